@@ -31,10 +31,6 @@ int main(int argc, char** argv) {
 
     int global_index = 0;
     while (!stream.empty()) {
-        stream.skip_comments();
-        if (stream.empty())
-            break;
-
         Global g;
         auto err = parse_global(stream, g);
         if (err) {
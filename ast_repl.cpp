@@ -1,5 +1,6 @@
 #include "parser.hpp"
 #include "ast_print.hpp"
+#include "jit.hpp"
 using namespace small_lang;
 
 // ------------------------------------------------------------
@@ -12,16 +13,18 @@ int main() {
     std::cout << "  :e           - Switch to expression mode\n";
     std::cout << "  :s           - Switch to statement mode\n";
     std::cout << "  :g           - Switch to global mode\n";
+    std::cout << "  :j           - Switch to JIT mode (compile and run globals)\n";
     std::cout << "  :t           - Toggle showing text ranges\n";
     std::cout << "  :i           - Toggle instant-commit mode (parse each line)\n";
     std::cout << "  :c           - Clear current input buffer\n";
     std::cout << "  :q           - Quit\n\n";
     std::cout << "Tip: Type code normally; a blank line commits and parses it.\n\n";
 
-    enum class Mode { Expr, Stmt, Global };
+    enum class Mode { Expr, Stmt, Global, Jit };
     Mode mode = Mode::Expr;
     bool show_text = false;
     bool instant_mode = true;
+    std::unique_ptr<ReplSession> session;//made on first use of :j
 
     std::string buffer;
     std::string line;
@@ -61,6 +64,14 @@ int main() {
                 mode = Mode::Global;
                 std::cout << "Mode: Global\n";
             }
+            else if (line == ":j") {
+                if (!session)
+                    session = ReplSession::create(RunOptions{});
+                if (session) {
+                    mode = Mode::Jit;
+                    std::cout << "Mode: JIT\n";
+                }
+            }
             else {
                 std::cout << "Unknown command.\n";
             }
@@ -85,6 +96,13 @@ int main() {
         if (!should_commit)
             continue;
 
+        if (mode == Mode::Jit) {
+            session->eval(std::move(buffer));
+            buffer.clear();
+            std::cout << "\n";
+            continue;
+        }
+
         std::string_view input = buffer;
         ParseStream stream(input);
 
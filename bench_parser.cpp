@@ -0,0 +1,91 @@
+#include "parser.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace small_lang;
+
+// ------------------------------------------------------------
+// Expression lexer + parser benchmark on 100k-term machine-generated inputs
+// ------------------------------------------------------------
+
+static constexpr int TERMS = 100000;
+
+struct BenchCase {
+    std::string name;
+    std::string src;
+};
+
+static std::vector<BenchCase> make_cases() {
+    std::vector<BenchCase> cases;
+    static const char* ops[] = {"+", "*", "-", "<", "==", "&&", "|", "/"};
+
+    std::string s;
+    for (int i = 0; i < TERMS; ++i) {
+        if (i) s += " + ";
+        s += std::to_string(i);
+    }
+    cases.push_back({"flat sum", s});
+
+    s.clear();
+    for (int i = 0; i < TERMS; ++i) {
+        if (i) s += ops[i % 8];
+        s += (i % 3) ? "x" : "f(y, 2)";
+    }
+    cases.push_back({"mixed precedence", s});
+
+    s.clear();
+    for (int i = 0; i < TERMS; ++i)
+        s += (i % 2) ? "-" : "!";
+    s += "a";
+    cases.push_back({"prefix chain", s});
+
+    s = std::string(TERMS, '(') + "a" + std::string(TERMS, ')');
+    cases.push_back({"nested parens", s});
+
+    s.clear();
+    for (int i = 0; i < TERMS; ++i)
+        s += "f(";
+    s += "0" + std::string(TERMS, ')');
+    cases.push_back({"nested calls", s});
+
+    s.clear();
+    for (int i = 0; i < TERMS; ++i)
+        s += "a = ";
+    s += "1";
+    cases.push_back({"assign chain", s});
+
+    return cases;
+}
+
+int main(int argc, char** argv) {
+    int reps = argc > 1 ? std::atoi(argv[1]) : 5;
+
+    std::cout << "=== Small-Lang parser bench (" << TERMS << " terms, best of " << reps << ") ===\n";
+
+    int failed = 0;
+    for (auto& c : make_cases()) {
+        double best = 1e30;
+        for (int r = 0; r < reps; ++r) {
+            Expression exp;
+
+            auto t0 = std::chrono::steady_clock::now();
+            ParseStream stream(c.src);//tokenizes up front, part of what we time
+            ParseError err = parse_expression(stream, exp);
+            auto t1 = std::chrono::steady_clock::now();
+
+            if (err || !stream.empty()) {
+                std::cerr << c.name << ": " << err.what(c.src).substr(0, 200) << "\n";
+                ++failed;
+                break;
+            }
+            best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+
+        std::cout << "  " << c.name << ": " << best << " ms ("
+                  << c.src.size() / 1024 << " KiB)\n";
+    }
+
+    return failed ? 1 : 0;
+}
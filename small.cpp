@@ -4,12 +4,13 @@
 #include <string>
 #include <string_view>
 #include <filesystem>
+#include <charconv>
 
 using namespace small_lang;
 
 static void print_help(const char* prog) {
     std::cout <<
-        "Usage: " << prog << " [options] <file>\n"
+        "Usage: " << prog << " [options] [lib.smallc...] <file>\n"
         "Options:\n"
         "  --no-run           Do not execute main()\n"
         "  --no-opt           Disable IR optimization\n"
@@ -17,6 +18,19 @@ static void print_help(const char* prog) {
         "  --print-globals    Print globals table\n"
         "  --print-ir-pre     Print IR before optimization\n"
         "  --print-ir-post    Print IR after optimization\n"
+        "  -g                 Emit debug info (line tables for gdb and perf)\n"
+        "  --release          Discard IR value names\n"
+        "  --profile-counts   Count function calls and If branches, print them after main()\n"
+        "  --report-promotions List the malloc/calloc calls moved to the stack\n"
+        "  --no-mir           Emit every function straight from the AST (skip the mid IR)\n"
+        "  --print-mir        Print the mid IR of the functions lowered through it\n"
+        "  --no-strict-aliasing Assume any pointer access may alias any other (no TBAA)\n"
+        "  --interp           Run main() in the bytecode interpreter if every function fits it\n"
+        "  --jit              Always JIT (by default small programs are interpreted)\n"
+        "  --emit-smallc <out> Write <file> as a precompiled module instead of running\n"
+        "  --workers <n>      Threads for spawn (default or 0: one per core)\n"
+        "  --link <lib.so>    Resolve C calls in a shared library\n"
+        "  --link-archive <lib.a> Resolve C calls in a static archive (bitcode members get inlined)\n"
         "  -h, --help         Show this message\n";
 }
 
@@ -40,12 +54,35 @@ int main(int argc, char** argv) {
         else if (arg == "--print-globals") opt.print_globals = true;
         else if (arg == "--print-ir-pre") opt.print_ir_pre = true;
         else if (arg == "--print-ir-post") opt.print_ir_post = true;
+        else if (arg == "-g") opt.debug_info = true;
+        else if (arg == "--release") opt.release = true;
+        else if (arg == "--profile-counts") opt.profile_counts = true;
+        else if (arg == "--report-promotions") opt.report_promotions = true;
+        else if (arg == "--no-mir") opt.mid_ir = false;
+        else if (arg == "--print-mir") opt.print_mir = true;
+        else if (arg == "--no-strict-aliasing") opt.strict_aliasing = false;
+        else if (arg == "--interp") opt.engine = Engine::Interp;
+        else if (arg == "--jit") opt.engine = Engine::Jit;
+        else if (arg == "--emit-smallc" && i + 1 < argc) opt.emit_smallc = argv[++i];
+        else if (arg == "--workers" && i + 1 < argc) {
+            std::string_view n = argv[++i];
+            auto [end, ec] = std::from_chars(n.data(), n.data() + n.size(), opt.workers);
+            if (ec != std::errc() || end != n.data() + n.size()) {
+                std::cerr << "Error: --workers takes a thread count, got: " << n << "\n";
+                print_help(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--link" && i + 1 < argc) opt.link_shared.emplace_back(argv[++i]);
+        else if (arg == "--link-archive" && i + 1 < argc) opt.link_archives.emplace_back(argv[++i]);
         else if (arg == "-h" || arg == "--help") {
             print_help(argv[0]);
             return 0;
         } else if (arg.starts_with('-')) {
             std::cerr << "Unknown flag: " << arg << "\n";
             return 1;
+        } else if (arg.ends_with(".smallc")) {
+            opt.link_smallc.emplace_back(arg);
         } else {
             input_path = arg;
         }
@@ -62,6 +99,8 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    opt.source_path = input_path.string();
+
     std::ifstream file(input_path);
     if (!file) {
         std::cerr << "Error: failed to open file: " << input_path << "\n";
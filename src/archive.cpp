@@ -0,0 +1,130 @@
+#include "archive.hpp"
+
+#include <llvm/Object/Archive.h>
+#include <llvm/BinaryFormat/Magic.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <iostream>
+
+namespace small_lang {
+
+std::unique_ptr<NativeArchive> NativeArchive::open(const std::string& path) {
+	auto bufExp = llvm::MemoryBuffer::getFile(path);
+	if (!bufExp) {
+		std::cerr << "[link] failed to open " << path << ": " << bufExp.getError().message() << "\n";
+		return nullptr;
+	}
+
+	auto ans = std::make_unique<NativeArchive>();
+	ans->path = path;
+	ans->buffer = std::move(*bufExp);
+
+	auto arExp = llvm::object::Archive::create(ans->buffer->getMemBufferRef());
+	if (!arExp) {
+		llvm::errs() << "[link] " << path << ": " << toString(arExp.takeError()) << "\n";
+		return nullptr;
+	}
+	ans->archive = std::move(*arExp);
+
+	llvm::Error err = llvm::Error::success();
+	for (auto& child : ans->archive->children(err)) {
+		auto mem = child.getMemoryBufferRef();
+		if (!mem) {
+			llvm::errs() << "[link] " << path << ": " << toString(mem.takeError()) << "\n";
+			return nullptr;
+		}
+		llvm::file_magic magic = llvm::identify_magic(mem->getBuffer());
+		if (magic == llvm::file_magic::bitcode) {
+			ans->has_bitcode = true;
+		} else if (magic.is_object()) {
+			ans->has_objects = true;
+		} else {
+			std::cerr << "[link] " << path << ": member " << mem->getBufferIdentifier().str()
+			          << " is neither an object file nor bitcode\n";
+			return nullptr;
+		}
+	}
+	if (err) {
+		llvm::errs() << "[link] " << path << ": " << toString(std::move(err)) << "\n";
+		return nullptr;
+	}
+	if (!ans->has_bitcode && !ans->has_objects) {
+		std::cerr << "[link] " << path << " has nothing to link\n";
+		return nullptr;
+	}
+	return ans;
+}
+
+NativeArchive::~NativeArchive() = default;
+
+std::unique_ptr<llvm::Module> NativeArchive::link_members(llvm::LLVMContext& ctx, const llvm::Module& like) const {
+	auto staging = std::make_unique<llvm::Module>(path, ctx);
+	llvm::Linker staged(*staging);
+
+	llvm::Error err = llvm::Error::success();
+	for (auto& child : archive->children(err)) {
+		auto mem = child.getMemoryBufferRef();
+		if (!mem) {
+			llvm::errs() << "[link] " << path << ": " << toString(mem.takeError()) << "\n";
+			return nullptr;
+		}
+		if (llvm::identify_magic(mem->getBuffer()) != llvm::file_magic::bitcode)
+			continue;
+
+		auto modExp = llvm::parseBitcodeFile(*mem, ctx);
+		if (!modExp) {
+			llvm::errs() << "[link] " << path << ": " << toString(modExp.takeError()) << "\n";
+			return nullptr;
+		}
+
+		//the JIT decides the target, and the inliner refuses callees whose
+		//cpu/features differ from the (attribute free) script functions
+		llvm::Module& m = **modExp;
+		m.setTargetTriple(like.getTargetTriple());
+		m.setDataLayout(like.getDataLayout());
+		for (llvm::Function& f : m) {
+			f.removeFnAttr("target-cpu");
+			f.removeFnAttr("target-features");
+			f.removeFnAttr("tune-cpu");
+		}
+
+		if (staged.linkInModule(std::move(*modExp))) {
+			std::cerr << "[link] failed to link a member of " << path << "\n";
+			return nullptr;
+		}
+	}
+	if (err) {
+		llvm::errs() << "[link] " << path << ": " << toString(std::move(err)) << "\n";
+		return nullptr;
+	}
+	return staging;
+}
+
+int NativeArchive::link_into(CompileContext& ctx, const std::vector<std::string_view>& wanted) const {
+	if (!has_bitcode)
+		return 0;
+
+	//members can call each other, so they are merged first and only then
+	//is what the script actually needs pulled out of the result
+	std::unique_ptr<llvm::Module> staging = link_members(*ctx.ctx, *ctx.mod);
+	if (!staging)
+		return 1;
+
+	//LinkOnlyNeeded only pulls what ctx.mod references, so declare the rest here
+	for (std::string_view name : wanted) {
+		llvm::Function* def = staging->getFunction(llvm::StringRef(name.data(), name.size()));
+		if (def && !def->isDeclaration())
+			ctx.mod->getOrInsertFunction(def->getName(), def->getFunctionType());
+	}
+
+	if (llvm::Linker::linkModules(*ctx.mod, std::move(staging), llvm::Linker::Flags::LinkOnlyNeeded)) {
+		std::cerr << "[link] failed to link " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+}//small_lang
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <string_view>
+
+#include "compiler.hpp"
+
+namespace llvm {
+class MemoryBuffer;
+class Module;
+class LLVMContext;
+namespace object { class Archive; }
+}
+
+namespace small_lang {
+
+// ------------------------------------------------------------
+// Static archives for --link-archive
+//   bitcode members are linked into the main module before optimization
+//   (so C helpers can be inlined into script code)
+//   object members are left to the JIT (StaticLibraryDefinitionGenerator
+//   over the buffer we already read, so keep the archive alive as long as the JIT)
+// ------------------------------------------------------------
+struct NativeArchive {
+	//null (after printing why) if the file cant be read or has nothing we can link
+	static std::unique_ptr<NativeArchive> open(const std::string& path);
+	~NativeArchive();
+
+	//every bitcode member linked into one module of ctx, targeting what like targets
+	//null (after printing why) on failure
+	std::unique_ptr<llvm::Module> link_members(llvm::LLVMContext& ctx, const llvm::Module& like) const;
+
+	//links what ctx.mod calls, plus anything in wanted (what other units call),
+	//out of the bitcode members, 0 on success
+	int link_into(CompileContext& ctx, const std::vector<std::string_view>& wanted) const;
+
+	std::string path;
+	bool has_bitcode = false;
+	bool has_objects = false;
+
+	std::unique_ptr<llvm::MemoryBuffer> buffer;
+	std::unique_ptr<llvm::object::Archive> archive;
+};
+
+}//small_lang
@@ -110,7 +110,33 @@ struct Call : Token{
 	std::vector<Expression> args;
 };
 
-using ExpressionVariant = std::variant<Invalid,Var,Num,PreOp,BinOp,TypeCast,SubScript,Call>;
+//spawn f(x): runs the call on the worker pool, evaluates to a pointer its result is stored through at sync
+struct Spawn : Token{
+	std::unique_ptr<Expression> call;//always a Call
+};
+
+//await h: runs the coroutine h to its return and evaluates to what it returned (h is gone after)
+//inside a coroutine every yield of h is passed on as our own, so it suspends with h
+struct Await : Token{
+	std::unique_ptr<Expression> handle;
+};
+
+//comptime e: e runs once while compiling (in a JIT of its own) and is replaced by the constant it made
+//it can call anything defined above it but cant see locals
+struct Comptime : Token{
+	std::unique_ptr<Expression> exp;
+};
+
+//if c then a else b: evaluates to a when c holds and to b otherwise, only the one taken runs
+//(when neither can trap or have effects both run and it is a select)
+//the else part takes the rest of the expression like an assignment would
+struct Conditional : Token{
+	std::unique_ptr<Expression> cond;
+	std::unique_ptr<Expression> then;
+	std::unique_ptr<Expression> other;
+};
+
+using ExpressionVariant = std::variant<Invalid,Var,Num,PreOp,BinOp,TypeCast,SubScript,Call,Spawn,Await,Comptime,Conditional>;
 struct Expression {
 	ExpressionVariant inner;
 	constexpr Expression() noexcept = default;
@@ -119,6 +145,9 @@ struct Expression {
     constexpr Expression(Expression&&) noexcept = default;
 	constexpr Expression& operator=(Expression&&) noexcept = default;
 
+	//iterative, generated code can nest deep enough to overflow a recursive one
+	~Expression();
+
 
 
 	 // construct from the variant directly
@@ -151,6 +180,93 @@ struct Expression {
     }
 };
 
+//moves the direct children of e into out (leaving empty shells behind)
+inline void detach_children(Expression& e, std::vector<Expression>& out) {
+	auto take = [&](std::unique_ptr<Expression>& p) {
+		if (p) out.push_back(std::move(*p));
+	};
+
+	if (auto* x = std::get_if<PreOp>(&e.inner)) {
+		take(x->exp);
+	} else if (auto* x = std::get_if<BinOp>(&e.inner)) {
+		take(x->a);
+		take(x->b);
+	} else if (auto* x = std::get_if<TypeCast>(&e.inner)) {
+		take(x->exp);
+	} else if (auto* x = std::get_if<SubScript>(&e.inner)) {
+		take(x->arr);
+		take(x->idx);
+	} else if (auto* x = std::get_if<Call>(&e.inner)) {
+		take(x->func);
+		for (auto& a : x->args)
+			out.push_back(std::move(a));
+	} else if (auto* x = std::get_if<Spawn>(&e.inner)) {
+		take(x->call);
+	} else if (auto* x = std::get_if<Await>(&e.inner)) {
+		take(x->handle);
+	} else if (auto* x = std::get_if<Comptime>(&e.inner)) {
+		take(x->exp);
+	} else if (auto* x = std::get_if<Conditional>(&e.inner)) {
+		take(x->cond);
+		take(x->then);
+		take(x->other);
+	}
+}
+
+inline Expression::~Expression() {
+	std::vector<Expression> pending;
+	detach_children(*this, pending);
+	while (!pending.empty()) {
+		Expression e = std::move(pending.back());
+		pending.pop_back();
+		detach_children(e, pending);
+	}
+}
+
+//can e run even when its value isnt wanted: no calls, stores, loads through a
+//pointer or division (which traps on zero), variables are fine
+inline bool speculatable(const Expression& e) {
+	std::vector<const Expression*> pending = {&e};
+	while (!pending.empty()) {
+		const Expression& x = *pending.back();
+		pending.pop_back();
+
+		if (std::holds_alternative<Var>(x.inner) || std::holds_alternative<Num>(x.inner)
+		 || std::holds_alternative<Comptime>(x.inner))//already a constant
+			continue;
+
+		if (auto* p = std::get_if<PreOp>(&x.inner)) {
+			if (p->op != Operator::Minus && p->op != Operator::Plus
+			 && p->op != Operator::Not && p->op != Operator::BitAnd)
+				return false;
+			pending.push_back(p->exp.get());
+		} else if (auto* b = std::get_if<BinOp>(&x.inner)) {
+			switch (b->op.kind) {
+			case Operator::Plus: case Operator::Minus: case Operator::Star:
+			case Operator::Lt: case Operator::Gt: case Operator::Le: case Operator::Ge:
+			case Operator::EqEq: case Operator::NotEq: case Operator::AndAnd: case Operator::OrOr:
+			case Operator::BitAnd: case Operator::BitOr: case Operator::BitXor:
+				break;
+			default:
+				return false;
+			}
+			pending.push_back(b->a.get());
+			pending.push_back(b->b.get());
+		} else if (auto* c = std::get_if<TypeCast>(&x.inner)) {
+			if (!c->exp)
+				return false;
+			pending.push_back(c->exp.get());
+		} else if (auto* c = std::get_if<Conditional>(&x.inner)) {
+			pending.push_back(c->cond.get());
+			pending.push_back(c->then.get());
+			pending.push_back(c->other.get());
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
 inline PreOp::PreOp(Op o, Expression expr,std::string_view t)
     : exp(std::make_unique<Expression>(std::move(expr))),
       op(o) {
@@ -169,6 +285,7 @@ struct Return : Token {
 
 struct Block : Token {
 	std::vector<Statement> parts;
+	bool cold = false;//cold { ... } as a branch, laid out after the rest of the function
 };
 
 struct CondStatement : Token {
@@ -182,7 +299,35 @@ struct If : CondStatement {
 };
 
 
-using statementVariant = std::variant<Invalid,While,If,Return,Block,Basic>;
+//region r { ... } r is a handle for alloc(r, size), everything allocated is freed when the block is left
+struct Region : Token {
+	Var name;
+	Block block;
+};
+
+//sync; waits for everything this function spawned (returns sync implicitly)
+struct Sync : Token {};
+
+//yield x; hands x to whoever resumed us and suspends, a function with one is a generator
+struct Yield : Token {
+	Expression val;
+};
+
+//one arm of a match, the values it takes and what runs for them
+struct MatchArm : Token {
+	std::vector<std::pair<int64_t, int64_t>> ranges;//inclusive, lo == hi for a single value
+	Block block;
+};
+
+//match x { 1, 3...5 stmt  6 { ... }  else stmt }  on an integer, the first arm holding the value runs
+//values the type cant hold never match (a char is -128...127, a bool 0...1)
+struct Match : Token {
+	Expression val;
+	std::vector<MatchArm> arms;
+	Block else_part;//empty when there is no else
+};
+
+using statementVariant = std::variant<Invalid,While,If,Return,Block,Basic,Region,Sync,Yield,Match>;
 struct Statement {
 	statementVariant inner;
 	operator std::string_view() const noexcept {
@@ -194,17 +339,42 @@ struct Statement {
 
 
 //global scope
+//cfn printf(@char* fmt, ...) -> @i32;  untyped parts default to int
 struct FuncDec : Token {
 	bool is_c = false;
+	bool varargs = false;
 	Var name;
-	std::vector<Var> args;
+	std::vector<Var> type_params;//fn name[T, U](@T* a, @U b), compiled once per argument types seen
+	std::vector<Var> args;//name may be empty in a declaration
+	std::vector<TypeDec> arg_types;//parallel to args, empty text means int
+	std::vector<bool> restrict_args;//parallel to args, @T* restrict p: nothing else p doesnt point into is reached through p
+	TypeDec ret;
 };
 
+//coroutines (async fn, or any function that yields) start suspended,
+//calling one returns its handle as an int for next/done/drop/await
 struct Function : FuncDec {
+	bool is_async = false;
 	Block body;
 };
 
-using globalVariant = std::variant<Invalid,FuncDec,Function,Basic>;
+//import "path.small"; (path is relative to the importing file)
+struct Import : Token {
+	std::string_view path;
+};
+
+//[export] [thread_local] @i32 hits = 0;  or just  hits = 0;  at the top level
+//internal to its file unless exported, thread_local gives one copy per thread
+//the initializer has to be a constant
+struct GlobalVar : Token {
+	bool is_thread_local = false;
+	bool is_exported = false;
+	TypeDec type;//empty text means int
+	Var name;
+	Expression init;//Invalid when there is none (zero)
+};
+
+using globalVariant = std::variant<Invalid,FuncDec,Function,Basic,Import,GlobalVar>;
 struct Global {
 	globalVariant inner;
 	operator std::string_view() const noexcept {
@@ -129,6 +129,36 @@ inline void stream(std::ostream& os, const Call& c, int indent, bool show_text)
     print_token(os, c, indent + 1, show_text);
 }
 
+inline void stream(std::ostream& os, const Spawn& s, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << "Spawn:\n";
+    stream(os, *s.call, indent + 1, show_text);
+    print_token(os, s, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Await& a, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << "Await:\n";
+    stream(os, *a.handle, indent + 1, show_text);
+    print_token(os, a, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Comptime& c, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << "Comptime:\n";
+    stream(os, *c.exp, indent + 1, show_text);
+    print_token(os, c, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Conditional& c, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << "Conditional:\n";
+    stream(os, *c.cond, indent + 1, show_text);
+    stream(os, *c.then, indent + 1, show_text);
+    stream(os, *c.other, indent + 1, show_text);
+    print_token(os, c, indent + 1, show_text);
+}
+
 // ============================================================
 // Expression dispatcher
 // ============================================================
@@ -170,6 +200,47 @@ inline void stream(std::ostream& os, const While& w, int indent, bool show_text)
     print_token(os, w, indent + 1, show_text);
 }
 
+inline void stream(std::ostream& os, const Region& r, int indent, bool show_text) {
+    for (int k = 0; k < indent; k++) os << "  ";
+    os << "Region: " << r.name.text << "\n";
+    stream(os, r.block, indent + 1, show_text);
+    print_token(os, r, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Sync& s, int indent, bool show_text) {
+    for (int k = 0; k < indent; k++) os << "  ";
+    os << "Sync\n";
+    print_token(os, s, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Yield& y, int indent, bool show_text) {
+    for (int k = 0; k < indent; k++) os << "  ";
+    os << "Yield:\n";
+    stream(os, y.val, indent + 1, show_text);
+    print_token(os, y, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const Match& m, int indent, bool show_text) {
+    for (int k = 0; k < indent; k++) os << "  ";
+    os << "Match:\n";
+    stream(os, m.val, indent + 1, show_text);
+    for (auto& arm : m.arms) {
+        for (int k = 0; k < indent; k++) os << "  ";
+        os << "  case";
+        for (auto [lo, hi] : arm.ranges) {
+            os << " " << lo;
+            if (hi != lo)
+                os << "..." << hi;
+        }
+        os << ":\n";
+        stream(os, arm.block, indent + 2, show_text);
+    }
+    for (int k = 0; k < indent; k++) os << "  ";
+    os << "  else:\n";
+    stream(os, m.else_part, indent + 2, show_text);
+    print_token(os, m, indent + 1, show_text);
+}
+
 inline void stream(std::ostream& os, const Basic& b, int indent, bool show_text) {
     for (int i = 0; i < indent; i++) os << "  ";
     os << "Basic Statement:\n";
@@ -179,7 +250,7 @@ inline void stream(std::ostream& os, const Basic& b, int indent, bool show_text)
 
 inline void stream(std::ostream& os, const Block& blk, int indent, bool show_text) {
     for (int i = 0; i < indent; i++) os << "  ";
-    os << "Block:\n";
+    os << (blk.cold ? "Block (cold):\n" : "Block:\n");
     for (const auto& s : blk.parts)
         stream(os, s, indent + 1, show_text);
     print_token(os, blk, indent + 1, show_text);
@@ -192,31 +263,59 @@ inline void stream(std::ostream& os, const Statement& stmt, int indent, bool sho
 // ============================================================
 // Functions and globals
 // ============================================================
-inline void stream(std::ostream& os, const FuncDec& fd, int indent, bool show_text) {
-    for (int i = 0; i < indent; i++) os << "  ";
-    os << (fd.is_c ? "C-FuncDec: " : "FuncDec: ") << fd.name.text << "(";
+//[T](a, @i32 b, ...) -> @type, untyped parts print like they were written
+inline void stream_signature(std::ostream& os, const FuncDec& fd) {
+    for (size_t i = 0; i < fd.type_params.size(); i++)
+        os << (i ? ", " : "[") << fd.type_params[i].text << (i + 1 < fd.type_params.size() ? "" : "]");
+    os << "(";
     for (size_t i = 0; i < fd.args.size(); i++) {
+        if (fd.arg_types[i].text.size())
+            os << fd.arg_types[i].text << (fd.restrict_args[i] ? " restrict" : "") << (fd.args[i].text.size() ? " " : "");
         os << fd.args[i].text;
-        if (i + 1 < fd.args.size()) os << ", ";
+        if (i + 1 < fd.args.size() || fd.varargs) os << ", ";
     }
-    os << ")\n";
+    if (fd.varargs) os << "...";
+    os << ")";
+    if (fd.ret.text.size())
+        os << " -> " << fd.ret.text;
+}
+
+inline void stream(std::ostream& os, const FuncDec& fd, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << (fd.is_c ? "C-FuncDec: " : "FuncDec: ") << fd.name.text;
+    stream_signature(os, fd);
+    os << "\n";
     print_token(os, fd, indent + 1, show_text);
 }
 
 inline void stream(std::ostream& os, const Function& fn, int indent, bool show_text) {
     for (int i = 0; i < indent; i++) os << "  ";
-    os << (fn.is_c ? "C-Function: " : "Function: ") << fn.name.text << "(";
-    for (size_t i = 0; i < fn.args.size(); i++) {
-        os << fn.args[i].text;
-        if (i + 1 < fn.args.size()) os << ", ";
-    }
-    os << ")\n";
+    os << (fn.is_c ? "C-Function: " : fn.is_async ? "Async-Function: " : "Function: ") << fn.name.text;
+    stream_signature(os, fn);
+    os << "\n";
     for (int i = 0; i < indent; i++) os << "  ";
     os << "  body:\n";
     stream(os, fn.body, indent + 2, show_text);
     print_token(os, fn, indent + 1, show_text);
 }
 
+inline void stream(std::ostream& os, const Import& im, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << "Import: \"" << im.path << "\"\n";
+    print_token(os, im, indent + 1, show_text);
+}
+
+inline void stream(std::ostream& os, const GlobalVar& v, int indent, bool show_text) {
+    for (int i = 0; i < indent; i++) os << "  ";
+    os << (v.is_exported ? "Exported " : "") << (v.is_thread_local ? "ThreadLocal: " : "GlobalVar: ");
+    if (v.type.text.size())
+        os << v.type.text << " ";
+    os << v.name.text << "\n";
+    if (!std::holds_alternative<Invalid>(v.init.inner))
+        stream(os, v.init, indent + 1, show_text);
+    print_token(os, v, indent + 1, show_text);
+}
+
 inline void stream(std::ostream& os, const Global& g, int indent, bool show_text) {
     std::visit([&](auto&& arg){ stream(os, arg, indent, show_text); }, g.inner);
 }
@@ -252,15 +351,25 @@ inline std::ostream& operator<<(std::ostream& os, const TypeCast& v)    { stream
 inline std::ostream& operator<<(std::ostream& os, const BinOp& v)       { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const SubScript& v)   { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const Call& v)        { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Spawn& v)       { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Await& v)       { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Comptime& v)    { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Conditional& v) { stream(os, v, 0, false); return os; }
 
 inline std::ostream& operator<<(std::ostream& os, const Return& v)      { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const If& v)          { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const While& v)       { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const Basic& v)       { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const Block& v)       { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Region& v)      { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Sync& v)        { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Yield& v)       { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Match& v)       { stream(os, v, 0, false); return os; }
 
 inline std::ostream& operator<<(std::ostream& os, const FuncDec& v)     { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const Function& v)    { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const Import& v)      { stream(os, v, 0, false); return os; }
+inline std::ostream& operator<<(std::ostream& os, const GlobalVar& v)   { stream(os, v, 0, false); return os; }
 inline std::ostream& operator<<(std::ostream& os, const Global& v)      { stream(os, v, 0, false); return os; }
 
 inline std::ostream& operator<<(std::ostream& os, const Expression& v)  { stream(os, v, 0, false); return os; }
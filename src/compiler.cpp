@@ -2,98 +2,173 @@
 #include "utils.hpp"
 #include <stdexcept>
 #include <algorithm>
+#include <filesystem>
+#include <format>
+#include <cstring>
 
 #include "ir_print.hpp"
+#include "mir.hpp"
+
+#include <llvm/IR/MDBuilder.h>
 
 
 #define FORWARD_UNEXPECTED(src) std::unexpected(std::move(src).error())
 
 
-static std::string concat_statements(std::string_view a, std::string_view b) {
-    std::string combined;
-    combined.reserve(a.size() + b.size());
+namespace small_lang {
 
-    // Copy first chunk as-is
-    combined.append(a.data(), a.size());
+Type* CompileContext::get_type(const TypeDec& t){
+	return get_type(t.name);
+}
 
-    // Copy second, collapsing whitespace runs to ≤4
-    size_t run = 0;
-    size_t len = std::min(b.size(),(size_t)100);
+Type* CompileContext::get_type(std::string_view name){
+	if(name.ends_with('*')){
+		Type* inner = get_type(name.substr(0,name.size()-1));
+		return inner ? pointer_to(inner) : nullptr;
+	}
 
-    for (size_t i =0;i<len;i++) {
-        if (std::isspace(static_cast<unsigned char>(b[i]))) {
-            if (run < 4) {
-                combined.push_back(' '); // normalize all whitespace to a single space
-                ++run;
-            }
-        } else {
-            run = 0;
-            combined.push_back(b[i]);
-        }
-    }
+	if(auto it = type_args.find(name); it != type_args.end())
+		return it->second;
+
+	if(name=="int")
+		return &int_type;
+	if(name=="bool")
+		return &bool_type;
+	if(name=="i32")
+		return &i32_type;
+	if(name=="char")
+		return &char_type;
+	if(name=="double")
+		return &double_type;
+	if(name=="void")
+		return &void_type;
 
-    return combined;
+	return nullptr;
 }
 
+Type* CompileContext::pointer_to(Type* t){
+	return intern(Type{llvm::PointerType::get(*ctx,0), t==&void_type ? nullptr : t, nullptr});
+}
 
+Type* CompileContext::canonical(const Type& t){
+	for(const Type* cur = &t; cur; cur = cur->stored)
+		if(cur->func)
+			return nullptr;
+	return intern(t);
+}
 
-namespace small_lang {
+Type* CompileContext::intern(const Type& t){
+	Type* stored = t.stored ? intern(*t.stored) : nullptr;
+	auto [it, fresh] = type_table.try_emplace({t.t, stored, t.func}, nullptr);
+	if(fresh)
+		it->second = &type_arena.emplace_back(Type{t.t, stored, t.func});
+	return it->second;
+}
 
-Type* CompileContext::get_type(const TypeDec& t){
-	if(t.name=="bool")
-		return &bool_type;
+FunctionType* CompileContext::intern(FunctionType f){
+	f.ret = *intern(f.ret);
+	for(Type& a : f.args)
+		a = *intern(a);
+
+	auto same = [&](const FunctionType* g){
+		if(g->ret.stored != f.ret.stored || g->ret.func != f.ret.func)
+			return false;
+		for(size_t i = 0; i < f.args.size(); ++i)
+			if(g->args[i].stored != f.args[i].stored || g->args[i].func != f.args[i].func)
+				return false;
+		return true;
+	};
+
+	//the llvm type already pins the widths and the arity, only what pointers point at is left
+	auto& bucket = func_table[{f.ft, f.cc}];
+	for(FunctionType* g : bucket)
+		if(same(g))
+			return g;
+	return bucket.emplace_back(&func_arena.emplace_back(std::move(f)));
+}
 
-	if(t.name=="int")
-		return &int_type;
+Value* CompileContext::local_value(Value v){
+	if(local_values_used == local_values.size())
+		local_values.emplace_back();
+	Value& slot = local_values[local_values_used++];
+	slot = v;
+	return &slot;
+}
 
-	//hack for now
+std::string CompileContext::type_name(const Type* t) const{
+	if(t->t->isPointerTy())
+		return (t->stored ? type_name(t->stored) : "void") + "*";
+
+	const std::pair<const Type*, const char*> bases[] = {
+		{&int_type, "int"}, {&bool_type, "bool"}, {&i32_type, "i32"},
+		{&char_type, "char"}, {&double_type, "double"}, {&void_type, "void"},
+	};
+	for(auto [base, name] : bases)
+		if(t == base)
+			return name;
+	return "?";
+}
 
-	if(t.name=="bool*")
-		return &bool_ptr_type;
+llvm::MDNode* CompileContext::tbaa(const Type& t){
+	if(!strict_aliasing)
+		return nullptr;
+	auto [it, fresh] = tbaa_tags.try_emplace(t.t, nullptr);
+	if(!fresh)
+		return it->second;
+
+	const char* name = t.t->isPointerTy() ? "any pointer"
+		: t.t->isDoubleTy() ? "double"
+		: t.t->isIntegerTy(1) ? "bool"
+		: t.t->isIntegerTy(8) ? "char"
+		: t.t->isIntegerTy(32) ? "i32"
+		: t.t->isIntegerTy(64) ? "int" : nullptr;
+	if(!name)
+		return nullptr;
+
+	//root <- char <- everything else, so only char is an ancestor of another type
+	llvm::MDBuilder md(*ctx);
+	llvm::MDNode* root = md.createTBAARoot("small tbaa");
+	llvm::MDNode* char_node = md.createTBAAScalarTypeNode("char", root);
+	llvm::MDNode* node = t.t->isIntegerTy(8) ? char_node : md.createTBAAScalarTypeNode(name, char_node);
+	return it->second = md.createTBAAStructTagNode(node, node, 0);
+}
 
-	if(t.name=="int*")
-		return &int_ptr_type;
+//C allocators, their results never alias anything else
+static constexpr std::string_view allocators[] = {
+	"malloc", "calloc", "realloc", "aligned_alloc", "strdup",
+};
 
-	return nullptr;
-}
+//the C11 names, relaxed is llvm's monotonic
+static constexpr std::pair<std::string_view, llvm::AtomicOrdering> orderings[] = {
+	{"relaxed", llvm::AtomicOrdering::Monotonic},
+	{"acquire", llvm::AtomicOrdering::Acquire},
+	{"release", llvm::AtomicOrdering::Release},
+	{"acq_rel", llvm::AtomicOrdering::AcquireRelease},
+	{"seq_cst", llvm::AtomicOrdering::SequentiallyConsistent},
+};
+
+//atomic_op(ptr, val, order) returns the old value
+static constexpr std::pair<std::string_view, llvm::AtomicRMWInst::BinOp> atomic_rmw_ops[] = {
+	{"atomic_add", llvm::AtomicRMWInst::Add},
+	{"atomic_sub", llvm::AtomicRMWInst::Sub},
+	{"atomic_and", llvm::AtomicRMWInst::And},
+	{"atomic_or", llvm::AtomicRMWInst::Or},
+	{"atomic_xor", llvm::AtomicRMWInst::Xor},
+	{"atomic_xchg", llvm::AtomicRMWInst::Xchg},
+	{"atomic_min", llvm::AtomicRMWInst::Min},
+	{"atomic_max", llvm::AtomicRMWInst::Max},
+};
 
 struct VisitorBase{
 	CompileContext& ctx;
 
+	//stored and func are interned (CompileContext::intern) so there is nothing to walk
 	bool types_exactly_equal(const Type& a, const Type& b) const {
-	    if (a.t == b.t)
-	        return true;
-	    
-	    if (a.stored && b.stored)
-	        return types_exactly_equal(*a.stored, *b.stored);
-
-
-	    // function type comparison
-	    if (a.func && b.func) {
-	        const FunctionType* fa = a.func;
-	        const FunctionType* fb = b.func;
-
-	        if (fa->cc != fb->cc)
-	            return false;
-	        if (!types_exactly_equal(fa->ret, fb->ret))
-	            return false;
-	        if (fa->args.size() != fb->args.size())
-	            return false;
-
-	        for (size_t i = 0; i < fa->args.size(); ++i)
-	            if (!types_exactly_equal(fa->args[i], fb->args[i]))
-	                return false;
-
-	        return true;
-	    }
-
-	    
-
-	    //TODO extend to support aggregate/struct comparison
-	    return false;
+	    return a.t == b.t && a.stored == b.stored && a.func == b.func;
 	}
 
-	void promote_integer_pair(Value& a, Value& b,bool isSigned = false) const {
+	//bools always zero extend, everything else follows isSigned
+	void promote_integer_pair(Value& a, Value& b,bool isSigned = true) const {
 	    auto* ta = llvm::cast<llvm::IntegerType>(a.type.t);
 	    auto* tb = llvm::cast<llvm::IntegerType>(b.type.t);
 
@@ -108,12 +183,12 @@ struct VisitorBase{
 	    llvm::Type* target_type = llvm::Type::getIntNTy(*ctx.ctx, target_width);
 
 	    if (wa < target_width) {
-	        a.v = ctx.builder.CreateIntCast(a.v, target_type,isSigned, "cast_up_a");
+	        a.v = ctx.builder.CreateIntCast(a.v, target_type,isSigned && wa > 1, "cast_up_a");
 	        a.type = Type{target_type,nullptr,nullptr};
 	    }
 
 	    if (wb < target_width) {
-	        b.v = ctx.builder.CreateIntCast(b.v, target_type, isSigned, "cast_up_b");
+	        b.v = ctx.builder.CreateIntCast(b.v, target_type, isSigned && wb > 1, "cast_up_b");
 	        b.type = Type{target_type,nullptr,nullptr};
 	    }
 	}
@@ -141,6 +216,10 @@ struct VisitorBase{
 	        return std::unexpected(BadType<D>{debug, target_type, val.type});
 	    }
 
+	    //every pointer (functions too) is the one opaque llvm type, they have always converted freely
+	    if (src->isPointerTy() && dst->isPointerTy())
+	        return {};
+
 	    // TODO: add the rest
 
 	    if(types_exactly_equal(val.type,target_type))
@@ -172,12 +251,57 @@ struct VisitorBase{
 	    	return {};
 	    }
 
+	    if (src->isIntegerTy() && dst->isPointerTy()){
+	    	val.v = ctx.builder.CreateIntToPtr(val.v, dst);
+	    	val.type = target_type;
+	    	return {};
+	    }
+
+	    if (src->isPointerTy() && dst->isIntegerTy()){
+	    	val.v = ctx.builder.CreatePtrToInt(val.v, dst);
+	    	val.type = target_type;
+	    	return {};
+	    }
+
+	    if (src->isIntegerTy() && dst->isFloatingPointTy()){
+	    	val.v = isSigned ? ctx.builder.CreateSIToFP(val.v, dst) : ctx.builder.CreateUIToFP(val.v, dst);
+	    	val.type = target_type;
+	    	return {};
+	    }
+
+	    if (src->isFloatingPointTy() && dst->isIntegerTy()){
+	    	val.v = ctx.builder.CreateFPToSI(val.v, dst);
+	    	val.type = target_type;
+	    	return {};
+	    }
+
 	    // TODO: add the rest
 	    if(types_exactly_equal(val.type,target_type))
 	    	return {};
 	    return std::unexpected(BadType<D>{debug, target_type, val.type});
 	}
 
+	//passing an argument or returning: integers convert to the declared width
+	//like they would in C (bools zero extend, anything to bool tests != 0)
+	template <typename D>
+	result_t assign_convert(Value& val, const Type& target_type, const D& debug) const {
+	    llvm::Type* src = val.type.t;
+	    llvm::Type* dst = target_type.t;
+	    if (!src->isIntegerTy() || !dst->isIntegerTy() || src == dst)
+	        return implicit_cast(val, target_type, debug);
+
+	    if (dst->isIntegerTy(1)) {
+	        vresult_t b = to_bool(val);
+	        if (!b) return FORWARD_UNEXPECTED(b);
+	        val = *b;
+	        return {};
+	    }
+
+	    val.v = ctx.builder.CreateIntCast(val.v, dst, !src->isIntegerTy(1));
+	    val.type = target_type;
+	    return {};
+	}
+
     vresult_t to_bool(Value val) const {
         // originally created bool comparisons depending on type
         // we keep structure but move to Value
@@ -205,10 +329,135 @@ struct VisitorBase{
 
         return std::unexpected(CantBool{val.type.t,nullptr,nullptr});
     }
+
+    //the callee name when it is a builtin, empty if the program defines its own
+    std::string_view builtin_name(const Call& c) const {
+        auto* name = std::get_if<Var>(&c.func->inner);
+        if (!name || ctx.local_var_addrs.find(name->text) || ctx.global_consts.contains(name->text)
+         || ctx.generics.contains(name->text))
+            return {};
+        return name->text;
+    }
+
+    //what likely(c), unlikely(c) or unpredictable(c) around a condition says about it
+    enum class Hint : uint8_t { None, Likely, Unlikely, Unpredictable };
+
+    //the weight of the expected side, the other gets 1 (what llvm.expect lowers to)
+    static constexpr uint32_t HOT_WEIGHT = 2000;
+
+    //the i1 an if tests, the hint is for the branch (or select) it ends up in
+    //likely/unlikely also go through llvm.expect so the guess follows the value
+    vresult_t condition(const Expression& e, Hint& hint) const {
+        const Expression* inner = &e;
+        hint = Hint::None;
+        if (auto* call = std::get_if<Call>(&e.inner); call && call->args.size() == 1) {
+            std::string_view name = builtin_name(*call);
+            hint = name == "likely" ? Hint::Likely
+                 : name == "unlikely" ? Hint::Unlikely
+                 : name == "unpredictable" ? Hint::Unpredictable : Hint::None;
+            if (hint != Hint::None)
+                inner = &call->args[0];
+        }
+
+        Value val;
+        result_t r = ctx.compile(*inner, val);
+        if (!r) return FORWARD_UNEXPECTED(r);
+        vresult_t b = to_bool(val);
+        if (!b || (hint != Hint::Likely && hint != Hint::Unlikely))
+            return b;
+        b->v = ctx.builder.CreateIntrinsic(llvm::Intrinsic::expect, {b->v->getType()},
+                                           {b->v, ctx.builder.getInt1(hint == Hint::Likely)});
+        return b;
+    }
+
+    //!unpredictable or !prof branch weights on a conditional branch or select
+    void mark(llvm::Instruction* inst, Hint hint) const {
+        if (hint == Hint::Unpredictable)
+            inst->setMetadata(llvm::LLVMContext::MD_unpredictable, llvm::MDNode::get(*ctx.ctx, {}));
+        else if (hint != Hint::None)
+            inst->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(*ctx.ctx).createBranchWeights(
+                hint == Hint::Likely ? HOT_WEIGHT : 1, hint == Hint::Likely ? 1 : HOT_WEIGHT));
+    }
+
+    //a cold arm says which way the branch into it goes, unless the condition already did
+    static Hint arms_hint(Hint hint, const Block& then, const Block& other) {
+        if (hint != Hint::None || then.cold == other.cold)
+            return hint;
+        return then.cold ? Hint::Unlikely : Hint::Likely;
+    }
+
+    // --- regions, the layout matches SmallRegion in runtime.hpp ---
+    llvm::StructType* region_type() const {
+        auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+        return llvm::StructType::get(*ctx.ctx, {ptr, ptr, ptr});
+    }
+
+    void region_release(llvm::Value* state) const {
+        auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+        auto release = ctx.mod->getOrInsertFunction("small_region_release",
+            llvm::FunctionType::get(ctx.builder.getVoidTy(), {ptr}, false));
+        llvm::cast<llvm::Function>(release.getCallee())->addFnAttr(llvm::Attribute::NoUnwind);
+        ctx.builder.CreateCall(release, {state});
+    }
+
+    // --- spawn/sync, see SmallTask in runtime.hpp ---
+    //spawns textually after a sync (or return) cant have run before it, there are no loops
+    void sync_spawns() const {
+        if (!ctx.spawned)
+            return;
+        auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+        auto sync = ctx.mod->getOrInsertFunction("small_sync",
+            llvm::FunctionType::get(ctx.builder.getVoidTy(), {ptr}, false));
+        llvm::cast<llvm::Function>(sync.getCallee())->addFnAttr(llvm::Attribute::NoUnwind);
+        ctx.builder.CreateCall(sync, {ctx.spawned});
+    }
+
+    // --- coroutines, see Coroutine in compiler.hpp ---
+    //the i64 a coroutine yields and returns through, handle is a coro.begin pointer
+    llvm::Value* coro_promise(llvm::Value* handle) const {
+        auto& b = ctx.builder;
+        return b.CreateIntrinsic(llvm::Intrinsic::coro_promise, {}, {handle, b.getInt32(8), b.getFalse()});
+    }
+
+    //0 resumes into resumed, 1 is the frame being destroyed, anything else returns to the resumer
+    void coro_suspend(bool final, llvm::BasicBlock* resumed, llvm::BasicBlock* destroyed) const {
+        auto& b = ctx.builder;
+        llvm::Value* token = llvm::ConstantTokenNone::get(*ctx.ctx);
+        llvm::Value* state = b.CreateIntrinsic(llvm::Intrinsic::coro_suspend, {}, {token, b.getInt1(final)});
+        llvm::SwitchInst* sw = b.CreateSwitch(state, ctx.coro.suspend, 2);
+        sw->addCase(b.getInt8(0), resumed);
+        sw->addCase(b.getInt8(1), destroyed);
+    }
+
+    //where a suspension point goes when its frame is destroyed instead of resumed,
+    //whatever is open at that point (regions, spawns, an awaited child) is closed on the way out
+    llvm::BasicBlock* coro_destroyed(llvm::Value* child = nullptr) const {
+        if (!child && !ctx.spawned && ctx.regions.empty())
+            return ctx.coro.cleanup;
+
+        auto& b = ctx.builder;
+        llvm::BasicBlock* here = b.GetInsertBlock();
+        auto* block = llvm::BasicBlock::Create(*ctx.ctx, "coro.destroyed", here->getParent());
+        b.SetInsertPoint(block);
+        if (child)
+            b.CreateIntrinsic(llvm::Intrinsic::coro_destroy, {}, {child});
+        sync_spawns();
+        for (auto it = ctx.regions.rbegin(); it != ctx.regions.rend(); ++it)
+            region_release(*it);
+        b.CreateBr(ctx.coro.cleanup);
+        b.SetInsertPoint(here);
+        return block;
+    }
 };
 
 struct ExpressionVisitor : VisitorBase{
 	Value& out;
+
+    bool is_global_variable(std::string_view name) const {
+        auto it = ctx.global_consts.find(name);
+        return it != ctx.global_consts.end() && llvm::isa<llvm::GlobalVariable>(it->second->v);
+    }
+
     result_t operator()(const Invalid&) const {
         throw std::invalid_argument("uninit expression");
     }
@@ -221,14 +470,29 @@ struct ExpressionVisitor : VisitorBase{
 
     result_t operator()(const Var& v) const {
         if (auto it = ctx.local_var_addrs.find(v.text); it != ctx.local_var_addrs.end()) {
-            Value* addr = it->get();
+            Value* addr = *it;
             out.type = *addr->type.stored;
             out.v = ctx.builder.CreateLoad(out.type.t, addr->v, v.text);
             out.address = addr;
             return {};
         }
         if (auto it = ctx.global_consts.find(v.text); it != ctx.global_consts.end()){
-        	out = *it->second;
+            Value* global = it->second.get();
+            auto* var = llvm::dyn_cast<llvm::GlobalVariable>(global->v);
+            if (!var) {
+                out = *global;
+                return {};
+            }
+
+            //thread locals have a different address on every thread, so it is looked up here
+            if (var->isThreadLocal()) {
+                global = ctx.local_value(*global);
+                global->v = ctx.builder.CreateThreadLocalAddress(var);
+            }
+
+            out.type = *global->type.stored;
+            out.v = ctx.builder.CreateLoad(out.type.t, global->v, v.text);
+            out.address = global;
             return {};
         }
         return std::unexpected(MissingVar{v});
@@ -237,16 +501,156 @@ struct ExpressionVisitor : VisitorBase{
     result_t operator()(const TypeCast& cast) const {
     	Type* type = ctx.get_type(cast.type);
     	if(!type)
-        	TODO;
+        	return std::unexpected(UnknownType{cast.type});
 
         result_t r = ctx.compile(*cast.exp,out);
         if(!r) return FORWARD_UNEXPECTED(r);
 
-        result_t r2 = exiplicit_cast(out,*type,cast);
+        bool is_signed = out.type.t->isIntegerTy() && !out.type.t->isIntegerTy(1);
+        result_t r2 = exiplicit_cast(out,*type,cast,is_signed);
         if(!r2) return FORWARD_UNEXPECTED(r2);
         return {};
     }
 
+    //*p, which stays assignable through its address
+    void load_through(const Value& p) const {
+        out.type = *p.type.stored;
+        llvm::LoadInst* load = ctx.builder.CreateLoad(out.type.t, p.v);
+        if (llvm::MDNode* tag = ctx.tbaa(out.type))
+            load->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+        out.v = load;
+        out.address = ctx.local_value(p);
+    }
+
+    //p + i (or p - i) counted in what p points at, void* in bytes like GNU C
+    //inbounds like C, stepping off the object (past one after its end) is undefined
+    vresult_t pointer_step(Value p, Value i, bool back, const Expression& at) const {
+        if (!i.type.t->isIntegerTy())
+            return std::unexpected(BadType<Expression>{at, ctx.int_type, i.type});
+        llvm::Value* idx = ctx.builder.CreateIntCast(i.v, ctx.int_type.t, !i.type.t->isIntegerTy(1), "idx");
+        if (back)
+            idx = ctx.builder.CreateNeg(idx, "idx");
+        llvm::Type* element = p.type.stored ? p.type.stored->t : ctx.builder.getInt8Ty();
+        p.v = ctx.builder.CreateInBoundsGEP(element, p.v, idx, "elem");
+        p.address = nullptr;
+        return p;
+    }
+
+    //p +- int, int + p, p - q (in elements) and unsigned compares, ptrtoint is left to explicit casts
+    result_t pointer_binop(Value a, Value b, const BinOp& bin_op) const {
+        auto kind = bin_op.op.kind;
+        bool a_ptr = a.type.t->isPointerTy() && !a.type.func;
+        bool b_ptr = b.type.t->isPointerTy() && !b.type.func;
+
+        if (kind == Operator::AndAnd || kind == Operator::OrOr) {
+            auto lhs = to_bool(a);
+            if (!lhs) return FORWARD_UNEXPECTED(lhs);
+            auto rhs = to_bool(b);
+            if (!rhs) return FORWARD_UNEXPECTED(rhs);
+            out.v = kind == Operator::AndAnd ? ctx.builder.CreateAnd(lhs->v, rhs->v, "andtmp")
+                                             : ctx.builder.CreateOr(lhs->v, rhs->v, "ortmp");
+            out.type = lhs->type;
+            return {};
+        }
+
+        if (a_ptr && b_ptr) {
+            if (!types_exactly_equal(a.type, b.type) && kind == Operator::Minus)
+                return std::unexpected(BadType<BinOp>{bin_op, a.type, b.type});
+
+            auto cmp = [&](llvm::CmpInst::Predicate pred) -> result_t {
+                out.v = ctx.builder.CreateICmp(pred, a.v, b.v);
+                out.type = ctx.bool_type;
+                return {};
+            };
+            switch (kind) {
+            case Operator::Minus: {
+                llvm::Type* element = a.type.stored ? a.type.stored->t : ctx.builder.getInt8Ty();
+                out.v = ctx.builder.CreatePtrDiff(element, a.v, b.v, "ptrdiff");
+                out.type = ctx.int_type;
+                return {};
+            }
+            case Operator::Lt:    return cmp(llvm::CmpInst::ICMP_ULT);
+            case Operator::Gt:    return cmp(llvm::CmpInst::ICMP_UGT);
+            case Operator::Le:    return cmp(llvm::CmpInst::ICMP_ULE);
+            case Operator::Ge:    return cmp(llvm::CmpInst::ICMP_UGE);
+            case Operator::EqEq:  return cmp(llvm::CmpInst::ICMP_EQ);
+            case Operator::NotEq: return cmp(llvm::CmpInst::ICMP_NE);
+            default:
+                return std::unexpected(BadType<BinOp>{bin_op, ctx.int_type, b.type});
+            }
+        }
+
+        if (a_ptr && (kind == Operator::Plus || kind == Operator::Minus)) {
+            vresult_t r = pointer_step(a, b, kind == Operator::Minus, *bin_op.b);
+            if (!r) return FORWARD_UNEXPECTED(r);
+            out = *r;
+            return {};
+        }
+        if (b_ptr && kind == Operator::Plus) {
+            vresult_t r = pointer_step(b, a, false, *bin_op.a);
+            if (!r) return FORWARD_UNEXPECTED(r);
+            out = *r;
+            return {};
+        }
+        return std::unexpected(BadType<BinOp>{bin_op, ctx.int_type, a_ptr || a.type.func ? a.type : b.type});
+    }
+
+    //double (or float) arithmetic and ordered compares, an int operand converts like it would in C
+    result_t float_binop(Value a, Value b, const BinOp& bin_op) const {
+        auto kind = bin_op.op.kind;
+        auto& bld = ctx.builder;
+        if (!a.type.t->isFloatingPointTy() && !a.type.t->isIntegerTy())
+            return std::unexpected(BadType<BinOp>{bin_op, b.type, a.type});
+        if (!b.type.t->isFloatingPointTy() && !b.type.t->isIntegerTy())
+            return std::unexpected(BadType<BinOp>{bin_op, a.type, b.type});
+
+        //the wider float wins, ints (bools unsigned) convert to it
+        Type type = !b.type.t->isFloatingPointTy() ? a.type
+                  : !a.type.t->isFloatingPointTy() ? b.type
+                  : a.type.t->getPrimitiveSizeInBits() >= b.type.t->getPrimitiveSizeInBits() ? a.type : b.type;
+        for (Value* v : {&a, &b}) {
+            if (v->type.t == type.t)
+                continue;
+            v->v = v->type.t->isIntegerTy() ? v->type.t->isIntegerTy(1) ? bld.CreateUIToFP(v->v, type.t)
+                                                                         : bld.CreateSIToFP(v->v, type.t)
+                                            : bld.CreateFPExt(v->v, type.t);
+            v->type = type;
+        }
+
+        auto cmp = [&](llvm::CmpInst::Predicate pred) -> result_t {
+            out.v = bld.CreateFCmp(pred, a.v, b.v);
+            out.type = ctx.bool_type;
+            return {};
+        };
+        out.type = type;
+        switch (kind) {
+        case Operator::Plus:    out.v = bld.CreateFAdd(a.v, b.v); return {};
+        case Operator::Minus:   out.v = bld.CreateFSub(a.v, b.v); return {};
+        case Operator::Star:    out.v = bld.CreateFMul(a.v, b.v); return {};
+        case Operator::Slash:   out.v = bld.CreateFDiv(a.v, b.v); return {};
+        case Operator::Percent: out.v = bld.CreateFRem(a.v, b.v); return {};
+        case Operator::Lt:    return cmp(llvm::CmpInst::FCMP_OLT);
+        case Operator::Gt:    return cmp(llvm::CmpInst::FCMP_OGT);
+        case Operator::Le:    return cmp(llvm::CmpInst::FCMP_OLE);
+        case Operator::Ge:    return cmp(llvm::CmpInst::FCMP_OGE);
+        case Operator::EqEq:  return cmp(llvm::CmpInst::FCMP_OEQ);
+        case Operator::NotEq: return cmp(llvm::CmpInst::FCMP_UNE);//nan != nan like C
+        case Operator::AndAnd:
+        case Operator::OrOr: {
+            auto lhs = to_bool(a);
+            if (!lhs) return FORWARD_UNEXPECTED(lhs);
+            auto rhs = to_bool(b);
+            if (!rhs) return FORWARD_UNEXPECTED(rhs);
+            out.v = kind == Operator::AndAnd ? bld.CreateAnd(lhs->v, rhs->v, "andtmp")
+                                             : bld.CreateOr(lhs->v, rhs->v, "ortmp");
+            out.type = lhs->type;
+            return {};
+        }
+        default://bitwise ops have no float meaning
+            return std::unexpected(BadType<BinOp>{bin_op, ctx.int_type, type});
+        }
+    }
+
     result_t pointer_preop(Value a,const PreOp& pre_op) const{
 	    switch (pre_op.op.kind) {
 	    case Operator::BitAnd:{
@@ -260,12 +664,7 @@ struct ExpressionVisitor : VisitorBase{
 	    	if(!a.type.stored)
 	    		TODO
 
-	        out.type = *a.type.stored;
-	        out.v = ctx.builder.CreateLoad(out.type.t, a.v);
-
-	        auto au = std::make_unique<Value>(a);
-	        out.address = au.get();
-	        ctx.local_arena.emplace_back(std::move(au));
+	        load_through(a);
 	        return {};
 	    }
 	    case Operator::Not: {
@@ -292,8 +691,25 @@ struct ExpressionVisitor : VisitorBase{
 	    if(a.type.t->isPointerTy())
 	    	return pointer_preop(a,pre_op);
 
+	    if(a.type.t->isFloatingPointTy()) {
+	    	switch (pre_op.op.kind) {
+	    	case Operator::Minus:
+	    		out.v = ctx.builder.CreateFNeg(a.v, "neg");
+	    		out.type = a.type;
+	    		return {};
+	    	case Operator::Not:
+	    		out.v = ctx.builder.CreateFCmpOEQ(a.v, llvm::ConstantFP::get(a.type.t, 0.0), "logical_not");
+	    		out.type = ctx.bool_type;
+	    		return {};
+	    	case Operator::Plus:
+	    	case Operator::BitAnd:
+	    		break;//same as for ints
+	    	default:
+	    		return std::unexpected(BadType<Expression>{*pre_op.exp, ctx.int_type, a.type});
+	    	}
+	    }
 	    // Check: only integer types allowed for now
-	    if (!a.type.t->isIntegerTy())
+	    else if (!a.type.t->isIntegerTy())
 	        TODO; // non-integer preops not handled yet
 
 	    out.type = a.type;
@@ -333,21 +749,21 @@ struct ExpressionVisitor : VisitorBase{
 	result_t operator()(const BinOp& bin_op) const {
 	    Value a, b;
 
-	    // auto-mint specialization (degenerate assign)
+	    // auto-mint specialization (degenerate assign), global variables are assigned like any other
 	    if (bin_op.op.kind == Operator::Assign)
 	    if (const auto var = std::get_if<Var>(&bin_op.a->inner))
-	    if (ctx.local_var_addrs.find(var->text) == ctx.local_var_addrs.end()) {
+	    if (ctx.local_var_addrs.find(var->text) == ctx.local_var_addrs.end() && !is_global_variable(var->text)) {
 	        result_t rb = ctx.compile(*bin_op.b,b);
 	        if (!rb) return FORWARD_UNEXPECTED(rb);
+	        if (b.type.t->isVoidTy())//nothing to keep, a call to a void cfn
+	            return std::unexpected(BadType<BinOp>{bin_op, ctx.int_type, b.type});
 
-	        auto slot = std::make_unique<Value>();
+	        Value* slot = ctx.local_value();
 	        slot->v = ctx.builder.CreateAlloca(b.type.t, nullptr, var->text);
-	        
-	        Type* type = ctx.local_type_arena.emplace_back(std::make_unique<Type>(b.type)).get();//TODO better alocation scheme
-	        slot->type = {slot->v->getType(),type,nullptr};
+	        slot->type = {slot->v->getType(),ctx.intern(b.type),nullptr};
 	        
 	        ctx.builder.CreateStore(b.v, slot->v);
-	        ctx.local_var_addrs[var->text] = std::move(slot);
+	        ctx.local_var_addrs[var->text] = slot;
 	        out = b;
 	        return {};
 	    }
@@ -364,11 +780,20 @@ struct ExpressionVisitor : VisitorBase{
 			result_t r = implicit_cast(b,*mem.type.stored,bin_op);
 			if(!r) return FORWARD_UNEXPECTED(r);
 
-			ctx.builder.CreateStore(b.v, mem.v);
+			//variables are left untagged, &x can be cast to any pointer and llvm sees through them anyway
+			llvm::StoreInst* store = ctx.builder.CreateStore(b.v, mem.v);
+			if (!llvm::isa<llvm::AllocaInst, llvm::GlobalVariable>(mem.v))
+			    if (llvm::MDNode* tag = ctx.tbaa(*mem.type.stored))
+			        store->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
 			out = b;
 			return {};
 	    }
 
+		if (a.type.t->isPointerTy() || b.type.t->isPointerTy())
+			return pointer_binop(a, b, bin_op);
+		if (a.type.t->isFloatingPointTy() || b.type.t->isFloatingPointTy())
+			return float_binop(a, b, bin_op);
+
 	  	// --- type normalization ---
 		if (a.type.t->isIntegerTy() && b.type.t->isIntegerTy()) {
 		    promote_integer_pair(a, b);
@@ -474,42 +899,374 @@ struct ExpressionVisitor : VisitorBase{
 
 
 
-    result_t operator()(const SubScript&) const {
-        TODO;
+    //p[i] is *(p + i)
+    result_t operator()(const SubScript& s) const {
+        Value p, i;
+        result_t rp = ctx.compile(*s.arr, p);
+        if (!rp) return FORWARD_UNEXPECTED(rp);
+        if (!p.type.t->isPointerTy() || !p.type.stored)
+            return std::unexpected(BadType<Expression>{*s.arr, ctx.int_ptr_type, p.type});
+
+        result_t ri = ctx.compile(*s.idx, i);
+        if (!ri) return FORWARD_UNEXPECTED(ri);
+        vresult_t elem = pointer_step(p, i, false, *s.idx);
+        if (!elem) return FORWARD_UNEXPECTED(elem);
+        load_through(*elem);
+        return {};
     }
 
-    result_t operator()(const Call& c) const {
-	    Value fn_val;
-	    result_t rf = ctx.compile(*c.func,fn_val);
-	    if (!rf) return FORWARD_UNEXPECTED(rf);
+    //alloc(r, size): bump the region inline, only a full chunk calls into the runtime
+    result_t region_alloc(const Call& c) const {
+        if (c.args.size() != 2)
+            return std::unexpected(WrongArgCount{c, nullptr});
+
+        Value handle, size;
+        result_t rh = ctx.compile(c.args[0], handle);
+        if (!rh) return FORWARD_UNEXPECTED(rh);
+        result_t rh2 = implicit_cast(handle, ctx.int_type, c.args[0]);
+        if (!rh2) return FORWARD_UNEXPECTED(rh2);
+
+        result_t rs = ctx.compile(c.args[1], size);
+        if (!rs) return FORWARD_UNEXPECTED(rs);
+        result_t rs2 = implicit_cast(size, ctx.int_type, c.args[1]);
+        if (!rs2) return FORWARD_UNEXPECTED(rs2);
+
+        auto& b = ctx.builder;
+        auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+        llvm::Type* i64 = ctx.int_type.t;
+        llvm::StructType* rt = region_type();
+
+        llvm::Value* state = b.CreateIntToPtr(handle.v, ptr);
+        //size 0 still takes 8 bytes so every alloc gets its own non null address
+        llvm::Value* at_least_one = b.CreateBinaryIntrinsic(llvm::Intrinsic::umax, size.v, b.getInt64(1));
+        llvm::Value* bytes = b.CreateAnd(b.CreateAdd(at_least_one, b.getInt64(7)), b.getInt64(-8));
+
+        llvm::Value* cur_slot = b.CreateStructGEP(rt, state, 0);
+        llvm::Value* cur = b.CreateLoad(ptr, cur_slot);
+        llvm::Value* end = b.CreateLoad(ptr, b.CreateStructGEP(rt, state, 1));
+        llvm::Value* avail = b.CreateSub(b.CreatePtrToInt(end, i64), b.CreatePtrToInt(cur, i64));
+
+        llvm::Function* func = b.GetInsertBlock()->getParent();
+        auto bbump = llvm::BasicBlock::Create(*ctx.ctx, "bump", func);
+        auto bgrow = llvm::BasicBlock::Create(*ctx.ctx, "grow", func);
+        auto bdone = llvm::BasicBlock::Create(*ctx.ctx, "allocated", func);
+        //bytes - 1 < avail is bytes <= avail, except a size that wrapped to 0 goes to grow which rejects it
+        b.CreateCondBr(b.CreateICmpULT(b.CreateSub(bytes, b.getInt64(1)), avail), bbump, bgrow,
+                       llvm::MDBuilder(*ctx.ctx).createBranchWeights(HOT_WEIGHT, 1));
+
+        b.SetInsertPoint(bbump);
+        b.CreateStore(b.CreateGEP(b.getInt8Ty(), cur, bytes), cur_slot);
+        b.CreateBr(bdone);
+
+        b.SetInsertPoint(bgrow);
+        auto grow = ctx.mod->getOrInsertFunction("small_region_grow",
+            llvm::FunctionType::get(ptr, {ptr, i64}, false));
+        auto* grow_fn = llvm::cast<llvm::Function>(grow.getCallee());
+        grow_fn->addFnAttr(llvm::Attribute::NoUnwind);
+        grow_fn->addFnAttr(llvm::Attribute::Cold);
+        grow_fn->addRetAttr(llvm::Attribute::NonNull);
+        llvm::Value* fresh = b.CreateCall(grow, {state, bytes});
+        b.CreateBr(bdone);
+
+        b.SetInsertPoint(bdone);
+        llvm::PHINode* mem = b.CreatePHI(ptr, 2);
+        mem->addIncoming(cur, bbump);
+        mem->addIncoming(fresh, bgrow);
+
+        out.v = b.CreatePtrToInt(mem, i64);
+        out.type = ctx.int_type;
+        return {};
+    }
+
+    //the callee and its converted arguments, shared by calls and spawns
+    //the generic c calls (by name, locals shadow it), null for anything else
+    const Function* generic(const Call& c) const {
+        auto* name = std::get_if<Var>(&c.func->inner);
+        if (!name || ctx.local_var_addrs.find(name->text))
+            return nullptr;
+        auto it = ctx.generics.find(name->text);
+        return it == ctx.generics.end() ? nullptr : it->second;
+    }
+
+    //binds every type parameter of g from the compiled arguments (@T matches the
+    //argument type, @T* one pointer level in ...) then finds or makes that instance
+    result_t instance(const Call& c, const Function& g, const std::vector<Value>& args, Value& fn_val) const {
+        if (g.varargs ? args.size() < g.args.size() : args.size() != g.args.size())
+            return std::unexpected(WrongArgCount{c, nullptr});
+
+        std::map<std::string_view, Type*> bound;
+        for (size_t i = 0; i < g.args.size(); ++i) {
+            std::string_view base = g.arg_types[i].name;
+            size_t depth = 0;
+            while (base.ends_with('*'))
+                base.remove_suffix(1), ++depth;
+
+            auto param = std::find_if(g.type_params.begin(), g.type_params.end(),
+                [&](const Var& p) { return p.text == base; });
+            if (g.arg_types[i].text.empty() || param == g.type_params.end())
+                continue;
+
+            Type* t = ctx.canonical(args[i].type);
+            for (; t && depth; --depth)
+                t = t->t->isPointerTy() ? t->stored : nullptr;
+            if (!t || t->t->isVoidTy())
+                return std::unexpected(CantInfer{c, *param, {}, args[i].type});
+
+            auto [it, fresh] = bound.emplace(base, t);
+            if (!fresh && it->second != t)
+                return std::unexpected(CantInfer{c, *param, *it->second, *t});
+        }
+
+        std::string name = std::string(g.name.text) + "[";
+        for (const Var& p : g.type_params) {
+            auto it = bound.find(p.text);
+            if (it == bound.end())
+                return std::unexpected(CantInfer{c, p, {}, {}});
+            name += ctx.type_name(it->second) + (&p == &g.type_params.back() ? "]" : ",");
+        }
+
+        auto cached = ctx.global_consts.find(name);
+        if (cached == ctx.global_consts.end()) {
+            std::string_view stable = *ctx.instance_names.insert(name).first;
+            result_t r = ctx.instantiate(c, g, stable, std::move(bound));
+            if (!r) return r;
+            cached = ctx.global_consts.find(stable);
+        }
+        fn_val = *cached->second;
+        return {};
+    }
+
+    result_t call_operands(const Call& c, Value& fn_val, std::vector<llvm::Value*>& arg_vals) const {
+	    //a generic needs the argument types before there is a callee
+	    std::vector<Value> early;
+	    if (const Function* g = generic(c)) {
+	        for (auto& e : c.args) {
+	            result_t ra = ctx.compile(e, early.emplace_back());
+	            if (!ra) return FORWARD_UNEXPECTED(ra);
+	        }
+	        result_t ri = instance(c, *g, early, fn_val);
+	        if (!ri) return ri;
+	    } else {
+	        result_t rf = ctx.compile(*c.func,fn_val);
+	        if (!rf) return FORWARD_UNEXPECTED(rf);
+	    }
 
 	    // must be a function
 	    if (!fn_val.type.func || !fn_val.type.func->ft)
 	        return std::unexpected(NotAFunction{*c.func, fn_val.type.t});
 
 	    FunctionType* fnty = fn_val.type.func;
+	    size_t fixed = fnty->args.size();
+	    bool varargs = fnty->ft->isVarArg();
 
 	    // argument count check
-	    if (fnty->args.size() != c.args.size())
+	    if (varargs ? c.args.size() < fixed : c.args.size() != fixed)
 	        return std::unexpected(WrongArgCount{c, fnty});
 
 	    // compile arguments
-	    std::vector<llvm::Value*> arg_vals;
 	    arg_vals.reserve(c.args.size());
 	    for (size_t i = 0; i < c.args.size(); ++i) {
 	        Value a;
-	        result_t ra = ctx.compile(c.args[i],a);
-	        if (!ra) return FORWARD_UNEXPECTED(ra);
+	        if (i < early.size()) {
+	            a = early[i];
+	        } else {
+	            result_t ra = ctx.compile(c.args[i],a);
+	            if (!ra) return FORWARD_UNEXPECTED(ra);
+	        }
+
+	        if (i < fixed) {
+	            result_t rc = assign_convert(a, fnty->args[i], c.args[i]);
+	            if (!rc) return FORWARD_UNEXPECTED(rc);
+	        } else if (a.type.t->isIntegerTy() && a.type.t->getIntegerBitWidth() < 32) {
+	            //default argument promotion for the ... part
+	            a.v = ctx.builder.CreateIntCast(a.v, ctx.i32_type.t, !a.type.t->isIntegerTy(1));
+	        }
 	        arg_vals.push_back(a.v);
+	    }
+	    return {};
+	}
+
+    //a constant ordering argument, store/load/fence each rule some out
+    std::expected<llvm::AtomicOrdering, CompileError> ordering(const Expression& e, bool load, bool store) const {
+        auto* name = std::get_if<Var>(&e.inner);
+        for (auto [spelling, order] : orderings) {
+            if (!name || name->text != spelling)
+                continue;
+            if (load && !store && (order == llvm::AtomicOrdering::Release || order == llvm::AtomicOrdering::AcquireRelease))
+                break;
+            if (store && !load && (order == llvm::AtomicOrdering::Acquire || order == llvm::AtomicOrdering::AcquireRelease))
+                break;
+            return order;
+        }
+        return std::unexpected(BadOrdering{e});
+    }
+
+    //the pointer operand, integers are addresses of ints (like alloc hands out)
+    result_t atomic_pointer(const Expression& e, Value& ptr) const {
+        result_t r = ctx.compile(e, ptr);
+        if (!r) return r;
+
+        if (ptr.type.t->isIntegerTy()) {
+            result_t r2 = exiplicit_cast(ptr, ctx.int_ptr_type, e);
+            if (!r2) return r2;
+        }
+        llvm::Type* stored = ptr.type.stored ? ptr.type.stored->t : nullptr;
+        if (!ptr.type.t->isPointerTy() || !stored || !stored->isIntegerTy() || stored->getIntegerBitWidth() < 8)
+            return std::unexpected(BadType<Expression>{e, ctx.int_ptr_type, ptr.type});
+        return {};
+    }
+
+    //atomic_load(p, order), atomic_store(p, v, order), atomic_<rmw>(p, v, order),
+    //atomic_cas(p, expected, desired, order) and fence(order)
+    result_t atomic_builtin(const Call& c, std::string_view name) const {
+        auto& b = ctx.builder;
+        auto arity = [&](size_t n) -> result_t {
+            if (c.args.size() != n)
+                return std::unexpected(WrongArgCount{c, nullptr});
+            return {};
+        };
+
+        if (name == "fence") {
+            result_t ra = arity(1);
+            if (!ra) return ra;
+            auto order = ordering(c.args[0], true, true);
+            if (!order) return FORWARD_UNEXPECTED(order);
+            if (*order == llvm::AtomicOrdering::Monotonic)
+                return std::unexpected(BadOrdering{c.args[0]});
+
+            b.CreateFence(*order);
+            out.v = b.getInt64(0);
+            out.type = ctx.int_type;
+            return {};
+        }
+
+        bool is_load = name == "atomic_load";
+        bool is_cas = name == "atomic_cas";
+        result_t ra = arity(is_load ? 2 : is_cas ? 4 : 3);
+        if (!ra) return ra;
+
+        Value ptr;
+        result_t rp = atomic_pointer(c.args[0], ptr);
+        if (!rp) return rp;
+        Type stored = *ptr.type.stored;
+        llvm::Align align(stored.t->getPrimitiveSizeInBits() / 8);
+
+        auto order = ordering(c.args.back(), is_load, name == "atomic_store");
+        if (!order) return FORWARD_UNEXPECTED(order);
+
+        if (is_load) {
+            llvm::LoadInst* load = b.CreateAlignedLoad(stored.t, ptr.v, align);
+            load->setAtomic(*order);
+            out.v = load;
+            out.type = stored;
+            return {};
+        }
+
+        std::vector<llvm::Value*> vals;
+        for (size_t i = 1; i + 1 < c.args.size(); ++i) {
+            Value v;
+            result_t rv = ctx.compile(c.args[i], v);
+            if (!rv) return rv;
+            result_t rc = assign_convert(v, stored, c.args[i]);
+            if (!rc) return rc;
+            vals.push_back(v.v);
+        }
+
+        out.type = stored;
+        if (name == "atomic_store") {
+            llvm::StoreInst* store = b.CreateAlignedStore(vals[0], ptr.v, align);
+            store->setAtomic(*order);
+            out.v = vals[0];
+            return {};
+        }
 
-	        const Type& expected = fnty->args[i];
-	        const Type& got = a.type;
-	        if (!types_exactly_equal(expected, got))
-	            return std::unexpected(BadType{c.args[i], expected, got});
+        if (is_cas) {
+            auto failure = llvm::AtomicCmpXchgInst::getStrongestFailureOrdering(*order);
+            llvm::Value* pair = b.CreateAtomicCmpXchg(ptr.v, vals[0], vals[1], align, *order, failure);
+            out.v = b.CreateExtractValue(pair, 0, "old");
+            return {};
+        }
+
+        for (auto [spelling, op] : atomic_rmw_ops)
+            if (spelling == name) {
+                out.v = b.CreateAtomicRMW(op, ptr.v, vals[0], align, *order);
+                return {};
+            }
+        return std::unexpected(MissingVar{std::get<Var>(c.func->inner)});
+    }
+
+    //the coroutine behind an int handle
+    result_t coroutine_handle(const Expression& e, llvm::Value*& handle) const {
+        Value h;
+        result_t r = ctx.compile(e, h);
+        if (!r) return r;
+        result_t r2 = implicit_cast(h, ctx.int_type, e);
+        if (!r2) return r2;
+        handle = ctx.builder.CreateIntToPtr(h.v, llvm::PointerType::get(*ctx.ctx, 0));
+        return {};
+    }
+
+    //next(g) resumes g and gives what it yielded, done(g) is true once it returned, drop(g) frees it
+    result_t coroutine_builtin(const Call& c, std::string_view name) const {
+        if (c.args.size() != 1)
+            return std::unexpected(WrongArgCount{c, nullptr});
+
+        llvm::Value* handle;
+        result_t r = coroutine_handle(c.args[0], handle);
+        if (!r) return r;
+
+        auto& b = ctx.builder;
+        if (name == "done") {
+            out.v = b.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle});
+            out.type = ctx.bool_type;
+            return {};
+        }
+        if (name == "drop") {
+            b.CreateIntrinsic(llvm::Intrinsic::coro_destroy, {}, {handle});
+            out.v = b.getInt64(0);
+            out.type = ctx.int_type;
+            return {};
+        }
+
+        //a finished coroutine cant be resumed, it keeps handing out what it returned
+        llvm::Function* func = b.GetInsertBlock()->getParent();
+        auto bresume = llvm::BasicBlock::Create(*ctx.ctx, "next.resume", func);
+        auto bvalue = llvm::BasicBlock::Create(*ctx.ctx, "next.value", func);
+        b.CreateCondBr(b.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle}), bvalue, bresume);
+
+        b.SetInsertPoint(bresume);
+        b.CreateIntrinsic(llvm::Intrinsic::coro_resume, {}, {handle});
+        b.CreateBr(bvalue);
+
+        b.SetInsertPoint(bvalue);
+        out.v = b.CreateLoad(ctx.int_type.t, coro_promise(handle), "next");
+        out.type = ctx.int_type;
+        return {};
+    }
+
+    result_t operator()(const Call& c) const {
+	    std::string_view builtin = builtin_name(c);
+	    if (builtin == "alloc")
+	        return region_alloc(c);
+	    if (builtin.starts_with("atomic_") || builtin == "fence")
+	        return atomic_builtin(c, builtin);
+	    if (builtin == "likely" || builtin == "unlikely" || builtin == "unpredictable") {//hints on if conditions, anywhere else just their argument
+	        if (c.args.size() != 1)
+	            return std::unexpected(WrongArgCount{c, nullptr});
+	        return ctx.compile(c.args[0], out);
 	    }
+	    if (builtin == "next" || builtin == "done" || builtin == "drop")
+	        return coroutine_builtin(c, builtin);
 
-	    // create call instruction
-	    llvm::CallInst* call = ctx.builder.CreateCall(fnty->ft, fn_val.v, arg_vals, "function call");
+	    Value fn_val;
+	    std::vector<llvm::Value*> arg_vals;
+	    result_t r = call_operands(c, fn_val, arg_vals);
+	    if (!r) return r;
+	    FunctionType* fnty = fn_val.type.func;
+
+	    // create call instruction (void results cant be named)
+	    llvm::CallInst* call = ctx.builder.CreateCall(fnty->ft, fn_val.v, arg_vals,
+	        fnty->ret.t->isVoidTy() ? "" : "function call");
 	    call->setCallingConv(fnty->cc);
 
 	    // wrap result
@@ -518,12 +1275,213 @@ struct ExpressionVisitor : VisitorBase{
 	    return {};
 	}
 
+    //the task lives in this frame: {run, pending, callee, result?, args...}
+    result_t operator()(const Spawn& s) const {
+	    const Call& c = std::get<Call>(s.call->inner);
+	    Value fn_val;
+	    std::vector<llvm::Value*> arg_vals;
+	    result_t r = call_operands(c, fn_val, arg_vals);
+	    if (!r) return r;
+	    FunctionType* fnty = fn_val.type.func;
+
+	    auto& b = ctx.builder;
+	    auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+	    bool has_result = !fnty->ret.t->isVoidTy();
+	    unsigned first_arg = has_result ? 4 : 3;
+
+	    std::vector<llvm::Type*> fields{ptr, ptr, ptr};
+	    if (has_result)
+	        fields.push_back(fnty->ret.t);
+	    for (llvm::Value* a : arg_vals)
+	        fields.push_back(a->getType());
+	    llvm::StructType* task_type = llvm::StructType::get(*ctx.ctx, fields);
+
+	    if (!ctx.spawned) {
+	        //in the entry block so every sync and return sees it
+	        llvm::BasicBlock& entry = b.GetInsertBlock()->getParent()->getEntryBlock();
+	        llvm::IRBuilder<> eb(&entry, entry.begin());
+	        llvm::AllocaInst* spawned = eb.CreateAlloca(ctx.int_type.t, nullptr, "spawned");
+	        spawned->setAlignment(llvm::Align(8));//the runtime uses it atomically
+	        eb.CreateStore(eb.getInt64(0), spawned);
+	        ctx.spawned = spawned;
+	    }
+
+	    llvm::Value* task = b.CreateAlloca(task_type, nullptr, "task");
+	    b.CreateStore(spawn_thunk(fnty, fn_val.v, task_type, first_arg), b.CreateStructGEP(task_type, task, 0));
+	    b.CreateStore(ctx.spawned, b.CreateStructGEP(task_type, task, 1));
+	    b.CreateStore(fn_val.v, b.CreateStructGEP(task_type, task, 2));
+	    for (size_t i = 0; i < arg_vals.size(); ++i)
+	        b.CreateStore(arg_vals[i], b.CreateStructGEP(task_type, task, first_arg + i));
+
+	    auto spawn = ctx.mod->getOrInsertFunction("small_spawn",
+	        llvm::FunctionType::get(b.getVoidTy(), {ptr}, false));
+	    llvm::cast<llvm::Function>(spawn.getCallee())->addFnAttr(llvm::Attribute::NoUnwind);
+	    b.CreateCall(spawn, {task});
+
+	    //only safe to read after sync
+	    out.v = has_result ? b.CreateStructGEP(task_type, task, 3, "spawned result") : task;
+	    out.type = *ctx.pointer_to(has_result ? ctx.intern(fnty->ret) : &ctx.void_type);
+	    return {};
+	}
+
+	//outside a coroutine this just resumes the child until it returns,
+	//inside one every yield of the child is passed on and we suspend with it
+	result_t operator()(const Comptime& c) const {
+	    return ctx.comptime(c, out);
+	}
+
+	//widens an arm to the type both arms of a conditional meet at
+	result_t meet(Value& v, const Type& to, const Conditional& c) const {
+	    if (v.type.t->isIntegerTy() && to.t->isIntegerTy()) {
+	        if (v.type.t != to.t)
+	            v.v = ctx.builder.CreateIntCast(v.v, to.t, !v.type.t->isIntegerTy(1), "cond_extend");
+	        v.type = to;
+	        return {};
+	    }
+	    return implicit_cast(v, to, *c.other);
+	}
+
+	//the wider integer (bools zero extend, like binary operators), or the then arm's type
+	static Type common_type(const Value& a, const Value& b) {
+	    if (a.type.t->isIntegerTy() && b.type.t->isIntegerTy()
+	     && b.type.t->getIntegerBitWidth() > a.type.t->getIntegerBitWidth())
+	        return b.type;
+	    return a.type;
+	}
+
+	//a select when neither arm can trap or have effects, otherwise a branch and a phi
+	result_t operator()(const Conditional& c) const {
+	    Hint hint;
+	    vresult_t cond = condition(*c.cond, hint);
+	    if (!cond) return FORWARD_UNEXPECTED(cond);
+
+	    Value a, b;
+	    if (speculatable(*c.then) && speculatable(*c.other)) {
+	        result_t ra = ctx.compile(*c.then, a);
+	        if (!ra) return ra;
+	        result_t rb = ctx.compile(*c.other, b);
+	        if (!rb) return rb;
+
+	        Type type = common_type(a, b);
+	        result_t r1 = meet(a, type, c);
+	        if (!r1) return r1;
+	        result_t r2 = meet(b, type, c);
+	        if (!r2) return r2;
+
+	        out.v = ctx.builder.CreateSelect(cond->v, a.v, b.v, "cond");
+	        out.type = type;
+	        if (auto* sel = llvm::dyn_cast<llvm::SelectInst>(out.v))
+	            mark(sel, hint);
+	        return {};
+	    }
+
+	    llvm::Function* func = ctx.builder.GetInsertBlock()->getParent();
+	    auto bthen = llvm::BasicBlock::Create(*ctx.ctx, "cond.then", func);
+	    auto belse = llvm::BasicBlock::Create(*ctx.ctx, "cond.else", func);
+	    auto bmerge = llvm::BasicBlock::Create(*ctx.ctx, "cond.end", func);
+	    mark(ctx.builder.CreateCondBr(cond->v, bthen, belse), hint);
+
+	    ctx.builder.SetInsertPoint(bthen);
+	    result_t ra = ctx.compile(*c.then, a);
+	    if (!ra) return ra;
+	    llvm::BasicBlock* then_end = ctx.builder.GetInsertBlock();
+
+	    ctx.builder.SetInsertPoint(belse);
+	    result_t rb = ctx.compile(*c.other, b);
+	    if (!rb) return rb;
+	    llvm::BasicBlock* else_end = ctx.builder.GetInsertBlock();
+
+	    //the arms only meet once both types are known, so the casts go at the end of each
+	    Type type = common_type(a, b);
+	    if (type.t->isVoidTy())
+	        return std::unexpected(BadType<Expression>{*c.then, ctx.int_type, type});
+	    for (auto [v, end] : {std::pair{&a, then_end}, std::pair{&b, else_end}}) {
+	        ctx.builder.SetInsertPoint(end);
+	        result_t r = meet(*v, type, c);
+	        if (!r) return r;
+	        ctx.builder.CreateBr(bmerge);
+	    }
+
+	    ctx.builder.SetInsertPoint(bmerge);
+	    llvm::PHINode* phi = ctx.builder.CreatePHI(type.t, 2, "cond");
+	    phi->addIncoming(a.v, then_end);
+	    phi->addIncoming(b.v, else_end);
+	    out.v = phi;
+	    out.type = type;
+	    return {};
+	}
+
+	result_t operator()(const Await& a) const {
+	    llvm::Value* handle;
+	    result_t r = coroutine_handle(*a.handle, handle);
+	    if (!r) return r;
+
+	    auto& b = ctx.builder;
+	    llvm::Function* func = b.GetInsertBlock()->getParent();
+	    auto bcheck = llvm::BasicBlock::Create(*ctx.ctx, "await", func);
+	    auto bstep = llvm::BasicBlock::Create(*ctx.ctx, "await.resume", func);
+	    auto bdone = llvm::BasicBlock::Create(*ctx.ctx, "awaited", func);
+	    b.CreateBr(bcheck);
+
+	    b.SetInsertPoint(bcheck);
+	    b.CreateCondBr(b.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle}), bdone, bstep);
+
+	    b.SetInsertPoint(bstep);
+	    b.CreateIntrinsic(llvm::Intrinsic::coro_resume, {}, {handle});
+	    if (!ctx.coro.handle) {
+	        b.CreateBr(bcheck);
+	    } else {
+	        auto bforward = llvm::BasicBlock::Create(*ctx.ctx, "await.yield", func);
+	        b.CreateCondBr(b.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle}), bdone, bforward);
+
+	        b.SetInsertPoint(bforward);
+	        b.CreateStore(b.CreateLoad(ctx.int_type.t, coro_promise(handle)), ctx.coro.promise);
+	        coro_suspend(false, bcheck, coro_destroyed(handle));
+	    }
+
+	    b.SetInsertPoint(bdone);
+	    out.v = b.CreateLoad(ctx.int_type.t, coro_promise(handle), "awaited");
+	    out.type = ctx.int_type;
+	    b.CreateIntrinsic(llvm::Intrinsic::coro_destroy, {}, {handle});
+	    return {};
+	}
+
+	//void run(SmallTask*): unpacks the task and makes the call, the runtime does the counting
+	llvm::Function* spawn_thunk(FunctionType* fnty, llvm::Value* callee,
+	                            llvm::StructType* task_type, unsigned first_arg) const {
+	    auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+	    auto* direct = llvm::dyn_cast<llvm::Function>(callee);
+
+	    llvm::Function* fn = llvm::Function::Create(
+	        llvm::FunctionType::get(llvm::Type::getVoidTy(*ctx.ctx), {ptr}, false),
+	        llvm::Function::InternalLinkage, direct ? ("spawn." + direct->getName()).str() : "spawn", *ctx.mod);
+	    fn->addFnAttr(llvm::Attribute::NoUnwind);
+
+	    //own builder, ctx.builder is in the middle of the spawning function
+	    llvm::IRBuilder<> b(llvm::BasicBlock::Create(*ctx.ctx, "entry", fn));
+	    llvm::Value* task = fn->getArg(0);
+
+	    llvm::Value* target = direct ? callee : b.CreateLoad(ptr, b.CreateStructGEP(task_type, task, 2));
+	    std::vector<llvm::Value*> args;
+	    for (unsigned i = first_arg; i < task_type->getNumElements(); ++i)
+	        args.push_back(b.CreateLoad(task_type->getElementType(i), b.CreateStructGEP(task_type, task, i)));
+
+	    llvm::CallInst* call = b.CreateCall(fnty->ft, target, args);
+	    call->setCallingConv(fnty->cc);
+	    if (first_arg == 4)
+	        b.CreateStore(call, b.CreateStructGEP(task_type, task, 3));
+	    b.CreateRetVoid();
+	    return fn;
+	}
+
 };
 
 result_t CompileContext::compile(const Expression& exp,Value& out) {
 	//print("[compiling exp:]\n");
 	// print_expression(exp,1,true);
+    llvm::DebugLoc prev = set_location(exp.tok().text);
     result_t r = std::visit(ExpressionVisitor{*this,out}, exp.inner);
+    builder.SetCurrentDebugLocation(prev);
     if(!r) return FORWARD_UNEXPECTED(r);
     return {};
 }
@@ -534,6 +1492,9 @@ struct StatmentVisitor :VisitorBase {
 
 
         for (auto& stmt : b.parts) {
+            //whatever follows a return is dead, like the mid IR drops it
+            if (ctx.builder.GetInsertBlock()->getTerminator())
+                break;
             result_t r = ctx.compile(stmt);
             if (!r) {
             	ctx.local_var_addrs.pop();
@@ -544,21 +1505,36 @@ struct StatmentVisitor :VisitorBase {
         return {};
     }
 
+    //a branch's block starting at first, a cold one (and whatever it branches to) goes out of line
+    result_t compile_arm(const Block& b, llvm::BasicBlock* first) const {
+        llvm::Function* func = first->getParent();
+        llvm::BasicBlock* last = &func->back();
+        result_t r = compile_block(b);
+        if (!r || !b.cold)
+            return r;
+        ctx.cold_blocks.push_back(first);
+        for (auto it = std::next(last->getIterator()); it != func->end(); ++it)
+            ctx.cold_blocks.push_back(&*it);
+        return r;
+    }
+
     result_t operator()(const Invalid&) const {
         throw std::invalid_argument("uninit statement");
     }
 
     result_t operator()(const While&) const { TODO; }
 
-    result_t operator()(const If& i) const {
-	    // --- 1. Evaluate condition ---
-	    Value cond_val;
-	    result_t rcond = ctx.compile(i.cond,cond_val);
-	    if (!rcond) return rcond;
-
+    //"if x < 0 then", first line of the condition only
+    static std::string branch_name(const If& i, std::string_view arm) {
+        std::string_view cond = i.cond.tok().text;
+        cond = cond.substr(0, std::min<size_t>(cond.find('\n'), 40));
+        return std::format("if {} {}", cond, arm);
+    }
 
-	    // --- 2. Convert to boolean ---
-	    vresult_t rcond_bool = to_bool(cond_val);
+    result_t operator()(const If& i) const {
+	    // --- 1. Evaluate condition (as a bool) ---
+	    Hint hint;
+	    vresult_t rcond_bool = condition(i.cond, hint);
 	    if (!rcond_bool)
 	        return FORWARD_UNEXPECTED(rcond_bool);
 
@@ -566,15 +1542,17 @@ struct StatmentVisitor :VisitorBase {
 	    llvm::Value* cond = cond_bool.v;
 	    llvm::Function* func = ctx.builder.GetInsertBlock()->getParent();
 
-		auto bthen  = llvm::BasicBlock::Create(*ctx.ctx, concat_statements("then",i.block.text), func);
-		auto belse  = llvm::BasicBlock::Create(*ctx.ctx, concat_statements("else",i.else_part.text), func);
-        ctx.builder.CreateCondBr(cond, bthen, belse);
+		auto bthen  = llvm::BasicBlock::Create(*ctx.ctx, "then", func);
+		auto belse  = llvm::BasicBlock::Create(*ctx.ctx, "else", func);
+        mark(ctx.builder.CreateCondBr(cond, bthen, belse), arms_hint(hint, i.block, i.else_part));
 
         //print("in %p \n",ctx.builder.GetInsertBlock());
         //print("made %p %p %p\n",bthen,belse,bmerge);
         //print("setting insertion at %p \n",bthen);
         ctx.builder.SetInsertPoint(bthen);
-        result_t rthen = compile_block(i.block);
+        if (ctx.profile)
+            ctx.count(branch_name(i, "then"), i.block.text.empty() ? i.text : i.block.text);
+        result_t rthen = compile_arm(i.block, bthen);
         if(!rthen) return rthen;
         auto then_end = ctx.builder.GetInsertBlock();
 
@@ -582,7 +1560,9 @@ struct StatmentVisitor :VisitorBase {
         //print("in %p \n",ctx.builder.GetInsertBlock());
         //print("setting insertion at %p \n",belse);
         ctx.builder.SetInsertPoint(belse);
-        result_t relse = compile_block(i.else_part);
+        if (ctx.profile)
+            ctx.count(branch_name(i, "else"), i.else_part.text.empty() ? i.text : i.else_part.text);
+        result_t relse = compile_arm(i.else_part, belse);
         if(!relse) return relse;
         auto else_end = ctx.builder.GetInsertBlock();
 
@@ -613,21 +1593,208 @@ struct StatmentVisitor :VisitorBase {
         return {};
 	}
 
+    //a range wider than this is tested with one compare instead of a case per value
+    static constexpr uint64_t MAX_RANGE_CASES = 64;
+
+    //one SwitchInst (llvm makes it a jump table or a compare tree), wide ranges checked on its default
+    result_t operator()(const Match& m) const {
+        Value val;
+        result_t rval = ctx.compile(m.val, val);
+        if (!rval) return rval;
+        if (!val.type.t->isIntegerTy())
+            return std::unexpected(BadType<Expression>{m.val, ctx.int_type, val.type});
+
+        auto* type = llvm::cast<llvm::IntegerType>(val.type.t);
+        unsigned w = type->getBitWidth();
+        int64_t min = w == 1 ? 0 : w == 64 ? INT64_MIN : -(int64_t(1) << (w - 1));
+        int64_t max = w == 1 ? 1 : w == 64 ? INT64_MAX : (int64_t(1) << (w - 1)) - 1;
+
+        llvm::Function* func = ctx.builder.GetInsertBlock()->getParent();
+        std::string_view what = m.val.tok().text;
+        what = what.substr(0, std::min<size_t>(what.find('\n'), 40));
+
+        auto belse = llvm::BasicBlock::Create(*ctx.ctx, "match.else", func);
+        std::vector<llvm::BasicBlock*> arms;
+        for (size_t k = 0; k < m.arms.size(); ++k)
+            arms.push_back(llvm::BasicBlock::Create(*ctx.ctx, std::format("case.{}", k), func));
+
+        //the first arm with a value keeps it, later ones skip what is already taken
+        struct Wide { int64_t lo, hi; llvm::BasicBlock* to; };
+        std::vector<Wide> wide;
+        std::set<int64_t> taken;
+        std::vector<std::pair<int64_t, llvm::BasicBlock*>> cases;
+        for (size_t k = 0; k < m.arms.size(); ++k)
+            for (auto [lo, hi] : m.arms[k].ranges) {
+                lo = std::max(lo, min);
+                hi = std::min(hi, max);
+                if (lo > hi)
+                    continue;
+                if (static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo) >= MAX_RANGE_CASES) {
+                    wide.push_back({lo, hi, arms[k]});
+                    continue;
+                }
+                for (int64_t v = lo;; ++v) {
+                    bool shadowed = std::any_of(wide.begin(), wide.end(),
+                        [&](const Wide& r) { return r.lo <= v && v <= r.hi; });
+                    if (!shadowed && taken.insert(v).second)
+                        cases.push_back({v, arms[k]});
+                    if (v == hi)
+                        break;
+                }
+            }
+
+        llvm::BasicBlock* bdefault = belse;
+        if (!wide.empty())
+            bdefault = llvm::BasicBlock::Create(*ctx.ctx, "match.ranges", func, arms.empty() ? belse : arms[0]);
+        //with a cold arm every case gets a weight, cold ones 1
+        bool any_cold = m.else_part.cold || std::any_of(m.arms.begin(), m.arms.end(),
+            [](const MatchArm& a) { return a.block.cold; });
+        auto weight = [&](llvm::BasicBlock* to) -> uint32_t {
+            if (to == belse)
+                return m.else_part.cold ? 1 : HOT_WEIGHT;
+            auto k = std::find(arms.begin(), arms.end(), to) - arms.begin();
+            return m.arms[k].block.cold ? 1 : HOT_WEIGHT;
+        };
+        bool ranges_cold = weight(belse) == 1 && std::all_of(wide.begin(), wide.end(),
+            [&](const Wide& r) { return weight(r.to) == 1; });
+
+        llvm::SwitchInst* sw = ctx.builder.CreateSwitch(val.v, bdefault, cases.size());
+        std::vector<uint32_t> weights{bdefault == belse ? weight(belse) : ranges_cold ? 1 : HOT_WEIGHT};
+        for (auto [v, to] : cases) {
+            sw->addCase(llvm::ConstantInt::get(type, v, true), to);
+            weights.push_back(weight(to));
+        }
+        if (any_cold)
+            sw->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(*ctx.ctx).createBranchWeights(weights));
+
+        //x - lo <= hi - lo unsigned, one compare per range in arm order
+        if (!wide.empty()) {
+            ctx.builder.SetInsertPoint(bdefault);
+            for (size_t k = 0; k < wide.size(); ++k) {
+                auto [lo, hi, to] = wide[k];
+                llvm::Value* off = ctx.builder.CreateSub(val.v, llvm::ConstantInt::get(type, lo, true));
+                llvm::Value* in = ctx.builder.CreateICmpULE(off,
+                    llvm::ConstantInt::get(type, static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo)), "in_range");
+                llvm::BasicBlock* next = k + 1 < wide.size()
+                    ? llvm::BasicBlock::Create(*ctx.ctx, "match.ranges", func, arms.empty() ? belse : arms[0])
+                    : belse;
+                bool rest_cold = weight(belse) == 1 && std::all_of(wide.begin() + k + 1, wide.end(),
+                    [&](const Wide& r) { return weight(r.to) == 1; });
+                bool to_cold = weight(to) == 1;
+                mark(ctx.builder.CreateCondBr(in, to, next),
+                     to_cold == rest_cold ? Hint::None : to_cold ? Hint::Unlikely : Hint::Likely);
+                ctx.builder.SetInsertPoint(next);
+            }
+        }
+
+        //arms that dont return fall out to one merge block
+        std::vector<llvm::BasicBlock*> open;
+        auto arm = [&](llvm::BasicBlock* at, const Block& block, std::string name) -> result_t {
+            ctx.builder.SetInsertPoint(at);
+            if (ctx.profile)
+                ctx.count(std::format("match {} {}", what, name), block.text.empty() ? m.text : block.text);
+            result_t r = compile_arm(block, at);
+            if (!r) return r;
+            if (!ctx.builder.GetInsertBlock()->getTerminator())
+                open.push_back(ctx.builder.GetInsertBlock());
+            return {};
+        };
+        for (size_t k = 0; k < m.arms.size(); ++k) {
+            std::string name = "case";
+            for (auto [lo, hi] : m.arms[k].ranges)
+                name += lo == hi ? std::format(" {}", lo) : std::format(" {}...{}", lo, hi);
+            result_t r = arm(arms[k], m.arms[k].block, std::move(name));
+            if (!r) return r;
+        }
+        result_t r = arm(belse, m.else_part, "else");
+        if (!r) return r;
+
+        //made even when every arm returns, the trailing return after a match goes here
+        auto bmerge = llvm::BasicBlock::Create(*ctx.ctx, "match.end", func);
+        for (llvm::BasicBlock* b : open) {
+            ctx.builder.SetInsertPoint(b);
+            ctx.builder.CreateBr(bmerge);
+        }
+        ctx.builder.SetInsertPoint(bmerge);
+        return {};
+    }
+
     result_t operator()(const Return& r) const {
         Value value;
         result_t res = ctx.compile(r.val,value);
         if (!res) return res;
         
-        result_t res2 = implicit_cast(value,ctx.current_func->ret,r);
+        result_t res2 = assign_convert(value,ctx.current_func->ret,r);
         if(!res2) return res2;
 
+        //spawned tasks can still be using the frame (and region memory)
+        sync_spawns();
+        for (auto it = ctx.regions.rbegin(); it != ctx.regions.rend(); ++it)
+            region_release(*it);
+
+        //a coroutine parks at its final suspend with the value in the promise, done() is true from here on
+        if (ctx.coro.handle) {
+            ctx.builder.CreateStore(value.v, ctx.coro.promise);
+            ctx.builder.CreateBr(ctx.coro.finish);
+            return {};
+        }
+
         //std::cout << "in "<<ctx.builder.GetInsertBlock() << r.text << "\n";
         ctx.builder.CreateRet(value.v);
         return {};
     }
 
+    result_t operator()(const Yield& y) const {
+        Value value;
+        result_t res = ctx.compile(y.val,value);
+        if (!res) return res;
+
+        result_t res2 = assign_convert(value,ctx.current_func->ret,y.val);
+        if(!res2) return res2;
+
+        ctx.builder.CreateStore(value.v, ctx.coro.promise);
+        llvm::Function* func = ctx.builder.GetInsertBlock()->getParent();
+        auto bresumed = llvm::BasicBlock::Create(*ctx.ctx, "resumed", func);
+        coro_suspend(false, bresumed, coro_destroyed());
+        ctx.builder.SetInsertPoint(bresumed);
+        return {};
+    }
+
     result_t operator()(const Block& b) const { return compile_block(b); }
 
+    result_t operator()(const Region& r) const {
+        llvm::StructType* rt = region_type();
+        llvm::Value* state = ctx.builder.CreateAlloca(rt, nullptr, r.name.text);
+        ctx.builder.CreateStore(llvm::Constant::getNullValue(rt), state);
+
+        //the name is an int handle (like any other address in the language) so it can be passed around
+        Value* slot = ctx.local_value();
+        slot->v = ctx.builder.CreateAlloca(ctx.int_type.t, nullptr, r.name.text);
+        slot->type = {slot->v->getType(), &ctx.int_type, nullptr};
+        ctx.builder.CreateStore(ctx.builder.CreatePtrToInt(state, ctx.int_type.t), slot->v);
+
+        ctx.local_var_addrs.push();
+        ctx.local_var_addrs[r.name.text] = slot;
+        ctx.regions.push_back(state);
+
+        result_t res = compile_block(r.block);
+        ctx.regions.pop_back();
+        ctx.local_var_addrs.pop();
+        if (!res) return res;
+
+        //returns inside the block already released it
+        if (!ctx.builder.GetInsertBlock()->getTerminator()) {
+            sync_spawns();
+            region_release(state);
+        }
+        return {};
+    }
+
+    result_t operator()(const Sync&) const {
+        sync_spawns();
+        return {};
+    }
+
     result_t operator()(const Basic& b) const {
     	Value out;
         return ctx.compile(b.inner,out);
@@ -637,53 +1804,81 @@ struct StatmentVisitor :VisitorBase {
 result_t CompileContext::compile(const Statement& stmt) {
     //print("[compiling stmt:]\n");
 	// print_statement(stmt,1,true);
+    llvm::DebugLoc prev = set_location(stmt);
     result_t r = std::visit(StatmentVisitor{*this}, stmt.inner);
+    builder.SetCurrentDebugLocation(prev);
     if (r || std::holds_alternative<StatmentError>(r.error())) return r;
     return std::unexpected(
         StatmentError{stmt, std::make_unique<CompileError>(std::move(r).error())});
 }
 
-struct GlobalVisitor : VisitorBase {
-    Value* generate_func(const FuncDec& dec) const {
-        std::vector<llvm::Type*> arg_llvm_types;
-        std::vector<Type> arg_types;
-        
-        for (auto& a : dec.args){
-            arg_types.push_back(ctx.int_type);
-            arg_llvm_types.push_back(ctx.int_type.t);
+//a function that yields anywhere (nested blocks included) is a generator
+static bool has_yield(const Block& block) {
+    for (auto& stmt : block.parts) {
+        const Block* inner[2] = {};
+        if (std::holds_alternative<Yield>(stmt.inner))
+            return true;
+        if (auto* x = std::get_if<If>(&stmt.inner))
+            inner[0] = &x->block, inner[1] = &x->else_part;
+        else if (auto* x = std::get_if<While>(&stmt.inner))
+            inner[0] = &x->block;
+        else if (auto* x = std::get_if<Region>(&stmt.inner))
+            inner[0] = &x->block;
+        else if (auto* x = std::get_if<Block>(&stmt.inner))
+            inner[0] = x;
+        else if (auto* x = std::get_if<Match>(&stmt.inner)) {
+            inner[0] = &x->else_part;
+            for (auto& arm : x->arms)
+                if (has_yield(arm.block))
+                    return true;
         }
 
-        Type ret = ctx.int_type;
-
-        auto sig = llvm::FunctionType::get(ret.t, arg_llvm_types, false);
-        llvm::Function* fn = llvm::Function::Create(
-            sig, llvm::Function::ExternalLinkage, dec.name.text, *ctx.mod);
+        for (const Block* b : inner)
+            if (b && has_yield(*b))
+                return true;
+    }
+    return false;
+}
 
-        if (dec.is_c)
-            fn->setCallingConv(llvm::CallingConv::C);
-        else
-            fn->setCallingConv(llvm::CallingConv::Fast);
+struct GlobalVisitor : VisitorBase {
+    //untyped parts of the signature are int
+    Type* declared_type(const TypeDec& t) const {
+        return t.text.empty() ? &ctx.int_type : ctx.get_type(t);
+    }
 
+    std::expected<Value*,CompileError> generate_func(const FuncDec& dec, std::string_view name) const {
+        //redeclaring is fine, a second body or a variable of the same name isnt
+        if (auto it = ctx.global_consts.find(name); !ctx.allow_redefinition && it != ctx.global_consts.end()) {
+            auto* old = llvm::dyn_cast<llvm::Function>(it->second->v);
+            if (!old || !old->isDeclaration())
+                return std::unexpected(Redefined{dec.name});
+        }
 
-        auto* ft = ctx.func_defs.emplace_back(std::make_unique<FunctionType>(
-        		FunctionType{
-        			 fn->getFunctionType(),
-        			 fn->getCallingConv(),
-        			 ret,
-        			 std::move(arg_types),
-        		}
-        	)).get();
+        Type* ret = declared_type(dec.ret);
+        if (!ret)
+            return std::unexpected(UnknownType{dec.ret});
 
-        auto val = std::make_unique<Value>(
-        	Value{fn,
-        		Type{fn->getType(),nullptr,ft},
-        		nullptr
-        	}
-        );
+        std::vector<Type> arg_types;
+        for (auto& t : dec.arg_types) {
+            Type* a = declared_type(t);
+            if (!a || a->t->isVoidTy())
+                return std::unexpected(UnknownType{t});
+            arg_types.push_back(*a);
+        }
 
-        Value* ans = val.get();
-        ctx.global_consts[dec.name.text] = std::move(val);
-        return ans;
+        Value* val = ctx.declare_function(name, *ret, std::move(arg_types),
+            dec.is_c ? llvm::CallingConv::C : llvm::CallingConv::Fast, dec.varargs);
+
+        //nothing in the language unwinds and C callees are assumed not to either
+        llvm::Function* fn = static_cast<llvm::Function*>(val->v);
+        fn->addFnAttr(llvm::Attribute::NoUnwind);
+        if (dec.is_c && ret->t->isPointerTy() &&
+            std::find(std::begin(allocators), std::end(allocators), dec.name.text) != std::end(allocators))
+            fn->addRetAttr(llvm::Attribute::NoAlias);
+        for (size_t i = 0; i < dec.restrict_args.size(); ++i)
+            if (dec.restrict_args[i])
+                fn->addParamAttr(i, llvm::Attribute::NoAlias);
+        return val;
     }
 
     result_t operator()(const Invalid&) const {
@@ -691,17 +1886,53 @@ struct GlobalVisitor : VisitorBase {
     }
 
     result_t operator()(const FuncDec& dec) const {
-        generate_func(dec);
+        ctx.generics.erase(dec.name.text);
+        auto r = generate_func(dec, dec.name.text);
+        if (!r) return FORWARD_UNEXPECTED(r);
+        ctx.history.emplace_back(dec);
         return {};
     }
 
     result_t operator()(const Function& f) const {
-        Value* fn_val = generate_func(f);
+        //nothing to emit until a call says what the type parameters are
+        if (!f.type_params.empty()) {
+            ctx.generics[f.name.text] = &f;
+            ctx.history.emplace_back(&f);
+            return {};
+        }
+        ctx.generics.erase(f.name.text);
+        result_t r = compile_function(f, f.name.text);
+        if (r)
+            ctx.history.emplace_back(&f);
+        return r;
+    }
+
+    //name is f.name.text, or the mangled one of a generic instance
+    result_t compile_function(const Function& f, std::string_view name) const {
+        auto r = generate_func(f, name);
+        if (!r) return FORWARD_UNEXPECTED(r);
+        Value* fn_val = *r;
         llvm::Function* fn = static_cast<llvm::Function*>(fn_val->v);
         FunctionType& fn_type = *fn_val->type.func;
 
+        //line tables and counters are only emitted by the visitors below
+        if (ctx.mid_ir && !ctx.debug && !ctx.profile)
+            if (std::optional<mir::Function> m = mir::build(ctx, f, fn_type)) {
+                mir::optimize(*m);
+                if (ctx.mir_log)
+                    mir::print(*ctx.mir_log, *m, name);
+                mir::lower(ctx, *m, fn);
+                if (ctx.keep_mir)
+                    ctx.keep_mir(fn->getName().str(), std::move(*m));
+                return {};
+            }
+
         llvm::BasicBlock* entry = llvm::BasicBlock::Create(*ctx.ctx, "entry", fn);
         ctx.builder.SetInsertPoint(entry);
+        ctx.builder.SetCurrentDebugLocation({});
+        size_t cold_base = ctx.cold_blocks.size();
+        if (ctx.debug)
+            debug_function(*ctx.debug, fn, f, name);
 
         ctx.clear_locals();
         
@@ -711,38 +1942,519 @@ struct GlobalVisitor : VisitorBase {
         auto it_types = fn_type.args.begin();
 
         for (llvm::Argument& arg : fn->args()) {
-            auto slot = std::make_unique<Value>();
+            Value* slot = ctx.local_value();
             slot->v = ctx.builder.CreateAlloca(it_types->t, nullptr, it->text);
             slot->type.t = slot->v->getType();
-            slot->type.stored = &*it_types;
+            slot->type.stored = ctx.intern(*it_types);
 
             ctx.builder.CreateStore(&arg, slot->v);
-            ctx.local_var_addrs[it->text] = std::move(slot);
+            ctx.local_var_addrs[it->text] = slot;
             ++it;
             ++it_types;
         }
         assert(it == f.args.end());
 
+        if (ctx.profile)
+            ctx.count(std::format("fn {}", name), f.name.text);
+
+        if (f.is_async || has_yield(f.body)) {
+            if (f.is_c)
+                return std::unexpected(CfnCoroutine{f});
+            if (fn_type.ret.t != ctx.int_type.t)
+                return std::unexpected(CoroutineReturn{f, fn_type.ret});
+            begin_coroutine(fn);
+        }
+
         ctx.current_func = fn_val->type.func;
 
         for (auto& stmt : f.body.parts) {
+            if (ctx.builder.GetInsertBlock()->getTerminator())
+                break;//dead code after a return
             result_t r = ctx.compile(stmt);
             if (!r) return r;//dont reset function so error can use it
         }
 
-        if (f.body.parts.empty() ||
+        //a void function can fall off the end, it has nothing to return
+        if (fn_type.ret.t->isVoidTy() && !ctx.builder.GetInsertBlock()->getTerminator()) {
+            sync_spawns();
+            ctx.builder.CreateRetVoid();
+        }
+        else if (f.body.parts.empty() ||
             !std::holds_alternative<Return>(f.body.parts.back().inner))
             TODO;
 
+        //cold arms (this function's, instances compiled meanwhile took theirs) after everything else
+        for (size_t k = cold_base; k < ctx.cold_blocks.size(); ++k)
+            if (ctx.cold_blocks[k] != &fn->back())
+                ctx.cold_blocks[k]->moveAfter(&fn->back());
+        ctx.cold_blocks.resize(cold_base);
+
         ctx.current_func = nullptr;
+        ctx.coro = {};
+        if (ctx.debug)
+            ctx.debug->scope = nullptr;
+        ctx.builder.SetCurrentDebugLocation({});
         return {};
     }
 
-    result_t operator()(const Basic& b) const { return StatmentVisitor{ctx}(b); }
+    //frame from malloc (unless CoroElide puts it in the caller), then park before the body runs
+    //the ramp hands the handle back as an int, every later suspend returns through coro.suspend
+    void begin_coroutine(llvm::Function* fn) const {
+        auto& b = ctx.builder;
+        auto* ptr = llvm::PointerType::get(*ctx.ctx, 0);
+        llvm::Value* null = llvm::ConstantPointerNull::get(ptr);
+        fn->setPresplitCoroutine();
+
+        llvm::AllocaInst* promise = b.CreateAlloca(ctx.int_type.t, nullptr, "promise");
+        b.CreateStore(b.getInt64(0), promise);
+        llvm::Value* id = b.CreateIntrinsic(llvm::Intrinsic::coro_id, {}, {b.getInt32(8), promise, null, null});
+
+        llvm::BasicBlock* entry = b.GetInsertBlock();
+        auto balloc = llvm::BasicBlock::Create(*ctx.ctx, "coro.alloc", fn);
+        auto bbegin = llvm::BasicBlock::Create(*ctx.ctx, "coro.begin", fn);
+        b.CreateCondBr(b.CreateIntrinsic(llvm::Intrinsic::coro_alloc, {}, {id}), balloc, bbegin);
+
+        b.SetInsertPoint(balloc);
+        auto alloc_fn = ctx.mod->getOrInsertFunction("malloc", llvm::FunctionType::get(ptr, {ctx.int_type.t}, false));
+        llvm::Value* mem = b.CreateCall(alloc_fn, {b.CreateIntrinsic(llvm::Intrinsic::coro_size, {ctx.int_type.t}, {})});
+        b.CreateBr(bbegin);
+
+        b.SetInsertPoint(bbegin);
+        llvm::PHINode* frame = b.CreatePHI(ptr, 2);
+        frame->addIncoming(null, entry);
+        frame->addIncoming(mem, balloc);
+        llvm::Value* handle = b.CreateIntrinsic(llvm::Intrinsic::coro_begin, {}, {id, frame});
+
+        auto bstart = llvm::BasicBlock::Create(*ctx.ctx, "coro.start", fn);
+        ctx.coro = {id, handle, promise,
+            llvm::BasicBlock::Create(*ctx.ctx, "coro.cleanup", fn),
+            llvm::BasicBlock::Create(*ctx.ctx, "coro.suspend", fn),
+            llvm::BasicBlock::Create(*ctx.ctx, "coro.final", fn)};
+        coro_suspend(false, bstart, ctx.coro.cleanup);
+
+        //resuming a finished coroutine is a bug in the caller (next checks done first)
+        auto btrap = llvm::BasicBlock::Create(*ctx.ctx, "resumed.finished", fn);
+        b.SetInsertPoint(ctx.coro.finish);
+        coro_suspend(true, btrap, ctx.coro.cleanup);
+        b.SetInsertPoint(btrap);
+        b.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+        b.CreateUnreachable();
+
+        b.SetInsertPoint(ctx.coro.cleanup);
+        auto free_fn = ctx.mod->getOrInsertFunction("free", llvm::FunctionType::get(b.getVoidTy(), {ptr}, false));
+        b.CreateCall(free_fn, {b.CreateIntrinsic(llvm::Intrinsic::coro_free, {}, {id, handle})});
+        b.CreateBr(ctx.coro.suspend);
+
+        b.SetInsertPoint(ctx.coro.suspend);
+        b.CreateIntrinsic(llvm::Intrinsic::coro_end, {}, {handle, b.getFalse(), llvm::ConstantTokenNone::get(*ctx.ctx)});
+        b.CreateRet(b.CreatePtrToInt(handle, ctx.int_type.t));
+
+        b.SetInsertPoint(bstart);
+    }
+
+    //opens the function scope, the prologue is attributed to the name
+    void debug_function(DebugInfo& di, llvm::Function* fn, const Function& f, std::string_view name) const {
+        unsigned line = 0, col = 0;
+        di.lines.position(f.name.text, line, col);
+
+        llvm::SmallVector<llvm::Metadata*, 8> sig(f.args.size() + 1, di.int_type);
+        auto* type = di.builder->createSubroutineType(di.builder->getOrCreateTypeArray(sig));
+
+        di.scope = di.builder->createFunction(
+            di.file, name, fn->getName(), di.file, line, type, line,
+            llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+        fn->setSubprogram(di.scope);
+        ctx.set_location(f.name.text);
+    }
+
+    //a file has no function to run top level code in, the REPL wraps its expressions before they get here
+    result_t operator()(const Basic& b) const { return std::unexpected(NotConstant{b.inner}); }
+
+    //integer literals, optionally negated, or comptime (widened like an assignment would)
+    std::expected<llvm::Constant*,CompileError> constant_init(const Expression& e, Type& type) const {
+        if (std::holds_alternative<Invalid>(e.inner))
+            return llvm::Constant::getNullValue(type.t);
+
+        if (std::holds_alternative<Comptime>(e.inner)) {
+            Value v;
+            result_t r = ctx.compile(e, v);
+            if (!r) return FORWARD_UNEXPECTED(r);
+            if (v.type.t == type.t)
+                return llvm::cast<llvm::Constant>(v.v);
+
+            auto* ci = llvm::dyn_cast<llvm::ConstantInt>(v.v);
+            if (!ci || !type.t->isIntegerTy() || type.t->getIntegerBitWidth() < ci->getBitWidth())
+                return std::unexpected(BadType<Expression>{e, type, v.type});
+            return llvm::ConstantInt::get(type.t, ci->getBitWidth() == 1 ? ci->getValue().zext(type.t->getIntegerBitWidth())
+                                                                          : ci->getValue().sext(type.t->getIntegerBitWidth()));
+        }
+
+        bool negative = false;
+        const Expression* lit = &e;
+        while (auto* pre = std::get_if<PreOp>(&lit->inner)) {
+            if (pre->op != Operator::Minus)
+                return std::unexpected(NotConstant{e});
+            negative = !negative;
+            lit = pre->exp.get();
+        }
+
+        auto* num = std::get_if<Num>(&lit->inner);
+        if (!num)
+            return std::unexpected(NotConstant{e});
+
+        //an int holds one more negative value than positive, negated unsigned so that one is fine
+        if (num->value > static_cast<uint64_t>(INT64_MAX) + negative)
+            return std::unexpected(OutOfRange{e, type});
+        int64_t value = static_cast<int64_t>(negative ? 0 - num->value : num->value);
+
+        if (type.t->isIntegerTy()) {
+            unsigned bits = type.t->getIntegerBitWidth();
+            if (bits == 1 ? value != 0 && value != 1 : !llvm::isIntN(bits, value))
+                return std::unexpected(OutOfRange{e, type});
+            return llvm::ConstantInt::getSigned(type.t, value);
+        }
+        if (type.t->isFloatingPointTy())
+            return llvm::ConstantFP::get(type.t, static_cast<double>(value));
+        if (value == 0)
+            return llvm::Constant::getNullValue(type.t);
+        return llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::getSigned(ctx.int_type.t, value), type.t);
+    }
+
+    result_t operator()(const GlobalVar& g) const {
+        if (!ctx.allow_redefinition && ctx.global_consts.contains(g.name.text))
+            return std::unexpected(Redefined{g.name});
+
+        Type* type = declared_type(g.type);
+        if (!type || type->t->isVoidTy())
+            return std::unexpected(UnknownType{g.type});
+
+        auto init = constant_init(g.init, *type);
+        if (!init) return FORWARD_UNEXPECTED(init);
+
+        //internal lets llvm see every use, a variable nothing stores to becomes its initializer
+        auto linkage = g.is_exported || !ctx.internal_globals ? llvm::GlobalValue::ExternalLinkage
+                                                              : llvm::GlobalValue::InternalLinkage;
+        auto* var = new llvm::GlobalVariable(*ctx.mod, type->t, false, linkage, *init, "", nullptr,
+            g.is_thread_local ? llvm::GlobalValue::GeneralDynamicTLSModel : llvm::GlobalValue::NotThreadLocal);
+
+        //take over the redeclaration reset_module made so we dont end up with name.1
+        if (llvm::GlobalVariable* old = ctx.mod->getNamedGlobal(g.name.text); old && old->isDeclaration()) {
+            old->replaceAllUsesWith(var);
+            old->eraseFromParent();
+        }
+        var->setName(g.name.text);
+
+        //same shape as a local slot, the address with the variable as its stored type
+        ctx.global_consts[g.name.text] = std::make_unique<Value>(
+            Value{var, Type{var->getType(), type, nullptr}, nullptr});
+        if (g.is_thread_local)
+            ctx.thread_locals.insert(g.name.text);
+        else
+            ctx.thread_locals.erase(g.name.text);
+        ctx.history.emplace_back(&g);
+        return {};
+    }
+
+    //resolved by the driver, which declares the imported functions up front
+    result_t operator()(const Import&) const { return {}; }
 };
 
 result_t CompileContext::compile(const Global& global) {
     return std::visit(GlobalVisitor{*this}, global.inner);
 }
 
+//deep enough for real code, shallow enough to stop f[T] -> f[T*] -> ... quickly
+static constexpr unsigned MAX_INSTANCE_DEPTH = 64;
+
+result_t CompileContext::instantiate(const Call& at, const Function& f, std::string_view name,
+                                     std::map<std::string_view, Type*> bindings) {
+    if (instance_depth >= MAX_INSTANCE_DEPTH)
+        return std::unexpected(InstanceDepth{at});
+
+    llvm::IRBuilderBase::InsertPointGuard guard(builder);
+    auto locals = std::exchange(local_var_addrs, {});
+    auto open_regions = std::exchange(regions, {});
+    size_t caller_values = local_values_used;
+    size_t caller_base = std::exchange(local_values_base, local_values_used);
+    auto caller_spawned = std::exchange(spawned, nullptr);
+    auto caller_coro = std::exchange(coro, {});
+    auto caller_func = std::exchange(current_func, nullptr);
+    auto caller_args = std::exchange(type_args, std::move(bindings));
+    llvm::DISubprogram* caller_scope = debug ? debug->scope : nullptr;
+
+    ++instance_depth;
+    result_t r = GlobalVisitor{*this}.compile_function(f, name);
+    --instance_depth;
+
+    local_var_addrs = std::move(locals);
+    regions = std::move(open_regions);
+    local_values_used = caller_values;
+    local_values_base = caller_base;
+    spawned = caller_spawned;
+    coro = caller_coro;
+    current_func = caller_func;
+    type_args = std::move(caller_args);
+    if (debug)
+        debug->scope = caller_scope;
+
+    //every instance is private to its module, the next module makes its own
+    if (llvm::Function* fn = mod->getFunction(name))
+        fn->setLinkage(llvm::GlobalValue::InternalLinkage);
+    if (!r)
+        global_consts.erase(name);
+    return r;
+}
+
+//the thunk comptime compiles its expression into, called as void __comptime(void* out)
+static constexpr const char* COMPTIME_ENTRY = "__comptime";
+
+result_t CompileContext::comptime(const Comptime& c, Value& out) {
+    //a number of type in this context
+    auto constant = [&](uint64_t bits, Type* type) {
+        out.type = *type;
+        if (type->t->isDoubleTy()) {
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            out.v = llvm::ConstantFP::get(type->t, d);
+        } else {
+            out.v = llvm::ConstantInt::get(type->t, bits);//the store only wrote the type's own bytes
+        }
+    };
+
+    //in an instance the result can depend on the type arguments
+    bool cacheable = type_args.empty();
+    if (cacheable)
+        if (auto it = folded->find(c.text.data()); it != folded->end()) {
+            constant(it->second.bits, get_type(it->second.type));
+            return {};
+        }
+
+    if (!run_comptime)
+        return std::unexpected(ComptimeFailed{c, "there is no JIT to run it in"});
+
+    //a context of its own so nothing half compiled here (or its debug info) gets in the way
+    auto tmp = std::make_unique<CompileContext>("comptime");
+    tmp->run_comptime = run_comptime;
+    tmp->strict_aliasing = strict_aliasing;
+    tmp->folded = folded;
+    for (auto& [name, t] : type_args)
+        tmp->type_args[name] = tmp->get_type(type_name(t));
+
+    auto fail = [&](CompileError err) -> result_t {
+        failed_comptimes.push_back(std::move(tmp));
+        return std::unexpected(std::move(err));
+    };
+
+    for (auto& g : history) {
+        GlobalVisitor replay{*tmp};
+        result_t r = std::visit([&](auto& x) -> result_t {
+            if constexpr (std::is_pointer_v<std::decay_t<decltype(x)>>)
+                return replay(*x);
+            else
+                return replay(x);
+        }, g);
+        if (!r) return fail(std::move(r).error());
+    }
+
+    auto& b = tmp->builder;
+    auto* thunk = llvm::Function::Create(
+        llvm::FunctionType::get(b.getVoidTy(), {llvm::PointerType::get(*tmp->ctx, 0)}, false),
+        llvm::Function::ExternalLinkage, COMPTIME_ENTRY, *tmp->mod);
+    b.SetInsertPoint(llvm::BasicBlock::Create(*tmp->ctx, "entry", thunk));
+
+    Value v;
+    result_t r = tmp->compile(*c.exp, v);
+    if (!r) return fail(std::move(r).error());
+
+    Type* type = tmp->canonical(v.type);
+    if (!type || !(type->t->isIntegerTy() || type->t->isDoubleTy()))
+        return fail(ComptimeFailed{c, std::format("the result has to be a number (int, i32, char, bool or double) not {}",
+            type ? tmp->type_name(type) : "a function")});
+    type = get_type(tmp->type_name(type));
+
+    b.CreateStore(v.v, thunk->getArg(0));
+    b.CreateRetVoid();
+
+    uint64_t bits = 0;//narrower results land in the low bytes
+    auto ran = run_comptime(*tmp, COMPTIME_ENTRY, &bits);
+    if (!ran)
+        return std::unexpected(ComptimeFailed{c, std::move(ran).error()});
+
+    constant(bits, type);
+    if (cacheable)
+        folded->insert_or_assign(c.text.data(), Folded{bits, type_name(type)});
+    return {};
+}
+
+Value* CompileContext::declare_function(std::string_view name, Type ret,
+                                        std::vector<Type> arg_types, llvm::CallingConv::ID cc,
+                                        bool varargs) {
+    std::vector<llvm::Type*> arg_llvm_types;
+    for (auto& a : arg_types)
+        arg_llvm_types.push_back(a.t);
+
+    auto sig = llvm::FunctionType::get(ret.t, arg_llvm_types, varargs);
+    llvm::Function* fn = llvm::Function::Create(
+        sig, llvm::Function::ExternalLinkage, "", *mod);
+
+    //take over an earlier declaration so we dont end up with name.1
+    llvm::Function* old = mod->getFunction(name);
+    if (old && old->isDeclaration()) {
+        old->replaceAllUsesWith(fn);
+        old->eraseFromParent();
+    }
+    fn->setName(name);
+    fn->setCallingConv(cc);
+
+    FunctionType* ft = intern(FunctionType{
+    		fn->getFunctionType(),
+    		fn->getCallingConv(),
+    		ret,
+    		std::move(arg_types),
+    	});
+
+    auto val = std::make_unique<Value>(
+    	Value{fn,
+    		Type{fn->getType(),nullptr,ft},
+    		nullptr
+    	}
+    );
+
+    Value* ans = val.get();
+    global_consts[name] = std::move(val);
+    return ans;
+}
+
+result_t CompileContext::declare_variable(const GlobalVar& g) {
+    Type* type = g.type.text.empty() ? &int_type : get_type(g.type);
+    if (!type || type->t->isVoidTy())
+        return std::unexpected(UnknownType{g.type});
+    declare_variable(g.name.text, type, g.is_thread_local);
+    return {};
+}
+
+void CompileContext::declare_variable(std::string_view name, Type* type, bool is_thread_local) {
+    auto* var = new llvm::GlobalVariable(*mod, type->t, false, llvm::GlobalValue::ExternalLinkage,
+        nullptr, name, nullptr,
+        is_thread_local ? llvm::GlobalValue::GeneralDynamicTLSModel : llvm::GlobalValue::NotThreadLocal);
+    global_consts[name] = std::make_unique<Value>(Value{var, Type{var->getType(), type, nullptr}, nullptr});
+    if (is_thread_local)
+        thread_locals.insert(name);
+    else
+        thread_locals.erase(name);
+}
+
+void CompileContext::reset_module(std::string name) {
+    mod = std::make_unique<llvm::Module>(std::move(name), *ctx);
+    builder.ClearInsertionPoint();
+    builder.SetCurrentDebugLocation({});
+    debug = nullptr;//the old compile unit belonged to the old module
+    profile = nullptr;
+
+    //instances were internal to the old module
+    for (auto& name : instance_names)
+        global_consts.erase(name);
+
+    for (auto& [name, val] : global_consts) {
+        if (!val->type.func && val->type.stored) {
+            val->v = new llvm::GlobalVariable(*mod, val->type.stored->t, false,
+                llvm::GlobalValue::ExternalLinkage, nullptr, name, nullptr,
+                thread_locals.contains(name) ? llvm::GlobalValue::GeneralDynamicTLSModel
+                                             : llvm::GlobalValue::NotThreadLocal);
+            continue;
+        }
+        if (!val->type.func)
+            continue;
+
+        llvm::Function* fn = llvm::Function::Create(
+            val->type.func->ft, llvm::Function::ExternalLinkage, name, *mod);
+        fn->setCallingConv(val->type.func->cc);
+        val->v = fn;
+    }
+}
+
+LineTable::LineTable(std::string_view s) : src(s) {
+    starts.push_back(0);
+    for (size_t i = 0; i < src.size(); ++i)
+        if (src[i] == '\n')
+            starts.push_back(i + 1);
+}
+
+bool LineTable::position(std::string_view text, unsigned& line, unsigned& col) const {
+    if (!text.data() || text.data() < src.data() || text.data() > src.data() + src.size())
+        return false;
+
+    size_t off = text.data() - src.data();
+    auto it = std::upper_bound(starts.begin(), starts.end(), off);
+    line = it - starts.begin();
+    col = off - *(it - 1) + 1;
+    return true;
+}
+
+void CompileContext::enable_debug_info(std::string_view src, std::string_view path, bool optimized) {
+    debug = std::make_unique<DebugInfo>();
+    debug->lines = LineTable(src);
+
+    std::filesystem::path p(path);
+    debug->builder = std::make_unique<llvm::DIBuilder>(*mod);
+    debug->file = debug->builder->createFile(p.filename().string(), p.parent_path().string());
+    debug->unit = debug->builder->createCompileUnit(
+        llvm::dwarf::DW_LANG_C, debug->file, "small_lang", optimized, "", 0);
+    debug->int_type = debug->builder->createBasicType("int", 64, llvm::dwarf::DW_ATE_signed);
+
+    mod->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    mod->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+void CompileContext::finish_debug_info() {
+    if (debug)
+        debug->builder->finalize();
+}
+
+llvm::DebugLoc CompileContext::set_location(std::string_view text) {
+    llvm::DebugLoc prev = builder.getCurrentDebugLocation();
+    if (!debug || !debug->scope)
+        return prev;
+
+    unsigned line, col;
+    if (debug->lines.position(text, line, col))
+        builder.SetCurrentDebugLocation(llvm::DILocation::get(*ctx, line, col, debug->scope));
+    return prev;
+}
+
+void CompileContext::enable_profile(std::string_view src, std::string_view path, std::string symbol) {
+    profile = std::make_unique<Profile>();
+    profile->symbol = std::move(symbol);
+    profile->path = path;
+    profile->lines = LineTable(src);
+    profile->counts = new llvm::GlobalVariable(*mod, llvm::ArrayType::get(int_type.t, 0), false,
+        llvm::GlobalValue::ExternalLinkage, nullptr, profile->symbol);
+}
+
+void CompileContext::count(std::string what, std::string_view at) {
+    if (!profile)
+        return;
+
+    //plain load/add/store, a lost update under threads is fine for a profile
+    llvm::Value* slot = builder.CreateConstInBoundsGEP1_64(
+        int_type.t, profile->counts, profile->sites.size());
+    llvm::Value* old = builder.CreateLoad(int_type.t, slot);
+    builder.CreateStore(builder.CreateAdd(old, builder.getInt64(1)), slot);
+
+    profile->sites.push_back({std::move(what), at});
+}
+
+void CompileContext::finish_profile() {
+    if (!profile)
+        return;
+
+    auto* type = llvm::ArrayType::get(int_type.t, profile->sites.size());
+    auto* counts = new llvm::GlobalVariable(*mod, type, false,
+        llvm::GlobalValue::ExternalLinkage, llvm::ConstantAggregateZero::get(type));
+    profile->counts->replaceAllUsesWith(counts);
+    counts->takeName(profile->counts);
+    profile->counts->eraseFromParent();
+    profile->counts = counts;
+}
+
 } // namespace small_lang
@@ -2,10 +2,17 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/DIBuilder.h>
+#include <deque>
 #include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <expected>
 #include <memory>
+#include <functional>
+#include <ostream>
+#include <variant>
 
 #include "ast.hpp"
 #include "scope.hpp"
@@ -13,14 +20,15 @@
 
 namespace small_lang {
 
+namespace mir { struct Function; }
 
 struct FunctionType;
 struct Type {
-	llvm::Type* t;
+	llvm::Type* t = nullptr;
 	
-	//optionals (live in function/global storage)
-	Type* stored;
-	FunctionType* func;
+	//optionals (interned, see CompileContext::intern)
+	Type* stored = nullptr;
+	FunctionType* func = nullptr;
 };
 
 struct FunctionType {
@@ -32,11 +40,11 @@ struct FunctionType {
 };
 
 struct Value {
-	llvm::Value* v;
+	llvm::Value* v = nullptr;
 	Type type;
 
 	//optionals (live in function/global storage)
-	Value* address;
+	Value* address = nullptr;
 };
 
 //=============ERRORS=========
@@ -53,6 +61,61 @@ struct CantBool {
     Type got;
 };
 
+struct UnknownType {
+    TypeDec type;
+};
+
+//global initializers are folded at compile time
+struct NotConstant {
+    const Expression& exp;
+};
+
+//a literal initializer the global's type cant hold
+struct OutOfRange {
+    const Expression& exp;
+    Type type;
+};
+
+//a file defines each top level name once, only the REPL replaces definitions
+struct Redefined {
+    Var name;
+};
+
+//atomic builtins take relaxed, acquire, release, acq_rel or seq_cst (whichever the operation allows)
+struct BadOrdering {
+    const Expression& exp;
+};
+
+//a coroutine returns its handle, so whatever it yields or returns has to be an int too
+struct CoroutineReturn {
+    const FuncDec& func;
+    Type got;
+};
+
+//C callers cant drive next/done on a handle, so a cfn cant yield
+struct CfnCoroutine {
+    const FuncDec& func;
+};
+
+//a generic call whose type parameters cant be worked out from the argument types
+struct CantInfer {
+    const Call& call;
+    Var param;
+    Type first; //what an earlier argument bound param to, null if none did
+    Type second;//what this argument needs instead, null if param appears in no argument
+};
+
+//generic instances that keep asking for new instances (f[T] calling f[T*])
+struct InstanceDepth {
+    const Call& call;
+};
+
+//comptime didnt produce a constant, why is the JIT's message or what was wrong with the result
+struct ComptimeFailed {
+    const Comptime& at;
+    std::string why;
+};
+
 struct WrongArgCount {
     const Call& call;
     FunctionType* t;//can give count
@@ -68,7 +131,7 @@ struct BadType {
 
 struct StatmentError;
 
-using CompileError = std::variant<MissingVar,NotAFunction,CantBool,BadType<Expression>,BadType<BinOp>,BadType<Return>,BadType<TypeCast>,WrongArgCount,StatmentError>;
+using CompileError = std::variant<MissingVar,NotAFunction,CantBool,BadType<Expression>,BadType<BinOp>,BadType<Return>,BadType<TypeCast>,WrongArgCount,CantInfer,InstanceDepth,ComptimeFailed,UnknownType,NotConstant,OutOfRange,Redefined,BadOrdering,CoroutineReturn,CfnCoroutine,StatmentError>;
 struct StatmentError {
 	const Statement& parent;
 	std::unique_ptr<CompileError> source;
@@ -78,47 +141,222 @@ using vresult_t = std::expected<Value,CompileError>;
 using result_t = std::expected<void,CompileError>;
 
 
+//maps Token::text views back to the source buffer they point into
+struct LineTable {
+    std::string_view src;
+    std::vector<size_t> starts;//offset of every line in src
+
+    LineTable() = default;
+    explicit LineTable(std::string_view src);
+
+    //1 based, false if text does not point into src
+    bool position(std::string_view text, unsigned& line, unsigned& col) const;
+};
+
+//DWARF for one source buffer
+struct DebugInfo {
+    std::unique_ptr<llvm::DIBuilder> builder;
+    llvm::DICompileUnit* unit = nullptr;
+    llvm::DIFile* file = nullptr;
+    llvm::DIType* int_type = nullptr;
+    llvm::DISubprogram* scope = nullptr;//function being compiled
+    LineTable lines;
+};
+
+//execution counters (--profile-counts), one i64 per site in a single exported array
+struct ProfileSite {
+    std::string what;
+    std::string_view at;//the token the count is reported against
+};
+
+struct Profile {
+    std::string symbol;//the counter array, the driver reads it back from the JIT
+    std::string path;
+    llvm::GlobalVariable* counts = nullptr;//placeholder until finish_profile knows the size
+    std::vector<ProfileSite> sites;
+    LineTable lines;
+};
+
+//the coroutine being compiled (switch resumed llvm.coro lowering), every field is null outside one
+struct Coroutine {
+    llvm::Value* id = nullptr;     //token from llvm.coro.id
+    llvm::Value* handle = nullptr; //from llvm.coro.begin, doubles as the value handed back
+    llvm::Value* promise = nullptr;//i64 slot next() and await read the yielded value from
+    llvm::BasicBlock* cleanup = nullptr;//frees the frame when it is destroyed
+    llvm::BasicBlock* suspend = nullptr;//returns to whoever resumed us
+    llvm::BasicBlock* finish = nullptr; //the one final suspend, every return stores its value and jumps here
+};
+
+//a heap allocation promote_allocations moved onto the stack
+struct Promotion {
+    std::string function;
+    std::string allocator;//malloc, calloc or aligned_alloc
+    uint64_t bytes;       //the bound, the call itself may ask for less
+    unsigned line;        //0 without debug info
+};
+
 struct CompileContext {
     CompileContext(std::string name)
-        : ctx(std::make_unique<llvm::LLVMContext>()),
+        : owned_ctx(std::make_unique<llvm::LLVMContext>()),
+          ctx(owned_ctx.get()),
           mod(std::make_unique<llvm::Module>(std::move(name), *ctx)),
           builder(*ctx),
           int_type(Type{llvm::Type::getInt64Ty(*ctx),nullptr,nullptr}),
           bool_type(Type{llvm::Type::getInt1Ty(*ctx), nullptr, nullptr}),
+          i32_type(Type{llvm::Type::getInt32Ty(*ctx), nullptr, nullptr}),
+          char_type(Type{llvm::Type::getInt8Ty(*ctx), nullptr, nullptr}),
+          double_type(Type{llvm::Type::getDoubleTy(*ctx), nullptr, nullptr}),
+          void_type(Type{llvm::Type::getVoidTy(*ctx), nullptr, nullptr}),
 		  
 		  int_ptr_type{llvm::PointerType::get(*ctx,0), &int_type, nullptr },
 		  bool_ptr_type{llvm::PointerType::get(*ctx,0), &bool_type, nullptr }
-    {}
+    {
+        for (Type* t : {&int_type, &bool_type, &i32_type, &char_type, &double_type, &void_type,
+                        &int_ptr_type, &bool_ptr_type})
+            type_table[{t->t, t->stored, t->func}] = t;
+    }
 
     result_t compile(const Expression& exp,Value& out);
     result_t compile(const Statement& stmt);
     result_t compile(const Global& global);
 
     Type* get_type(const TypeDec& t);
+    Type* get_type(std::string_view name);//"int", "char**" ... null if unknown
+    Type* pointer_to(Type* t);//void* has no stored type, it cant be dereferenced
+    Type* canonical(const Type& t);//the get_type/pointer_to object for t, null for function types
+
+    //hash-consed types: equal types are one object for the life of the context,
+    //so comparing them (or anything that points at them) is comparing addresses
+    Type* intern(const Type& t);//stored is interned first, func has to come from intern below
+    FunctionType* intern(FunctionType f);//ret and args are interned first
+
+    //a Value that lives until the function is done, the storage is reused by the next one
+    Value* local_value(Value v = {});
+    std::string type_name(const Type* t) const;//as written after @, t has to be canonical
+
+    //!tbaa for memory read or written through a pointer as t, null when strict_aliasing is off
+    //like C a char access may alias anything, otherwise int, i32, bool, double and pointers dont alias each other
+    llvm::MDNode* tbaa(const Type& t);
+
+    //compiles f with its type parameters bound, as name (internal to mod)
+    //every function-local piece of state is put aside so this can run in the middle of a call
+    result_t instantiate(const Call& at, const Function& f, std::string_view name,
+                         std::map<std::string_view, Type*> bindings);
+
+    //replays history into a throwaway context, runs c there through run_comptime
+    //and hands back the result as a constant of this context
+    result_t comptime(const Comptime& c, Value& out);
+
+    //adds a function to mod and global_consts, name has to outlive the context
+    Value* declare_function(std::string_view name, Type ret,
+                            std::vector<Type> args, llvm::CallingConv::ID cc,
+                            bool varargs = false);
+
+    //an exported variable of an imported file, extern here (it is defined there)
+    result_t declare_variable(const GlobalVar& g);
+    //the same from a precompiled module, name has to outlive the context
+    void declare_variable(std::string_view name, Type* type, bool is_thread_local);
+
+    //start a fresh module and redeclare every known global in it
+    //the old module must already be handed off (or dropped) by the caller
+    void reset_module(std::string name);
+
+    //emit line tables for everything compiled from src from now on
+    //every Token::text handed to compile() has to point into src
+    void enable_debug_info(std::string_view src, std::string_view path, bool optimized);
+    void finish_debug_info();//before verifying
+
+    //points the builder at text, returns the old location to restore
+    llvm::DebugLoc set_location(std::string_view text);
+
+    //count function entries and If branches into symbol (an [N x i64])
+    void enable_profile(std::string_view src, std::string_view path, std::string symbol);
+    void finish_profile();//sizes the counter array, after the last compile()
+
+    //bumps a new counter at the current insert point (no-op without a profile)
+    void count(std::string what, std::string_view at);
+
+    //escape analysis over every function in mod (escape.cpp), after the last compile()
+    //malloc/calloc/aligned_alloc of a bounded size whose pointer never leaves the
+    //function become entry block allocas and the frees on them are dropped
+    std::vector<Promotion> promote_allocations();
+
+    bool mid_ir = true;//functions in the integer subset go through mir.hpp first
+    bool internal_globals = false;//unexported global variables get internal linkage, not in the REPL which links every line by name
+    bool allow_redefinition = true;//the REPL replaces a definition with the next one, a file cant
+    bool strict_aliasing = true;//tbaa() tags, off for programs that read memory as another type than it was written
+    std::ostream* mir_log = nullptr;//--print-mir, each one is printed after its passes
+    std::function<void(std::string_view name, mir::Function&& f)> keep_mir;//gets every function once lowered (--interp)
 
     FunctionType* current_func = nullptr;
-    std::unique_ptr<llvm::LLVMContext> ctx;
+    std::unique_ptr<llvm::LLVMContext> owned_ctx;//moved out when handing the context to the JIT
+    llvm::LLVMContext* ctx;
     std::unique_ptr<llvm::Module> mod;
+    std::unique_ptr<DebugInfo> debug;//null unless enable_debug_info was called
+    std::unique_ptr<Profile> profile;//null unless enable_profile was called
 
     llvm::IRBuilder<> builder;
     Type int_type;
     Type bool_type;
+    Type i32_type;
+    Type char_type;//i8
+    Type double_type;
+    Type void_type;//only as a return type
 
     Type int_ptr_type;
     Type bool_ptr_type;
+
+    struct TypeKey {
+        llvm::Type* t;
+        const Type* stored;
+        const FunctionType* func;
+        bool operator==(const TypeKey&) const = default;
+    };
+    struct TypeKeyHash {
+        size_t operator()(const TypeKey& k) const {
+            std::hash<const void*> h;
+            return h(k.t) ^ (h(k.stored) * 31) ^ (h(k.func) * 961);
+        }
+    };
+    std::unordered_map<TypeKey, Type*, TypeKeyHash> type_table;//the members above are in it too
+    std::deque<Type> type_arena;//the rest of intern, deque so nothing moves
+    std::map<std::pair<const llvm::FunctionType*, llvm::CallingConv::ID>, std::vector<FunctionType*>> func_table;
+    std::deque<FunctionType> func_arena;
+    std::map<llvm::Type*, llvm::MDNode*> tbaa_tags;//by the llvm type, every pointer shares one
     // std::map<std::string_view, llvm::AllocaInst*> vars;
     // std::map<std::string_view, llvm::Value*> consts;
 
-    Scope<std::unique_ptr<Value>> local_var_addrs;
-    std::map<std::string_view, std::unique_ptr<Value>> global_consts;
-    std::vector<std::unique_ptr<Type>> local_type_arena;
-    std::vector<std::unique_ptr<Value>> local_arena;
-    std::vector<std::unique_ptr<FunctionType>> func_defs;    
+    Scope<Value*> local_var_addrs;//into local_values
+    std::map<std::string_view, std::unique_ptr<Value>> global_consts;//functions and global variables
+    std::set<std::string_view> thread_locals;//the global variables that are thread_local
+    std::map<std::string_view, const Function*> generics;//instantiated on call, the AST has to outlive the context
+    std::set<std::string, std::less<>> instance_names;//name[int,char*], global_consts points into these
+    std::map<std::string_view, Type*> type_args;//bindings of the instance being compiled
+    unsigned instance_depth = 0;
+
+    //the globals compiled so far in order (declarations are copied, the AST they come from may be gone)
+    std::vector<std::variant<const Function*, const GlobalVar*, FuncDec>> history;
+    //runs entry(void* out) of tmp.mod (the JIT takes the module and its context), set by the driver
+    std::function<std::expected<void, std::string>(CompileContext& tmp, const std::string& entry, void* out)> run_comptime;
+    std::vector<std::unique_ptr<CompileContext>> failed_comptimes;//errors point into their types
+    //what every comptime outside an instance folded to, by where it sits in the source
+    //shared with the throwaway contexts so replaying history never runs one twice
+    struct Folded { uint64_t bits; std::string type; };
+    std::shared_ptr<std::map<const char*, Folded>> folded = std::make_shared<std::map<const char*, Folded>>();
+    std::deque<Value> local_values;//local_value, only grows
+    size_t local_values_used = 0;
+    size_t local_values_base = 0;//what the function being compiled starts from, above its caller's in an instance
+    std::vector<llvm::Value*> regions;//SmallRegion of every open region block, innermost last
+    llvm::Value* spawned = nullptr;//i64 count of unsynced spawns, made by the first spawn in a function
+    std::vector<llvm::BasicBlock*> cold_blocks;//moved to the end once their function is done, instances stack above
+    Coroutine coro;
 
     void clear_locals(){
     	local_var_addrs.clear();
-    	local_type_arena.clear();
-    	local_arena.clear();
+    	regions.clear();
+    	spawned = nullptr;
+    	coro = {};
+    	local_values_used = local_values_base;
     }
 };
 
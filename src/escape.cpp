@@ -0,0 +1,296 @@
+#include "compiler.hpp"
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Transforms/Utils/BuildLibCalls.h>
+#include <llvm/TargetParser/Host.h>
+
+#include <algorithm>
+#include <optional>
+#include <set>
+
+namespace small_lang {
+
+// ------------------------------------------------------------
+// Heap to stack promotion
+//   runs on the IR straight out of the visitors (before mem2reg) so locals
+//   are still alloca slots, a pointer parked in a slot is followed through
+//   every load of that slot
+//   a call escapes if its pointer (or any int/pointer computed from it)
+//   is stored into real memory, returned, or handed to a call that may
+//   capture it, free is the one call that is allowed and gets dropped
+//   (realloc and friends escape even when marked nocapture)
+// ------------------------------------------------------------
+
+//bigger requests stay on the heap, the stack is only 8MB and recursion is our loop
+static constexpr uint64_t MAX_PROMOTED = 1024;
+
+//an alloca only ever loaded from and stored to, what the visitors make for a local
+static bool is_slot(const llvm::Value* v) {
+	auto* a = llvm::dyn_cast<llvm::AllocaInst>(v);
+	if (!a)
+		return false;
+	for (const llvm::User* u : a->users()) {
+		if (llvm::isa<llvm::LoadInst>(u))
+			continue;
+		auto* st = llvm::dyn_cast<llvm::StoreInst>(u);
+		if (!st || st->getValueOperand() == a)
+			return false;
+	}
+	return true;
+}
+
+//constant, or loaded from a slot that is only ever set to constants (the largest one)
+static std::optional<uint64_t> size_bound(const llvm::Value* v) {
+	if (auto* c = llvm::dyn_cast<llvm::ConstantInt>(v))
+		return c->getZExtValue();
+	if (auto* ext = llvm::dyn_cast<llvm::ZExtInst>(v))
+		return size_bound(ext->getOperand(0));
+
+	auto* load = llvm::dyn_cast<llvm::LoadInst>(v);
+	if (!load || !is_slot(load->getPointerOperand()))
+		return std::nullopt;
+
+	std::optional<uint64_t> bound;
+	for (const llvm::User* u : load->getPointerOperand()->users()) {
+		auto* st = llvm::dyn_cast<llvm::StoreInst>(u);
+		if (!st)
+			continue;
+		auto* c = llvm::dyn_cast<llvm::ConstantInt>(st->getValueOperand());
+		if (!c || c->isNegative())
+			return std::nullopt;
+		bound = std::max(bound.value_or(0), c->getZExtValue());
+	}
+	return bound;
+}
+
+//true if f can end up calling itself, calls we cant see into count as yes
+//(indirect calls and other small modules, plain C is assumed not to call back)
+//a function whose address is taken (stored, handed to spawn) may be called from
+//anywhere, so f having its address taken or reaching one that does counts too
+static bool may_recurse(llvm::Function& f) {
+	if (f.hasAddressTaken())
+		return true;
+
+	std::set<const llvm::Function*> seen;
+	std::vector<const llvm::Function*> todo{&f};
+	//false if callee means f may recurse
+	auto reach = [&](const llvm::Function* callee) {
+		if (callee == &f)
+			return false;
+		if (callee->isIntrinsic())
+			return true;
+		if (callee->isDeclaration())
+			return callee->getCallingConv() == llvm::CallingConv::C;
+		if (seen.insert(callee).second)
+			todo.push_back(callee);
+		return true;
+	};
+	while (!todo.empty()) {
+		const llvm::Function* cur = todo.back();
+		todo.pop_back();
+		for (const llvm::BasicBlock& bb : *cur)
+			for (const llvm::Instruction& inst : bb) {
+				auto* call = llvm::dyn_cast<llvm::CallBase>(&inst);
+				if (call && !call->isInlineAsm() && !call->getCalledFunction())
+					return true;
+				for (const llvm::Use& op : inst.operands())
+					if (auto* fn = llvm::dyn_cast<llvm::Function>(op.get()); fn && !reach(fn))
+						return true;
+			}
+	}
+	return false;
+}
+
+//block sits on a cycle, one stack slot would be shared by every trip around it
+static bool in_cycle(llvm::BasicBlock* bb) {
+	for (llvm::BasicBlock* succ : llvm::successors(bb))
+		if (llvm::isPotentiallyReachable(succ, bb))
+			return true;
+	return false;
+}
+
+//the callee resizes or releases the block, a stack slot must never reach the allocator
+//(the inferred libfunc attributes mark realloc's pointer nocapture)
+static bool reaches_allocator(const llvm::CallBase* call, unsigned arg) {
+	if (call->paramHasAttr(arg, llvm::Attribute::AllocatedPointer))
+		return true;
+	if (llvm::Attribute kind = call->getFnAttr(llvm::Attribute::AllocKind); kind.isValid()
+	 && (kind.getAllocKind() & (llvm::AllocFnKind::Realloc | llvm::AllocFnKind::Free)) != llvm::AllocFnKind::Unknown)
+		return true;
+	const llvm::Function* callee = call->getCalledFunction();
+	if (!callee)
+		return false;
+	llvm::StringRef name = callee->getName();
+	return name == "realloc" || name == "reallocarray" || name == "reallocf" || name == "free";
+}
+
+//follows everything computed from root, fills frees with the calls to drop
+//false as soon as something escapes
+static bool stays_local(llvm::Instruction* root, std::vector<llvm::CallBase*>& frees) {
+	std::vector<llvm::Value*> todo{root};
+	std::set<llvm::Value*> seen{root};
+	std::set<llvm::Value*> slots;
+
+	auto derived = [&](llvm::Value* v) {
+		if (seen.insert(v).second)
+			todo.push_back(v);
+	};
+
+	while (!todo.empty()) {
+		llvm::Value* v = todo.back();
+		todo.pop_back();
+
+		for (llvm::User* u : v->users()) {
+			if (llvm::isa<llvm::LoadInst>(u) || llvm::isa<llvm::ICmpInst>(u))
+				continue;
+
+			if (llvm::isa<llvm::GetElementPtrInst>(u) || llvm::isa<llvm::CastInst>(u)
+			 || llvm::isa<llvm::BinaryOperator>(u)) {
+				derived(u);
+				continue;
+			}
+
+			if (auto* st = llvm::dyn_cast<llvm::StoreInst>(u)) {
+				if (st->getPointerOperand() == v && st->getValueOperand() != v)
+					continue;
+				llvm::Value* dst = st->getPointerOperand();
+				if (!is_slot(dst))
+					return false;
+				if (slots.insert(dst).second)
+					for (llvm::User* su : dst->users())
+						if (llvm::isa<llvm::LoadInst>(su))
+							derived(su);
+				continue;
+			}
+
+			if (auto* call = llvm::dyn_cast<llvm::CallBase>(u)) {
+				llvm::Function* callee = call->getCalledFunction();
+				if (callee && callee->isDeclaration() && callee->getName() == "free") {
+					frees.push_back(call);
+					continue;
+				}
+				for (unsigned i = 0; i < call->arg_size(); ++i)
+					if (call->getArgOperand(i) == v && (!call->doesNotCapture(i) || reaches_allocator(call, i)))
+						return false;
+				if (call->getCalledOperand() == v)
+					return false;
+				continue;
+			}
+
+			//returns, phis, selects, atomics... anything we dont follow
+			return false;
+		}
+	}
+
+	//a slot holding something else as well would make its frees ambiguous
+	for (llvm::Value* slot : slots)
+		for (llvm::User* su : slot->users())
+			if (auto* st = llvm::dyn_cast<llvm::StoreInst>(su))
+				if (!seen.count(st->getValueOperand()))
+					return false;
+	return true;
+}
+
+std::vector<Promotion> CompileContext::promote_allocations() {
+	std::vector<Promotion> ans;
+
+	//the driver leaves the triple to the JIT, which builds for the host
+	llvm::Triple triple(mod->getTargetTriple());
+	if (triple.getArch() == llvm::Triple::UnknownArch)
+		triple = llvm::Triple(llvm::sys::getProcessTriple());
+	llvm::TargetLibraryInfoImpl tlii(triple);
+	llvm::TargetLibraryInfo tli(tlii);
+
+	//the C declarations carry no attributes yet, nocapture is what lets strlen(buf) stay local
+	for (llvm::Function& f : *mod)
+		if (f.isDeclaration() && !f.isIntrinsic())
+			llvm::inferNonMandatoryLibFuncAttrs(f, tli);
+
+	struct Candidate {
+		llvm::CallInst* call;
+		uint64_t bytes;
+		uint64_t align;
+		std::vector<llvm::CallBase*> frees;
+	};
+
+	for (llvm::Function& f : *mod) {
+		if (f.isDeclaration())
+			continue;
+
+		std::vector<Candidate> found;
+		for (llvm::BasicBlock& bb : f)
+			for (llvm::Instruction& inst : bb) {
+				auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+				llvm::Function* callee = call ? call->getCalledFunction() : nullptr;
+				//an untyped cfn malloc(size) hands back an int
+				if (!callee || !callee->isDeclaration() || callee->getCallingConv() != llvm::CallingConv::C
+				 || !(call->getType()->isPointerTy() || call->getType()->isIntegerTy(64)))
+					continue;
+
+				llvm::StringRef name = callee->getName();
+				std::optional<uint64_t> bytes;
+				uint64_t align = 16;//what malloc promises
+				if (name == "malloc" && call->arg_size() == 1) {
+					bytes = size_bound(call->getArgOperand(0));
+				} else if (name == "calloc" && call->arg_size() == 2) {
+					auto n = size_bound(call->getArgOperand(0));
+					auto size = size_bound(call->getArgOperand(1));
+					if (n && size && *n <= MAX_PROMOTED && *size <= MAX_PROMOTED)
+						bytes = *n * *size;
+				} else if (name == "aligned_alloc" && call->arg_size() == 2) {
+					auto* a = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(0));
+					if (a && a->getValue().isPowerOf2() && a->getZExtValue() <= 4096) {
+						align = std::max<uint64_t>(align, a->getZExtValue());
+						bytes = size_bound(call->getArgOperand(1));
+					}
+				}
+
+				if (!bytes || *bytes == 0 || *bytes > MAX_PROMOTED || in_cycle(&bb))
+					continue;
+
+				Candidate c{call, *bytes, align, {}};
+				if (stays_local(call, c.frees))
+					found.push_back(std::move(c));
+			}
+
+		if (found.empty() || may_recurse(f))
+			continue;
+
+		llvm::BasicBlock& entry = f.getEntryBlock();
+		for (Candidate& c : found) {
+			llvm::IRBuilder<> b(&entry, entry.getFirstInsertionPt());
+			auto* slot = b.CreateAlloca(llvm::ArrayType::get(b.getInt8Ty(), c.bytes));
+			slot->setAlignment(llvm::Align(c.align));
+			slot->takeName(c.call);
+
+			llvm::StringRef name = c.call->getCalledFunction()->getName();
+			b.SetInsertPoint(c.call);
+			llvm::Value* repl = slot;
+			if (!c.call->getType()->isPointerTy())
+				repl = b.CreatePtrToInt(slot, c.call->getType());
+			if (name == "calloc") {
+				b.CreateMemSet(slot, b.getInt8(0),
+					b.CreateMul(c.call->getArgOperand(0), c.call->getArgOperand(1)), llvm::Align(c.align));
+			}
+
+			unsigned line = 0;
+			if (const llvm::DebugLoc& loc = c.call->getDebugLoc())
+				line = loc.getLine();
+			ans.push_back({f.getName().str(), name.str(), c.bytes, line});
+
+			c.call->replaceAllUsesWith(repl);
+			c.call->eraseFromParent();
+			for (llvm::CallBase* fr : c.frees) {
+				if (!fr->use_empty())//an untyped cfn free returns an int
+					fr->replaceAllUsesWith(llvm::Constant::getNullValue(fr->getType()));
+				fr->eraseFromParent();
+			}
+		}
+	}
+	return ans;
+}
+
+}//small_lang
@@ -0,0 +1,438 @@
+#include "interp.hpp"
+
+#include <llvm/IR/Module.h>
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+
+namespace small_lang::interp {
+
+//registers start at 512KB and double when a call needs more, recursion is how the
+//language loops so this goes well past what the native stack gives compiled code (256MB)
+static constexpr size_t STACK_WORDS = size_t(1) << 16;
+static constexpr size_t MAX_STACK_WORDS = size_t(1) << 25;
+
+//what the trampoline can pass (all of them in registers on SysV x86-64)
+static constexpr uint32_t MAX_NATIVE_ARGS = 6;
+
+int32_t Program::find(std::string_view name) const {
+	for (size_t i = 0; i < funcs.size(); ++i)
+		if (funcs[i].name == name)
+			return i;
+	return -1;
+}
+
+// ------------------------------------------------------------
+// mir -> bytecode
+// ------------------------------------------------------------
+namespace {
+
+struct FunctionCompiler {
+	Program& p;
+	const mir::Function& f;
+	const std::map<std::string_view, uint32_t>& funcs;
+	std::string& why;
+
+	std::vector<uint32_t> reg;
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> moves;//per block, phi copies made when leaving it
+
+	void emit(Insn in) { p.code.push_back(in); }
+
+	//back to the canonical form after an op that can leave the width
+	void wrap(uint32_t dst, uint8_t width) {
+		if (width < 64)
+			emit({width == 1 ? Code::Mask : Code::Wrap, width, dst});
+	}
+
+	static bool live(const mir::Function& f, uint32_t b) {
+		uint32_t end = f.block_end(b);
+		return end > f.starts[b] && (f.ops[end - 1] == mir::Op::Br || f.ops[end - 1] == mir::Op::CondBr
+		                          || f.ops[end - 1] == mir::Op::Ret);
+	}
+
+	bool fail(std::string reason) {
+		why = std::move(reason);
+		return false;
+	}
+
+	//index into funcs or natives, is_native says which
+	bool callee(const mir::Callee& c, uint32_t& index, bool& is_native) {
+		auto* fn = llvm::dyn_cast<llvm::Function>(c.fn);
+		if (!fn)
+			return fail("an indirect call");
+		std::string name = fn->getName().str();
+
+		if (auto it = funcs.find(name); it != funcs.end()) {
+			index = it->second;
+			is_native = false;
+			return true;
+		}
+
+		if (!fn->isDeclaration() || fn->getCallingConv() != llvm::CallingConv::C)
+			return fail(std::format("{} is not a C function", name));
+		if (fn->isVarArg() || fn->arg_size() > MAX_NATIVE_ARGS)
+			return fail(std::format("{} takes varargs or more than {} arguments", name, MAX_NATIVE_ARGS));
+
+		for (size_t i = 0; i < p.natives.size(); ++i)
+			if (p.natives[i].name == name) {
+				index = i;
+				is_native = true;
+				return true;
+			}
+
+		void* sym = dlsym(RTLD_DEFAULT, name.c_str());
+		if (!sym)
+			return fail(std::format("{} is not in the process", name));
+		index = p.natives.size();
+		is_native = true;
+		p.natives.push_back({name, sym, static_cast<uint32_t>(fn->arg_size())});
+		return true;
+	}
+
+	//the next instruction that is still there, in the same block
+	uint32_t next_live(uint32_t i, uint32_t end) const {
+		while (++i < end && f.ops[i] == mir::Op::Nop) {}
+		return i;
+	}
+
+	bool run(uint32_t self) {
+		Program::Func& out = p.funcs[self];
+		out.entry = p.code.size();
+		out.args = f.type->args.size();
+
+		//arguments are the first registers, every other value gets one of its own
+		reg.assign(f.size(), NO_REG);
+		uint32_t next = out.args;
+		for (uint32_t i = 0; i < f.size(); ++i) {
+			if (f.ops[i] == mir::Op::Arg)
+				reg[i] = f.imms[i];
+			else if (f.ops[i] != mir::Op::Nop && f.widths[i])
+				reg[i] = next++;
+		}
+		out.regs = std::max<uint32_t>(next, 1);
+
+		moves.assign(f.blocks(), {});
+		std::vector<uint32_t> order;
+		for (uint32_t b = 0; b < f.blocks(); ++b) {
+			if (!live(f, b))
+				continue;
+			order.push_back(b);
+			for (uint32_t i = f.starts[b]; i < f.block_end(b); ++i)
+				if (f.ops[i] == mir::Op::Phi)
+					for (uint32_t k = 0; k < f.bs[i]; ++k)
+						moves[f.extra[f.as[i] + 2 * k]].push_back({reg[i], reg[f.extra[f.as[i] + 2 * k + 1]]});
+		}
+
+		std::vector<uint32_t> block_pc(f.blocks(), NO_REG);
+		for (size_t o = 0; o < order.size(); ++o) {
+			uint32_t b = order[o];
+			uint32_t fallthrough = o + 1 < order.size() ? order[o + 1] : NO_REG;
+			block_pc[b] = p.code.size();
+
+			uint32_t end = f.block_end(b);
+			for (uint32_t i = f.starts[b]; i < end; ++i)
+				if (!instruction(i, end, fallthrough, b))
+					return false;
+		}
+
+		//jumps were emitted with block numbers
+		for (size_t pc = out.entry; pc < p.code.size(); ++pc) {
+			Insn& in = p.code[pc];
+			if (in.op == Code::Jmp) {
+				in.a = block_pc[in.a];
+			} else if (in.op == Code::JmpIf) {
+				in.b = block_pc[in.b];
+				in.dst = block_pc[in.dst];
+			}
+		}
+		return true;
+	}
+
+	bool instruction(uint32_t& i, uint32_t end, uint32_t fallthrough, uint32_t block) {
+		using mir::Op;
+		uint8_t w = f.widths[i];
+		uint32_t dst = reg[i];
+		uint32_t a = f.ops[i] == Op::Nop ? 0 : f.as[i];
+
+		auto binary = [&](Code c) { emit({c, w, dst, reg[a], reg[f.bs[i]]}); };
+
+		//an i1 true is -1 to a signed compare, so on bools the order flips
+		auto compare = [&](Code c, Code on_bools) {
+			emit({f.widths[a] == 1 ? on_bools : c, 1, dst, reg[a], reg[f.bs[i]]});
+		};
+
+		switch (f.ops[i]) {
+		case Op::Nop: case Op::Arg: case Op::Phi:
+			return true;
+		case Op::Const:
+			emit({Code::LoadK, w, dst, static_cast<uint32_t>(p.consts.size())});
+			p.consts.push_back(f.imms[i]);
+			return true;
+		case Op::Copy:
+			emit({Code::Mov, w, dst, reg[a]});
+			return true;
+
+		case Op::Add:  binary(Code::Add); wrap(dst, w); return true;
+		case Op::Sub:  binary(Code::Sub); wrap(dst, w); return true;
+		case Op::Mul:  binary(Code::Mul); wrap(dst, w); return true;
+		case Op::SDiv: binary(Code::SDiv); wrap(dst, w); return true;
+		case Op::SRem: binary(Code::SRem); return true;
+		case Op::And:  binary(Code::And); return true;
+		case Op::Or:   binary(Code::Or); return true;
+		case Op::Xor:  binary(Code::Xor); return true;
+
+		case Op::Lt: compare(Code::Lt, Code::Gt); return true;
+		case Op::Gt: compare(Code::Gt, Code::Lt); return true;
+		case Op::Le: compare(Code::Le, Code::Ge); return true;
+		case Op::Ge: compare(Code::Ge, Code::Le); return true;
+		case Op::Eq: compare(Code::Eq, Code::Eq); return true;
+		case Op::Ne: compare(Code::Ne, Code::Ne); return true;
+
+		case Op::SExt:
+			emit({f.widths[a] == 1 ? Code::Neg : Code::Mov, w, dst, reg[a]});
+			return true;
+		case Op::ZExt:
+			emit({Code::Mov, w, dst, reg[a]});
+			if (f.widths[a] > 1)
+				emit({Code::Mask, f.widths[a], dst});
+			return true;
+		case Op::Trunc:
+			emit({Code::Mov, w, dst, reg[a]});
+			wrap(dst, w);
+			return true;
+
+		case Op::Call: {
+			uint32_t index;
+			bool is_native;
+			if (!callee(f.callees[f.imms[i]], index, is_native))
+				return false;
+			uint32_t args = p.args.size();
+			for (uint32_t k = 0; k < f.bs[i]; ++k)
+				p.args.push_back(reg[f.extra[a + k]]);
+
+			if (is_native) {
+				emit({Code::CallC, w, w ? dst : NO_REG, index, args});
+				if (w)
+					wrap(dst, w);
+				return true;
+			}
+
+			//return f(x) reuses the frame, recursion is how the language loops
+			uint32_t after = next_live(i, end);
+			if (after < end && f.ops[after] == Op::Ret && f.as[after] == i) {
+				emit({Code::TailCall, w, NO_REG, index, args});
+				i = after;
+				return true;
+			}
+			emit({Code::Call, w, w ? dst : NO_REG, index, args});
+			return true;
+		}
+
+		case Op::Br:
+			for (auto [to, from] : moves[block])
+				emit({Code::Mov, 0, to, from});
+			if (a != fallthrough)
+				emit({Code::Jmp, 0, NO_REG, a});
+			return true;
+		case Op::CondBr:
+			if (!moves[block].empty())
+				return fail("a phi on a conditional edge");
+			emit({Code::JmpIf, 0, static_cast<uint32_t>(f.imms[i]), reg[a], f.bs[i]});
+			return true;
+		case Op::Ret:
+			emit({Code::Ret, 0, NO_REG, reg[a]});
+			return true;
+		}
+		return true;
+	}
+};
+
+}//namespace
+
+std::unique_ptr<Program> compile(const std::map<std::string, mir::Function, std::less<>>& fns,
+                                 const llvm::Module& mod, std::string& why) {
+	auto p = std::make_unique<Program>();
+
+	//every function gets its index first so calls can go forward
+	std::map<std::string_view, uint32_t> funcs;
+	std::vector<const mir::Function*> bodies;
+	for (const llvm::Function& fn : mod) {
+		if (fn.isDeclaration())
+			continue;
+		llvm::StringRef name = fn.getName();
+		auto it = fns.find(std::string_view(name.data(), name.size()));
+		if (it == fns.end()) {
+			why = std::format("{} is not in the mid IR subset", name.str());
+			return nullptr;
+		}
+		funcs[it->first] = p->funcs.size();
+		p->funcs.push_back({it->first, 0, 0, 0});
+		bodies.push_back(&it->second);
+	}
+
+	for (uint32_t i = 0; i < bodies.size(); ++i)
+		if (!FunctionCompiler{*p, *bodies[i], funcs, why, {}, {}}.run(i)) {
+			why = std::format("{}: {}", p->funcs[i].name, why);
+			return nullptr;
+		}
+	return p;
+}
+
+// ------------------------------------------------------------
+// Dispatch
+// ------------------------------------------------------------
+
+//every integer goes in a general purpose register, extra ones are ignored by the callee
+static int64_t call_native(void* fn, const int64_t* regs, const uint32_t* args, uint32_t n) {
+	int64_t a[MAX_NATIVE_ARGS] = {};
+	for (uint32_t k = 0; k < n; ++k)
+		a[k] = regs[args[k]];
+	using Native = int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+	return reinterpret_cast<Native>(fn)(a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+[[noreturn]] static void overflow() {
+	std::cerr << "[interp] stack overflow\n";
+	std::abort();
+}
+
+//room for need more words above r, moves the stack (and r with it) when it grows
+static void reserve(std::vector<int64_t>& stack, int64_t*& r, size_t need) {
+	size_t at = r - stack.data();
+	if (at + need <= stack.size())
+		return;
+	size_t words = stack.size();
+	while (words < at + need)
+		words *= 2;
+	if (words > MAX_STACK_WORDS)
+		overflow();
+	stack.resize(words);
+	r = stack.data() + at;
+}
+
+int64_t run(const Program& p, uint32_t entry) {
+	struct Frame {
+		const Insn* call;//what we return to, its dst gets the result
+		size_t regs;//offset into the stack, which moves when it grows
+		uint32_t size;
+	};
+
+	//same order as Code
+	static const void* const labels[] = {
+		&&mov, &&loadk,
+		&&add, &&sub, &&mul, &&sdiv, &&srem, &&and_, &&or_, &&xor_,
+		&&lt, &&gt, &&le, &&ge, &&eq, &&ne,
+		&&neg, &&wrap, &&mask,
+		&&jmp, &&jmpif,
+		&&call, &&tailcall, &&callc, &&ret,
+	};
+	static_assert(std::size(labels) == static_cast<size_t>(Code::Ret) + 1);
+
+	std::vector<int64_t> stack(STACK_WORDS);
+	std::vector<Frame> frames;
+
+	const Insn* const code = p.code.data();
+	const int64_t* const consts = p.consts.data();
+	const uint32_t* const arg_regs = p.args.data();
+
+	int64_t* r = stack.data();
+	uint32_t size = p.funcs[entry].regs;
+	const Insn* pc = code + p.funcs[entry].entry;
+	reserve(stack, r, size);
+
+#define DISPATCH() goto *labels[static_cast<size_t>(pc->op)]
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define JUMP(to) do { pc = code + (to); DISPATCH(); } while (0)
+#define U(x) static_cast<uint64_t>(x)
+
+	DISPATCH();
+
+mov:   r[pc->dst] = r[pc->a]; NEXT();
+loadk: r[pc->dst] = consts[pc->a]; NEXT();
+
+//wraps around like the compiled code, Wrap/Mask bring narrow results back
+add:   r[pc->dst] = static_cast<int64_t>(U(r[pc->a]) + U(r[pc->b])); NEXT();
+sub:   r[pc->dst] = static_cast<int64_t>(U(r[pc->a]) - U(r[pc->b])); NEXT();
+mul:   r[pc->dst] = static_cast<int64_t>(U(r[pc->a]) * U(r[pc->b])); NEXT();
+//division by zero traps, same as it does compiled
+sdiv:  r[pc->dst] = r[pc->a] / r[pc->b]; NEXT();
+srem:  r[pc->dst] = r[pc->a] % r[pc->b]; NEXT();
+and_:  r[pc->dst] = r[pc->a] & r[pc->b]; NEXT();
+or_:   r[pc->dst] = r[pc->a] | r[pc->b]; NEXT();
+xor_:  r[pc->dst] = r[pc->a] ^ r[pc->b]; NEXT();
+
+lt:    r[pc->dst] = r[pc->a] < r[pc->b]; NEXT();
+gt:    r[pc->dst] = r[pc->a] > r[pc->b]; NEXT();
+le:    r[pc->dst] = r[pc->a] <= r[pc->b]; NEXT();
+ge:    r[pc->dst] = r[pc->a] >= r[pc->b]; NEXT();
+eq:    r[pc->dst] = r[pc->a] == r[pc->b]; NEXT();
+ne:    r[pc->dst] = r[pc->a] != r[pc->b]; NEXT();
+
+neg:   r[pc->dst] = static_cast<int64_t>(0 - U(r[pc->a])); NEXT();
+wrap: {
+	unsigned shift = 64 - pc->width;
+	r[pc->dst] = static_cast<int64_t>(U(r[pc->dst]) << shift) >> shift;
+	NEXT();
+}
+mask:  r[pc->dst] &= static_cast<int64_t>((U(1) << pc->width) - 1); NEXT();
+
+jmp:   JUMP(pc->a);
+jmpif: JUMP(r[pc->a] ? pc->b : pc->dst);
+
+call: {
+	const Program::Func& callee = p.funcs[pc->a];
+	reserve(stack, r, size + callee.regs);
+	int64_t* next = r + size;
+	for (uint32_t k = 0; k < callee.args; ++k)
+		next[k] = r[arg_regs[pc->b + k]];
+	frames.push_back({pc, static_cast<size_t>(r - stack.data()), size});
+	r = next;
+	size = callee.regs;
+	JUMP(callee.entry);
+}
+
+//the arguments go through the free space above the frame, they can read any register
+tailcall: {
+	const Program::Func& callee = p.funcs[pc->a];
+	reserve(stack, r, std::max(size + callee.args, callee.regs));
+	int64_t* scratch = r + size;
+	for (uint32_t k = 0; k < callee.args; ++k)
+		scratch[k] = r[arg_regs[pc->b + k]];
+	std::copy(scratch, scratch + callee.args, r);
+	size = callee.regs;
+	JUMP(callee.entry);
+}
+
+callc: {
+	const Program::Native& n = p.natives[pc->a];
+	int64_t v = call_native(n.fn, r, arg_regs + pc->b, n.args);
+	if (pc->dst != NO_REG)
+		r[pc->dst] = v;
+	NEXT();
+}
+
+ret: {
+	int64_t v = r[pc->a];
+	if (frames.empty())
+		return v;
+	Frame back = frames.back();
+	frames.pop_back();
+	r = stack.data() + back.regs;
+	size = back.size;
+	pc = back.call;
+	if (pc->dst != NO_REG)
+		r[pc->dst] = v;
+	NEXT();
+}
+
+#undef U
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+}
+
+}//small_lang::interp
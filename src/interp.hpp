@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mir.hpp"
+
+namespace small_lang::interp {
+
+// ------------------------------------------------------------
+// Register bytecode interpreter (--interp)
+//   built from the mid IR once its passes ran, so it runs exactly the
+//   programs whose every function is in the mir subset
+//   each function gets a frame of int64 registers (the arguments first),
+//   values are kept sign extended from their width like mir constants
+//   cfn calls go through a plain int64 trampoline, fine for every integer
+//   argument and return on the ABIs we run on (no varargs)
+// ------------------------------------------------------------
+
+enum class Code : uint8_t {
+	Mov,   //dst = a
+	LoadK, //dst = consts[a]
+	Add, Sub, Mul, SDiv, SRem, And, Or, Xor,//dst = a op b
+	Lt, Gt, Le, Ge, Eq, Ne,//dst = a cmp b
+	Neg,   //dst = -a
+	Wrap,  //dst sign extended from width
+	Mask,  //dst zero extended from width
+	Jmp,   //to a
+	JmpIf, //a ? b : dst
+	Call,  //dst = funcs[a](args[b..]), dst is NO_REG for void
+	TailCall,//return funcs[a](args[b..])
+	CallC, //dst = natives[a](args[b..])
+	Ret,   //a
+};
+
+static constexpr uint32_t NO_REG = ~0u;
+
+struct Insn {
+	Code op;
+	uint8_t width = 0;
+	uint32_t dst = NO_REG;
+	uint32_t a = 0;
+	uint32_t b = 0;
+};
+
+struct Program {
+	struct Func {
+		std::string name;
+		uint32_t entry;//index into code
+		uint32_t regs; //frame size
+		uint32_t args;
+	};
+	struct Native {
+		std::string name;
+		void* fn;
+		uint32_t args;
+	};
+
+	std::vector<Insn> code;//every function back to back
+	std::vector<int64_t> consts;
+	std::vector<uint32_t> args;//argument registers of the calls
+	std::vector<Func> funcs;
+	std::vector<Native> natives;
+
+	//index into funcs, -1 if there is no such function
+	int32_t find(std::string_view name) const;
+};
+
+//null if a function is outside the subset or calls something we cant reach, why says which
+//fns are the mir of every function defined in mod (by name)
+std::unique_ptr<Program> compile(const std::map<std::string, mir::Function, std::less<>>& fns,
+                                 const llvm::Module& mod, std::string& why);
+
+//runs funcs[entry] (which takes no arguments) to its return
+int64_t run(const Program& p, uint32_t entry);
+
+}//small_lang::interp
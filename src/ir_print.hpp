@@ -45,6 +45,8 @@ inline std::string to_string(const Type& type) {
             else
                 rso << "(?)";
         }
+        if (type.func->ft->isVarArg())
+            rso << (type.func->args.empty() ? "..." : ", ...");
         rso << ")";
         rso << " cc=" << static_cast<int>(type.func->cc) << ")";
     }
@@ -82,12 +84,82 @@ inline std::ostream& operator<<(std::ostream& os, const WrongArgCount& e) {
     os << "WrongArgCount:\n"
        << "  call: " << e.call << "\n";
     if (e.t)
-        os << "  expected arg count: " << e.t->args.size() << "\n";
+        os << "  expected arg count: " << (e.t->ft->isVarArg() ? "at least " : "")
+           << e.t->args.size() << "\n";
     else
         os << "  expected arg count: (unknown)\n";
     return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const UnknownType& e) {
+    os << "UnknownType:\n"
+       << "  " << e.type.text << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const NotConstant& e) {
+    os << "NotConstant:\n"
+       << "  " << (std::string_view)e.exp << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const OutOfRange& e) {
+    os << "OutOfRange: the value does not fit in " << to_string(e.type) << "\n"
+       << "  " << (std::string_view)e.exp << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Redefined& e) {
+    os << "Redefined: the name is already defined\n"
+       << "  " << e.name << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const BadOrdering& e) {
+    os << "BadOrdering: expected relaxed, acquire, release, acq_rel or seq_cst (valid for the operation)\n"
+       << "  got: " << (std::string_view)e.exp << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CantInfer& e) {
+    os << "CantInfer: type parameter " << e.param.text;
+    if (!e.second.t)
+        os << " does not appear in any argument type\n";
+    else if (!e.first.t)
+        os << " cant be read off an argument of type " << to_string(e.second) << "\n";
+    else
+        os << " is bound to two types\n"
+           << "  first:  " << to_string(e.first) << "\n"
+           << "  second: " << to_string(e.second) << "\n";
+    os << "  call: " << e.call << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const InstanceDepth& e) {
+    os << "InstanceDepth: generic instances nested too deep (does it instantiate itself with a new type?)\n"
+       << "  call: " << e.call << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const ComptimeFailed& e) {
+    os << "ComptimeFailed: " << e.why << "\n"
+       << "  at: " << e.at << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CoroutineReturn& e) {
+    os << "CoroutineReturn: a coroutine hands out its handle as an int, so it has to return int\n"
+       << "  function: " << e.func.name.text << "\n"
+       << "  declared: " << to_string(e.got) << "\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CfnCoroutine& e) {
+    os << "CfnCoroutine: a cfn cant yield, C callers have no way to resume it\n"
+       << "  function: " << e.func.name.text << "\n";
+    return os;
+}
+
 template <typename T>
 inline std::ostream& operator<<(std::ostream& os, const BadType<T>& e) {
     os << "BadType:\n"
@@ -3,22 +3,46 @@
 #include "parser.hpp"
 #include "ast_print.hpp"
 #include "ir_print.hpp"
+#include "smallc.hpp"
+#include "archive.hpp"
+#include "runtime.hpp"
+#include "mir.hpp"
+#include "interp.hpp"
 
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Passes/PassBuilder.h>
 
+#include <llvm/Support/raw_os_ostream.h>
+
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <optional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 namespace small_lang {
 
 
 // ------------------------------------------------------------
 // Modern optimizer (O2 pipeline, includes mem2reg etc.)
+// both pipelines schedule the coroutine passes (CoroEarly, CoroSplit,
+// CoroElide for frames that dont escape, CoroCleanup) so coroutines are
+// always split, without optimize only they run (through the O0 pipeline)
 // ------------------------------------------------------------
-static void optimize_module(llvm::Module& mod) {
+static void optimize_module(llvm::Module& mod, bool optimize = true) {
+    if (!optimize && !mod.getFunction("llvm.coro.begin"))
+        return;
+
     llvm::PassBuilder pb;
 
     llvm::LoopAnalysisManager lam;
@@ -36,33 +60,201 @@ static void optimize_module(llvm::Module& mod) {
     // ----------------------------------------------------------
 
 
-    llvm::ModulePassManager mpm =
-        pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+    llvm::ModulePassManager mpm = optimize
+        ? pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2)
+        : pb.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
 
     mpm.run(mod, mam);
 }
 
+// ------------------------------------------------------------
+// LLJIT that can see symbols from --link libraries, --link-archive
+// object members and then the current process (libc etc.), in that order
+// every object is announced to gdb (__jit_debug_register_code) and,
+// if LLVM was built with LLVM_USE_PERF, written to jit-<pid>.dump for perf inject
+// the archives were opened by the caller and have to outlive the JIT
+// ------------------------------------------------------------
+using Archives = std::vector<std::unique_ptr<NativeArchive>>;
+
+static llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> make_jit(const RunOptions& opt, const Archives& archives) {
+    auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb)
+        return jtmb.takeError();
+    //RuntimeDyld cant allocate native TLS, thread_local globals go through __emutls_get_address
+    jtmb->getOptions().EmulatedTLS = true;
+
+    auto jitExp = llvm::orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(std::move(*jtmb))
+        .setObjectLinkingLayerCreator([](llvm::orc::ExecutionSession& es, auto&&...)
+                -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+            auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(es,
+                [](auto&&...) { return std::make_unique<llvm::SectionMemoryManager>(); });
+
+            layer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
+            if (auto* perf = llvm::JITEventListener::createPerfJITEventListener())
+                layer->registerJITEventListener(*perf);
+            return layer;
+        })
+        .create();
+    if (!jitExp)
+        return jitExp.takeError();
+
+    auto& jit = *jitExp;
+    auto& dylib = jit->getMainJITDylib();
+    char prefix = jit->getDataLayout().getGlobalPrefix();
+
+    for (auto& path : opt.link_shared) {
+        auto gen = llvm::orc::DynamicLibrarySearchGenerator::Load(path.c_str(), prefix);
+        if (!gen)
+            return gen.takeError();
+        dylib.addGenerator(std::move(*gen));
+    }
+
+    //bitcode members are linked in as IR, the generator only loads object members
+    for (auto& ar : archives) {
+        if (!ar->has_objects)
+            continue;
+
+        auto gen = llvm::orc::StaticLibraryDefinitionGenerator::Create(jit->getObjLinkingLayer(),
+            llvm::MemoryBuffer::getMemBuffer(ar->buffer->getMemBufferRef(), false));
+        if (!gen)
+            return gen.takeError();
+        dylib.addGenerator(std::move(*gen));
+    }
+
+        dylib.addGenerator(
+            cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                prefix))
+        );
+    return jitExp;
+}
+
+static void init_native_target() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+}
+
+//returns true on failure (like verifyModule)
+static bool verify_failed(llvm::Module& mod, std::ostream& err = std::cerr) {
+    std::string verifyErrs;
+    llvm::raw_string_ostream os(verifyErrs);
+    if (llvm::verifyModule(mod, &os)) {
+        err << "[verify] Module verification failed:\n"
+            << os.str() << "\n";
+        err << "[IR dump for debugging]\n";
+        llvm::raw_os_ostream ir(err);
+        mod.print(ir, nullptr);
+        return true;
+    }
+    return false;
+}
+
+//heap to stack runs with the optimizer, --report-promotions says what it moved
+static void promote_allocations(CompileContext& ctx, const RunOptions& opt, std::ostream& out) {
+    if (!opt.optimize_ir)
+        return;
+    for (const Promotion& p : ctx.promote_allocations()) {
+        if (!opt.report_promotions)
+            continue;
+        out << "[promote] " << p.function << ": " << p.allocator << " of " << p.bytes << " bytes";
+        if (p.line)
+            out << " (line " << p.line << ")";
+        out << " moved to the stack\n";
+    }
+}
+
+// ------------------------------------------------------------
+// comptime: the throwaway context the compiler builds runs in a JIT of its own
+// spawns in there run inline, the worker pool only exists around main()
+// ------------------------------------------------------------
+static auto comptime_runner(const RunOptions& opt, const Archives& archives) {
+    return [&opt, &archives](CompileContext& tmp, const std::string& entry, void* out) -> std::expected<void, std::string> {
+        std::string why;
+        llvm::raw_string_ostream os(why);
+        if (llvm::verifyModule(*tmp.mod, &os))
+            return std::unexpected(os.str());
+        optimize_module(*tmp.mod, opt.optimize_ir);
+
+        auto jit = make_jit(opt, archives);
+        if (!jit)
+            return std::unexpected(toString(jit.takeError()));
+
+        llvm::orc::ThreadSafeModule tsm(std::move(tmp.mod), std::move(tmp.owned_ctx));
+        if (auto err = (*jit)->addIRModule(std::move(tsm)))
+            return std::unexpected(toString(std::move(err)));
+
+        auto sym = (*jit)->lookup(entry);
+        if (!sym)
+            return std::unexpected(toString(sym.takeError()));
+
+        using EntryFn = void (*)(void*);
+        sym->toPtr<EntryFn>()(out);
+        return {};
+    };
+}
+
+// ------------------------------------------------------------
+// --profile-counts table, hottest first
+// ------------------------------------------------------------
+static void print_profile(llvm::orc::LLJIT& jit, const std::vector<CompileContext*>& units) {
+    struct Row {
+        int64_t count;
+        std::string where;
+        const std::string* what;
+    };
+    std::vector<Row> rows;
+
+    for (CompileContext* ctx : units) {
+        Profile* p = ctx->profile.get();
+        if (!p)
+            continue;
+
+        auto sym = jit.lookup(p->symbol);
+        if (!sym) {
+            llvm::errs() << "[profile] " << toString(sym.takeError()) << "\n";
+            continue;
+        }
+
+        using Counts = const int64_t*;
+        Counts counts = sym->toPtr<Counts>();
+        std::string file = std::filesystem::path(p->path).filename().string();
+
+        for (size_t i = 0; i < p->sites.size(); ++i) {
+            unsigned line = 0, col = 0;
+            p->lines.position(p->sites[i].at, line, col);
+            rows.push_back({counts[i], std::format("{}:{}:{}", file, line, col), &p->sites[i].what});
+        }
+    }
+
+    std::stable_sort(rows.begin(), rows.end(),
+        [](const Row& a, const Row& b) { return a.count > b.count; });
+
+    std::cout << "[profile]\n";
+    for (auto& r : rows)
+        std::cout << std::format("{:>14}  {:<28} {}\n", r.count, r.where, *r.what);
+}
+
 // ------------------------------------------------------------
 // Run the JIT and call main()
+// every context is its own module (and LLVMContext), they link by name
 // ------------------------------------------------------------
-static int run_jit(CompileContext& ctx, const RunOptions& opt,int64_t& ret) {
-    auto jitExp = llvm::orc::LLJITBuilder().create();
+static int run_jit(std::vector<CompileContext*>& units, const RunOptions& opt,
+                   const Archives& archives, int64_t& ret) {
+    auto jitExp = make_jit(opt, archives);
 
     if (!jitExp) {
         llvm::errs() << toString(jitExp.takeError()) << "\n";
         return 1;
     }
     auto jit = std::move(*jitExp);
-    auto& dylib = jit->getMainJITDylib();
-        dylib.addGenerator(
-            cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
-                jit->getDataLayout().getGlobalPrefix()))
-        );
 
-    llvm::orc::ThreadSafeModule tsm(std::move(ctx.mod), std::move(ctx.ctx));
-    if (auto err = jit->addIRModule(std::move(tsm))) {
-        llvm::errs() << toString(std::move(err)) << "\n";
-        return 1;
+    for (CompileContext* ctx : units) {
+        llvm::orc::ThreadSafeModule tsm(std::move(ctx->mod), std::move(ctx->owned_ctx));
+        if (auto err = jit->addIRModule(std::move(tsm))) {
+            llvm::errs() << toString(std::move(err)) << "\n";
+            return 1;
+        }
     }
 
     std::cout << "[JIT] module added\n";
@@ -80,28 +272,76 @@ static int run_jit(CompileContext& ctx, const RunOptions& opt,int64_t& ret) {
     MainFn mainFn = sym->toPtr<MainFn>();
 
     std::cout << "[Run]\n";
+    start_workers(opt.workers);
     ret = mainFn();
+    stop_workers();
     std::cout << "main() returned " << ret << "\n";
+
+    if (opt.profile_counts)
+        print_profile(*jit, units);
     return 0;
 }
 
 // ------------------------------------------------------------
-// Compile + verify + (optionally) optimize + JIT
+// One source file of a program
 // ------------------------------------------------------------
-int compile_source(std::string_view src, const RunOptions& opt,int64_t& ret) {
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
+struct Unit {
+    std::string path;//canonical, empty for an in memory source
+    std::string owned;//file contents (the main source is borrowed)
+    std::string_view src;
+    std::vector<Global> globals;
+    std::vector<size_t> imports;//indices into the unit list
+
+    std::unique_ptr<CompileContext> ctx;
+    std::ostringstream out;//buffered so parallel units dont interleave
+    std::ostringstream err;
+
+    //only kept when the interpreter may run the program
+    std::map<std::string, mir::Function, std::less<>> mir;
+    std::unique_ptr<interp::Program> program;//set if main() runs in it
+};
+
+//past this many instructions Auto leaves the program to the JIT, it pays for itself
+static constexpr size_t AUTO_INTERP_LIMIT = 1000;
+
+//the interpreter runs one module as it is, nothing linked or instrumented
+static bool may_interpret(const std::vector<std::unique_ptr<Unit>>& units, const RunOptions& opt) {
+    if (opt.engine == Engine::Jit || !opt.mid_ir || !opt.run_main)
+        return false;
+    return units.size() == 1 && opt.link_smallc.empty() && opt.link_shared.empty()
+        && opt.link_archives.empty() && opt.emit_smallc.empty()
+        && !opt.print_ir_post && !opt.debug_info && !opt.profile_counts;
+}
 
-    ParseStream stream(src);
-    CompileContext ctx("jit_test");
+//runs job(i) for every i < count on a pool of up to hardware_concurrency threads
+template <typename F>
+static void parallel_for(size_t count, F&& job) {
+    size_t workers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::vector<std::jthread> pool;
+    for (size_t w = 0; w < workers; ++w)
+        pool.emplace_back([&] {
+            for (size_t i = next++; i < count; i = next++)
+                job(i);
+        });
+}
 
-    while (true) {
-        stream.skip_comments();
-        if (stream.empty()) break;
+//parse u and queue up anything it imports, 0 on success
+static int parse_unit(std::vector<std::unique_ptr<Unit>>& units, size_t idx, const RunOptions& opt) {
+    Unit& u = *units[idx];
+    ParseStream stream(u.src);
 
+    while (!stream.empty()) {
         Global g;
         if (auto err = parse_global(stream, g)) {
+            if (!u.path.empty())
+                std::cerr << "[in " << u.path << "]\n";
             std::cerr << "[parser error] " << err.what(stream.full) << "\n";
             return 1;
         }
@@ -111,47 +351,548 @@ int compile_source(std::string_view src, const RunOptions& opt,int64_t& ret) {
             print_global(g);
         }
 
+        if (auto* im = std::get_if<Import>(&g.inner)) {
+            std::filesystem::path base = u.path.empty()
+                ? std::filesystem::current_path()
+                : std::filesystem::path(u.path).parent_path();
+            std::string path = std::filesystem::weakly_canonical(base / im->path).string();
+
+            auto found = std::find_if(units.begin(), units.end(),
+                [&](auto& other) { return other->path == path; });
+            if (found != units.end()) {
+                u.imports.push_back(found - units.begin());
+            } else {
+                auto dep = std::make_unique<Unit>();
+                dep->path = path;
+
+                std::ifstream file(path);
+                if (!file) {
+                    std::cerr << "[import error] failed to open " << path << "\n"
+                              << "imported by: " << im->text << "\n";
+                    return 1;
+                }
+                dep->owned.assign(std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>());
+                dep->src = dep->owned;
+
+                u.imports.push_back(units.size());
+                units.push_back(std::move(dep));
+            }
+        }
+
+        u.globals.push_back(std::move(g));
+    }
+    return 0;
+}
+
+//everything from the command line that gets linked into the main unit
+struct LinkInputs {
+    std::vector<std::unique_ptr<Precompiled>> smallc;
+    Archives archives;
+    std::vector<std::string_view> externs;//every body-less declaration in the program
+};
+
+//lower, verify and optimize one unit, only touches u (and reads its imports' ASTs)
+static int compile_unit(Unit& u, const std::vector<std::unique_ptr<Unit>>& units,
+                        const LinkInputs& links, size_t idx, const RunOptions& opt) {
+    bool is_main = idx == 0;
+    u.ctx = std::make_unique<CompileContext>(u.path.empty() ? "jit_test" : u.path);
+    CompileContext& ctx = *u.ctx;
+    ctx.ctx->setDiscardValueNames(opt.release);
+    ctx.run_comptime = comptime_runner(opt, links.archives);
+    ctx.mid_ir = opt.mid_ir;
+    ctx.strict_aliasing = opt.strict_aliasing;
+    ctx.internal_globals = true;
+    ctx.allow_redefinition = false;
+    if (opt.print_mir)
+        ctx.mir_log = &u.out;
+    if (may_interpret(units, opt))
+        ctx.keep_mir = [&u](std::string_view name, mir::Function&& f) {
+            u.mir.insert_or_assign(std::string(name), std::move(f));
+        };
+    if (opt.debug_info)
+        ctx.enable_debug_info(u.src, u.path.empty() ? "jit_test" : u.path, opt.optimize_ir);
+    if (opt.profile_counts)
+        ctx.enable_profile(u.src, u.path.empty() ? "jit_test" : u.path,
+                           std::format("__small_profile_{}", idx));
+
+    for (auto& lib : links.smallc)
+        lib->declare(ctx);
+
+    //cross file calls and exported variables are plain declarations, the JIT resolves them by name
+    for (size_t idx : u.imports)
+        for (auto& g : units[idx]->globals) {
+            if (auto* var = std::get_if<GlobalVar>(&g.inner); var && var->is_exported) {
+                if (result_t res = ctx.declare_variable(*var); !res) {
+                    u.err << "[compile error]\n" << res.error();
+                    return 1;
+                }
+                continue;
+            }
+
+            const FuncDec* dec = std::get_if<FuncDec>(&g.inner);
+            if (auto* f = std::get_if<Function>(&g.inner))
+                dec = f;
+            if (!dec)
+                continue;
+
+            //generics have no symbol to declare, we instantiate our own copies
+            if (!dec->type_params.empty()) {
+                ctx.compile(g);
+                continue;
+            }
+
+            Global decl;
+            decl.inner = *dec;
+            if (result_t res = ctx.compile(decl); !res) {
+                u.err << "[compile error]\n" << res.error();
+                return 1;
+            }
+        }
+
+    for (auto& g : u.globals) {
         result_t res = ctx.compile(g);
         if (!res) {
-            std::cerr << "[compile error]\n" << res.error();
+            if (!u.path.empty())
+                u.err << "[in " << u.path << "]\n";
+            u.err << "[compile error]\n" << res.error();
             return 1;
         }
     }
+    ctx.finish_debug_info();
+    ctx.finish_profile();
+    promote_allocations(ctx, opt, u.out);
+
+    llvm::raw_os_ostream ir(u.out);
 
     // --- Pre-optimization IR ---
     if (opt.print_ir_pre) {
-        std::cout << "\n[IR before optimization]\n";
-        ctx.mod->print(llvm::outs(), nullptr);
-        std::cout << "\n";
+        u.out << "\n[IR before optimization]\n";
+        ctx.mod->print(ir, nullptr);
+        ir.flush();
+        u.out << "\n";
     }
 
     // --- Verify IR ---
-    if (opt.verify_ir) {
-        std::string verifyErrs;
-        llvm::raw_string_ostream os(verifyErrs);
-        if (llvm::verifyModule(*ctx.mod, &os)) {
-            std::cerr << "[verify] Module verification failed:\n"
-                      << os.str() << "\n";
-            std::cerr << "[IR dump for debugging]\n";
-            ctx.mod->print(llvm::errs(), nullptr);
-            return 1;
+    if (opt.verify_ir && verify_failed(*ctx.mod, u.err))
+        return 1;
+
+    // --- Bytecode, instead of optimizing and JITing ---
+    if (ctx.keep_mir) {
+        std::string why;
+        u.program = interp::compile(u.mir, *ctx.mod, why);
+        if (u.program && opt.engine == Engine::Auto && u.program->code.size() > AUTO_INTERP_LIMIT) {
+            u.program.reset();
+        } else if (u.program) {
+            u.out << std::format("[interp] {} instructions\n", u.program->code.size());
+            return 0;
+        } else if (opt.engine == Engine::Interp) {
+            u.out << "[interp] " << why << ", using the JIT\n";
         }
     }
 
+    // --- Precompiled modules (after verify, they were checked when emitted) ---
+    if (is_main)
+        for (auto& lib : links.smallc)
+            if (lib->link_into(ctx))
+                return 1;
+
+    // --- Bitcode archives, before optimizing so their code can be inlined ---
+    if (is_main)
+        for (auto& ar : links.archives)
+            if (ar->link_into(ctx, links.externs))
+                return 1;
+
     // --- Optimization ---
-    if (opt.optimize_ir) {
-        optimize_module(*ctx.mod);
-        std::cout << "[optimize] done\n";
-    }
+    optimize_module(*ctx.mod, opt.optimize_ir);
+    if (opt.optimize_ir)
+        u.out << "[optimize] done\n";
 
     // --- Post-optimization IR ---
     if (opt.print_ir_post) {
-        std::cout << "\n[IR after optimization]\n";
-        ctx.mod->print(llvm::outs(), nullptr);
-        std::cout << "\n";
+        u.out << "\n[IR after optimization]\n";
+        ctx.mod->print(ir, nullptr);
+        ir.flush();
+        u.out << "\n";
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// Compile + verify + (optionally) optimize + JIT
+// imported files are separate units compiled in parallel
+// ------------------------------------------------------------
+int compile_source(std::string_view src, const RunOptions& opt,int64_t& ret) {
+    init_native_target();
+
+    //declared first so the names they own outlive the contexts
+    LinkInputs links;
+    for (auto& path : opt.link_smallc) {
+        auto lib = Precompiled::open(path);
+        if (!lib) return 1;
+        links.smallc.push_back(std::move(lib));
+    }
+    for (auto& path : opt.link_archives) {
+        auto ar = NativeArchive::open(path);
+        if (!ar) return 1;
+        links.archives.push_back(std::move(ar));
+    }
+
+    std::vector<std::unique_ptr<Unit>> units;
+    auto& main_unit = units.emplace_back(std::make_unique<Unit>());
+    main_unit->src = src;
+    if (!opt.source_path.empty())
+        main_unit->path = std::filesystem::weakly_canonical(opt.source_path).string();
+
+    //breadth first, units only ever gets appended to
+    for (size_t i = 0; i < units.size(); ++i)
+        if (parse_unit(units, i, opt))
+            return 1;
+
+    for (auto& u : units)
+        for (auto& g : u->globals)
+            if (auto* dec = std::get_if<FuncDec>(&g.inner))
+                links.externs.push_back(dec->name.text);
+
+    if (!opt.emit_smallc.empty() && units.size() > 1) {
+        std::cerr << "[smallc] can't emit a program with imports, emit each file on its own\n";
+        return 1;
+    }
+
+    std::vector<int> failed(units.size(), 0);
+    parallel_for(units.size(), [&](size_t i) {
+        failed[i] = compile_unit(*units[i], units, links, i, opt);
+    });
+
+    int status = 0;
+    for (size_t i = 0; i < units.size(); ++i) {
+        std::cout << units[i]->out.str();
+        std::cerr << units[i]->err.str();
+        status |= failed[i];
     }
+    if (status)
+        return 1;
+
+    if (!opt.emit_smallc.empty()) {
+        if (write_smallc(*main_unit->ctx, opt.emit_smallc))
+            return 1;
+        std::cout << "[smallc] wrote " << opt.emit_smallc << "\n";
+        return 0;
+    }
+
+    if (interp::Program* p = units[0]->program.get()) {
+        int32_t entry = p->find("main");
+        if (entry < 0 || p->funcs[entry].args) {
+            std::cerr << "[interp] no main() to run\n";
+            return 1;
+        }
+        std::cout << "[Run]\n";
+        ret = interp::run(*p, entry);
+        std::cout << "main() returned " << ret << "\n";
+        return 0;
+    }
+
+    std::vector<CompileContext*> ctxs;
+    for (auto& u : units)
+        ctxs.push_back(u->ctx.get());
+    return run_jit(ctxs, opt, links.archives, ret);
+}
+
+// ------------------------------------------------------------
+// Incremental session
+// ------------------------------------------------------------
+struct ReplSession::Impl {
+    struct Entry {
+        Global global;
+        std::string_view name;
+        llvm::orc::ResourceTrackerSP rt;
+        std::vector<std::string> deps;//globals this module calls into
+    };
+
+    RunOptions opt;
+    Archives archives;//the JIT reads their object members in place
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    llvm::orc::ThreadSafeContext tsc;//owns ctx.ctx so must outlive ctx
+    CompileContext ctx{"repl"};
+
+    std::vector<std::unique_ptr<std::string>> sources;//all names and AST text point in here
+    std::vector<std::unique_ptr<Entry>> entries;//in definition order
+    size_t module_count = 0;
+
+    Impl(const RunOptions& o, Archives a, std::unique_ptr<llvm::orc::LLJIT> j)
+        : opt(o), archives(std::move(a)), jit(std::move(j)) {
+        ctx.ctx->setDiscardValueNames(opt.release);
+        ctx.run_comptime = comptime_runner(opt, archives);
+        ctx.mid_ir = opt.mid_ir;
+        ctx.strict_aliasing = opt.strict_aliasing;
+        if (opt.print_mir)
+            ctx.mir_log = &std::cout;
+        tsc = llvm::orc::ThreadSafeContext(std::move(ctx.owned_ctx));
+    }
+
+    static std::string_view name_of(const Global& g) {
+        if (auto* f = std::get_if<Function>(&g.inner)) return f->name.text;
+        if (auto* d = std::get_if<FuncDec>(&g.inner)) return d->name.text;
+        if (auto* v = std::get_if<GlobalVar>(&g.inner)) return v->name.text;
+        return {};
+    }
+
+    //there is no main module to link bitcode members into, so each archive's
+    //bitcode goes in whole as a module of its own, false on failure
+    bool add_bitcode_archives() {
+        for (auto& ar : archives) {
+            if (!ar->has_bitcode)
+                continue;
+            std::unique_ptr<llvm::Module> mod = ar->link_members(*ctx.ctx, *ctx.mod);
+            if (!mod)
+                return false;
+            optimize_module(*mod, opt.optimize_ir);
+            if (auto err = jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(mod), tsc))) {
+                llvm::errs() << "[JIT error] " << toString(std::move(err)) << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //compile g into a fresh ctx.mod, on failure the symbol table is left as it was
+    bool compile_module(const Global& g, std::string_view name) {
+        ctx.reset_module(std::format("repl_{}", module_count++));
+
+        std::optional<Value> prev;
+        if (auto it = ctx.global_consts.find(name); it != ctx.global_consts.end())
+            prev = *it->second;
+
+        result_t res = ctx.compile(g);
+        if (!res) {
+            std::cerr << "[compile error]\n" << res.error();
+            ctx.current_func = nullptr;
+            if (prev)
+                *ctx.global_consts[name] = *prev;
+            else
+                ctx.global_consts.erase(name);
+            return false;
+        }
+
+        //redeclarations nobody used are just noise
+        for (llvm::Function& f : llvm::make_early_inc_range(*ctx.mod))
+            if (f.isDeclaration() && f.use_empty())
+                f.eraseFromParent();
+        for (llvm::GlobalVariable& v : llvm::make_early_inc_range(ctx.mod->globals()))
+            if (v.isDeclaration() && v.use_empty())
+                v.eraseFromParent();
+
+        promote_allocations(ctx, opt, std::cout);
+
+        if (opt.print_ir_pre) {
+            std::cout << "\n[IR before optimization]\n";
+            ctx.mod->print(llvm::outs(), nullptr);
+        }
+
+        if (opt.verify_ir && verify_failed(*ctx.mod))
+            return false;
+
+        optimize_module(*ctx.mod, opt.optimize_ir);
+
+        if (opt.print_ir_post) {
+            std::cout << "\n[IR after optimization]\n";
+            ctx.mod->print(llvm::outs(), nullptr);
+        }
+        return true;
+    }
+
+    //hand ctx.mod to the jit under its own tracker
+    bool add_module(llvm::orc::ResourceTrackerSP& rt) {
+        rt = jit->getMainJITDylib().createResourceTracker();
+        llvm::orc::ThreadSafeModule tsm(std::move(ctx.mod), tsc);
+        if (auto err = jit->addIRModule(rt, std::move(tsm))) {
+            llvm::errs() << "[JIT error] " << toString(std::move(err)) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void remove(Entry& e) {
+        if (!e.rt)
+            return;
+        if (auto err = e.rt->remove())
+            llvm::errs() << "[JIT error] " << toString(std::move(err)) << "\n";
+        e.rt = nullptr;
+    }
+
+    bool commit(Entry& e) {
+        if (!compile_module(e.global, e.name))
+            return false;
+
+        e.deps.clear();
+        for (llvm::GlobalValue& v : ctx.mod->global_values())
+            if (v.isDeclaration())
+                e.deps.emplace_back(v.getName());
+
+        return add_module(e.rt);
+    }
+
+    //wraps a top level expression in a throwaway function and runs it
+    int eval_expression(Basic& b) {
+        std::string_view name = *sources.emplace_back(
+            std::make_unique<std::string>(std::format("__repl_expr_{}", module_count)));
 
-    return run_jit(ctx, opt,ret);
+        Global g;
+        Function& f = g.inner.emplace<Function>();
+        f.is_c = true;
+        f.name = Var(name);
+        f.text = b.text;
+
+        Return& r = f.body.parts.emplace_back().inner.emplace<Return>();
+        r.val = std::move(b.inner);
+        r.text = b.text;
+
+        if (!compile_module(g, name))
+            return 1;
+        ctx.global_consts.erase(name);
+        ctx.history.pop_back();//g is gone after this
+
+        llvm::orc::ResourceTrackerSP rt;
+        if (!add_module(rt))
+            return 1;
+
+        auto sym = jit->lookup(name);
+        if (!sym) {
+            llvm::errs() << "[JIT error] " << toString(sym.takeError()) << "\n";
+            return 1;
+        }
+
+        using ExprFn = int64_t (*)();
+        std::cout << "=> " << sym->toPtr<ExprFn>()() << "\n";
+
+        if (auto err = rt->remove())
+            llvm::errs() << "[JIT error] " << toString(std::move(err)) << "\n";
+        return 0;
+    }
+
+    int eval(Global g) {
+        if (auto* b = std::get_if<Basic>(&g.inner))
+            return eval_expression(*b);
+
+        auto entry = std::make_unique<Entry>();
+        entry->name = name_of(g);
+        entry->global = std::move(g);
+
+        auto old = std::find_if(entries.begin(), entries.end(),
+            [&](auto& e) { return e->name == entry->name; });
+
+        if (old == entries.end()) {
+            if (!commit(*entry))
+                return 1;
+            entries.push_back(std::move(entry));
+            return 0;
+        }
+
+        //redefinition: compile first so a typo doesnt cost us the old version
+        //comptimes fold again, the new definition may change their results
+        ctx.folded->clear();
+        if (!compile_module(entry->global, entry->name))
+            return 1;
+        std::unique_ptr<llvm::Module> mod = std::move(ctx.mod);
+
+        //anything that called into the old code has its address baked in
+        std::vector<std::string_view> dirty{entry->name};
+        auto is_dirty = [&](std::string_view n) {
+            return std::find(dirty.begin(), dirty.end(), n) != dirty.end();
+        };
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto& e : entries) {
+                if (is_dirty(e->name))
+                    continue;
+                for (auto& d : e->deps)
+                    if (is_dirty(d)) {
+                        dirty.push_back(e->name);
+                        changed = true;
+                        break;
+                    }
+            }
+        }
+
+        for (auto& e : entries)
+            if (is_dirty(e->name))
+                remove(*e);
+
+        ctx.mod = std::move(mod);
+        entry->deps.clear();
+        for (llvm::GlobalValue& v : ctx.mod->global_values())
+            if (v.isDeclaration())
+                entry->deps.emplace_back(v.getName());
+        if (!add_module(entry->rt))
+            return 1;
+        *old = std::move(entry);
+
+        int failed = 0;
+        for (auto it = entries.begin(); it != entries.end();) {
+            Entry& e = **it;
+            if (e.rt || !is_dirty(e.name)) {
+                ++it;
+                continue;
+            }
+
+            if (commit(e)) {
+                ++it;
+                continue;
+            }
+
+            std::cerr << "[repl] dropped " << e.name << "\n";
+            ctx.global_consts.erase(e.name);
+            it = entries.erase(it);
+            failed = 1;
+        }
+        return failed;
+    }
+};
+
+std::unique_ptr<ReplSession> ReplSession::create(const RunOptions& opt) {
+    init_native_target();
+
+    Archives archives;
+    for (auto& path : opt.link_archives) {
+        auto ar = NativeArchive::open(path);
+        if (!ar) return nullptr;
+        archives.push_back(std::move(ar));
+    }
+
+    auto jitExp = make_jit(opt, archives);
+    if (!jitExp) {
+        llvm::errs() << toString(jitExp.takeError()) << "\n";
+        return nullptr;
+    }
+
+    auto impl = std::make_unique<Impl>(opt, std::move(archives), std::move(*jitExp));
+    if (!impl->add_bitcode_archives())
+        return nullptr;
+    return std::unique_ptr<ReplSession>(new ReplSession(std::move(impl)));
+}
+
+ReplSession::ReplSession(std::unique_ptr<Impl> i) : impl(std::move(i)) {}
+ReplSession::~ReplSession() = default;
+
+int ReplSession::eval(std::string src) {
+    std::string_view text = *impl->sources.emplace_back(
+        std::make_unique<std::string>(std::move(src)));
+
+    ParseStream stream(text);
+    while (!stream.empty()) {
+        Global g;
+        if (auto err = parse_global(stream, g, true)) {
+            std::cerr << "[parser error] " << err.what(stream.full) << "\n";
+            return 1;
+        }
+
+        if (impl->opt.print_globals)
+            print_global(g);
+
+        if (int r = impl->eval(std::move(g)))
+            return r;
+    }
+    return 0;
 }
 
 }//small_lang
\ No newline at end of file
@@ -1,12 +1,19 @@
 #pragma once
 
 #include<string_view>
+#include<string>
+#include<memory>
+#include<vector>
 
 namespace small_lang {
 
 // ------------------------------------------------------------
 // Run options
 // ------------------------------------------------------------
+
+//what runs main(), Auto interprets small single file programs and JITs the rest
+enum class Engine : unsigned char { Auto, Jit, Interp };
+
 struct RunOptions {
     bool print_globals = false;
     bool print_ir_pre  = false;   // print IR before optimization
@@ -14,8 +21,44 @@ struct RunOptions {
     bool verify_ir     = true;
     bool optimize_ir   = true;
     bool run_main      = true;
+    bool debug_info    = false;   // DWARF line tables for gdb/perf (not in the REPL)
+    bool release       = false;   // drop IR value names, cheaper but unreadable IR
+    bool profile_counts = false;  // count calls and If branches, print them after main()
+    bool report_promotions = false;// list the heap allocations moved to the stack
+    bool mid_ir        = true;    // integer-only functions are lowered through the mid IR
+    bool strict_aliasing = true;  // tbaa on pointer loads and stores, off for programs that pun types
+    bool print_mir     = false;   // print the mid IR of those functions after its passes
+    Engine engine      = Engine::Auto;// --interp/--jit, the interpreter only takes mid IR programs
+    unsigned workers   = 0;       // threads running spawned calls, 0 is one per core
+
+    std::string source_path;               // where the source came from, imports are relative to it
+    std::string emit_smallc;               // write a precompiled module here instead of running
+    std::vector<std::string> link_smallc;  // precompiled modules the source can call into
+    std::vector<std::string> link_shared;  // --link, shared libraries searched before the process
+    std::vector<std::string> link_archives;// --link-archive, static archives (objects or bitcode)
 };
 
 int compile_source(std::string_view src, const RunOptions& opt,int64_t& ret);
 
+// ------------------------------------------------------------
+// Incremental session (used by the REPL)
+// keeps one symbol table and one LLJIT alive, every global gets its own module
+// redefining a function drops the old code and recompiles whatever called it
+// top level expressions are evaluated right away
+// ------------------------------------------------------------
+struct ReplSession {
+    struct Impl;
+
+    //returns null (after printing why) if the JIT cant be created
+    static std::unique_ptr<ReplSession> create(const RunOptions& opt);
+    ~ReplSession();
+
+    //parse and commit every global in src, 0 on success
+    int eval(std::string src);
+
+private:
+    ReplSession(std::unique_ptr<Impl> impl);
+    std::unique_ptr<Impl> impl;
+};
+
 }
\ No newline at end of file
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <iterator>
+#include "ast.hpp"
+
+namespace small_lang {
+
+static constexpr std::string_view keywords[] = {
+    "if", "else", "for", "while", "return",
+    "fn", "cfn", "import",
+    //not used but like comeon
+    "break", "continue", "true", "false",
+    "let","as","is", "const", "struct",
+    "region", "spawn", "sync", "thread_local",
+    "yield", "async", "await", "comptime", "match",
+    "cold", "restrict", "export", "then",
+};
+
+//same order as keywords, the interner hands these out as the first ids
+enum class Kw : uint32_t {
+    If, Else, For, While, Return,
+    Fn, Cfn, Import,
+    Break, Continue, True, False,
+    Let, As, Is, Const, Struct,
+    Region, Spawn, Sync, ThreadLocal,
+    Yield, Async, Await, Comptime, Match,
+    Cold, Restrict, Export, Then,
+};
+
+static constexpr uint32_t KEYWORD_COUNT = std::size(keywords);
+static_assert(static_cast<uint32_t>(Kw::Then) + 1 == KEYWORD_COUNT);
+
+enum class Tok : uint8_t {
+    Eof,
+    Name, Keyword, Num, Op,
+    Type,   // @name** (one token so the stars cant be mistaken for deref)
+    String, // "..." on a single line
+    LParen, RParen, LBrace, RBrace, LBracket, RBracket, Comma, Semi,
+    Ellipsis,// ... (C varargs)
+    Unknown,// any other single byte
+};
+
+// ------------------------------------------------------------
+// Token buffer: structure of arrays, one entry per token
+// the last token is always Eof (placed at the end of the source)
+// ------------------------------------------------------------
+struct TokenBuffer {
+    std::vector<Tok> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> ids;    // interned name (keywords first), Operator for Op
+    std::vector<uint64_t> values; // Num only
+
+    std::vector<std::string_view> names;//id -> spelling
+
+    void push(Tok k, size_t off, size_t len, uint32_t id = 0, uint64_t value = 0) {
+        kinds.push_back(k);
+        offsets.push_back(off);
+        lengths.push_back(len);
+        ids.push_back(id);
+        values.push_back(value);
+    }
+
+    size_t size() const { return kinds.size(); }
+};
+
+//open addressing on the FNV hash computed while the name was scanned
+struct Interner {
+    std::vector<std::string_view>& names;
+    std::vector<uint64_t> hashes;//parallel to names
+    std::vector<uint32_t> slots; //id+1, 0 is empty
+
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    static constexpr uint64_t hash(std::string_view s) {
+        uint64_t h = FNV_OFFSET;
+        for (char c : s)
+            h = (h ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+        return h;
+    }
+
+    Interner(std::vector<std::string_view>& n) : names(n), slots(64, 0) {
+        for (auto kw : keywords)
+            intern(kw, hash(kw));
+    }
+
+    uint32_t intern(std::string_view s, uint64_t h) {
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            uint32_t slot = slots[i];
+            if (!slot) {
+                uint32_t id = names.size();
+                names.push_back(s);
+                hashes.push_back(h);
+                slots[i] = id + 1;
+                if (names.size() * 2 > slots.size())
+                    grow();
+                return id;
+            }
+            if (hashes[slot - 1] == h && names[slot - 1] == s)
+                return slot - 1;
+        }
+    }
+
+    void grow() {
+        std::vector<uint32_t> bigger(slots.size() * 2, 0);
+        size_t mask = bigger.size() - 1;
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            size_t i = hashes[id] & mask;
+            while (bigger[i])
+                i = (i + 1) & mask;
+            bigger[i] = id + 1;
+        }
+        slots = std::move(bigger);
+    }
+};
+
+//longest match first, 0 if there is no operator at p
+inline size_t lex_operator(const char* p, size_t avail, Op& out) {
+    if (avail >= 2) {
+        Operator k = Operator::Invalid;
+        switch (p[0]) {
+            case '+': if (p[1] == '+') k = Operator::PlusPlus; break;
+            case '-': {
+                if (p[1] == '-') k = Operator::MinusMinus;
+                else if (p[1] == '>') k = Operator::Arrow;
+                break;
+            }
+            case '&': if (p[1] == '&') k = Operator::AndAnd; break;
+            case '|': if (p[1] == '|') k = Operator::OrOr; break;
+            case '=': if (p[1] == '=') k = Operator::EqEq; break;
+            case '!': if (p[1] == '=') k = Operator::NotEq; break;
+            case '<': if (p[1] == '=') k = Operator::Le; break;
+            case '>': if (p[1] == '=') k = Operator::Ge; break;
+        }
+        if (k != Operator::Invalid) {
+            out = Op(k);
+            return 2;
+        }
+    }
+
+    Operator k = Operator::Invalid;
+    switch (p[0]) {
+        case '+': k = Operator::Plus; break;
+        case '-': k = Operator::Minus; break;
+        case '*': k = Operator::Star; break;
+        case '/': k = Operator::Slash; break;
+        case '%': k = Operator::Percent; break;
+        case '.': k = Operator::Dot; break;
+        case '&': k = Operator::BitAnd; break;
+        case '|': k = Operator::BitOr; break;
+        case '^': k = Operator::BitXor; break;
+        case '!': k = Operator::Not; break;
+        case '=': k = Operator::Assign; break;
+        case '<': k = Operator::Lt; break;
+        case '>': k = Operator::Gt; break;
+    }
+    out = Op(k);
+    return k == Operator::Invalid ? 0 : 1;
+}
+
+//single pass over src, every byte is looked at once
+inline TokenBuffer tokenize(std::string_view src) {
+    TokenBuffer t;
+    Interner interner(t.names);
+
+    //rough guess, saves most of the regrowth on big inputs
+    size_t guess = src.size() / 4 + 1;
+    t.kinds.reserve(guess);
+    t.offsets.reserve(guess);
+    t.lengths.reserve(guess);
+    t.ids.reserve(guess);
+    t.values.reserve(guess);
+
+    const char* s = src.data();
+    size_t n = src.size();
+    size_t i = 0;
+
+    auto is_name_char = [](unsigned char c) {
+        return std::isalnum(c) || c == '_';
+    };
+
+    for (;;) {
+        //whitespace and # comments
+        while (i < n) {
+            unsigned char c = s[i];
+            if (std::isspace(c)) {
+                ++i;
+            } else if (c == '#') {
+                while (i < n && s[i] != '\n')
+                    ++i;
+            } else {
+                break;
+            }
+        }
+
+        if (i >= n) {
+            t.push(Tok::Eof, n, 0);
+            return t;
+        }
+
+        size_t start = i;
+        unsigned char c = s[i];
+
+        if (std::isalpha(c)) {
+            uint64_t h = Interner::FNV_OFFSET;
+            while (i < n && is_name_char(s[i])) {
+                h = (h ^ static_cast<unsigned char>(s[i])) * Interner::FNV_PRIME;
+                ++i;
+            }
+            uint32_t id = interner.intern({s + start, i - start}, h);
+            t.push(id < KEYWORD_COUNT ? Tok::Keyword : Tok::Name, start, i - start, id);
+            continue;
+        }
+
+        if (std::isdigit(c)) {
+            uint64_t value = 0;
+            bool overflow = false;
+            while (i < n && std::isdigit(static_cast<unsigned char>(s[i]))) {
+                overflow |= __builtin_mul_overflow(value, 10, &value);
+                overflow |= __builtin_add_overflow(value, s[i] - '0', &value);
+                ++i;
+            }
+            t.push(Tok::Num, start, i - start, 0, overflow ? 0 : value);
+            continue;
+        }
+
+        if (c == '@') {
+            ++i;
+            while (i < n && is_name_char(s[i]))
+                ++i;
+            while (i < n && s[i] == '*')
+                ++i;
+            t.push(Tok::Type, start, i - start);
+            continue;
+        }
+
+        if (c == '"') {
+            size_t j = i + 1;
+            while (j < n && s[j] != '"' && s[j] != '\n')
+                ++j;
+            if (j < n && s[j] == '"') {
+                i = j + 1;
+                t.push(Tok::String, start, i - start);
+            } else {
+                ++i;
+                t.push(Tok::Unknown, start, 1);
+            }
+            continue;
+        }
+
+        Tok punct = Tok::Unknown;
+        switch (c) {
+            case '(': punct = Tok::LParen; break;
+            case ')': punct = Tok::RParen; break;
+            case '{': punct = Tok::LBrace; break;
+            case '}': punct = Tok::RBrace; break;
+            case '[': punct = Tok::LBracket; break;
+            case ']': punct = Tok::RBracket; break;
+            case ',': punct = Tok::Comma; break;
+            case ';': punct = Tok::Semi; break;
+        }
+        if (punct != Tok::Unknown) {
+            ++i;
+            t.push(punct, start, 1);
+            continue;
+        }
+
+        if (c == '.' && i + 2 < n && s[i + 1] == '.' && s[i + 2] == '.') {
+            i += 3;
+            t.push(Tok::Ellipsis, start, 3);
+            continue;
+        }
+
+        Op op;
+        if (size_t len = lex_operator(s + i, n - i, op)) {
+            i += len;
+            t.push(Tok::Op, start, len, static_cast<uint32_t>(op.kind));
+            continue;
+        }
+
+        ++i;
+        t.push(Tok::Unknown, start, 1);
+    }
+}
+
+}//small_lang
@@ -0,0 +1,772 @@
+#include "mir.hpp"
+
+#include <llvm/IR/Instructions.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace small_lang::mir {
+
+static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+//ctx.int_type, what a literal is
+static constexpr uint8_t INT_BITS = 64;
+
+//the plain integer types, pointers, double, void and function values are not ours
+static std::optional<uint8_t> int_width(const Type& t) {
+	if (!t.t || !t.t->isIntegerTy() || t.stored || t.func)
+		return std::nullopt;
+	return t.t->getIntegerBitWidth();
+}
+
+static bool is_terminator(Op op) {
+	return op == Op::Br || op == Op::CondBr || op == Op::Ret;
+}
+
+//calls fn on every value operand of instruction i (block numbers are not values)
+template <typename Fn, typename F>
+static void each_operand(Fn& f, uint32_t i, F&& fn) {
+	switch (f.ops[i]) {
+	case Op::Nop: case Op::Const: case Op::Arg: case Op::Br:
+		return;
+	case Op::Copy: case Op::SExt: case Op::ZExt: case Op::Trunc: case Op::CondBr: case Op::Ret:
+		fn(f.as[i]);
+		return;
+	case Op::Call:
+		for (uint32_t k = 0; k < f.bs[i]; ++k)
+			fn(f.extra[f.as[i] + k]);
+		return;
+	case Op::Phi:
+		for (uint32_t k = 0; k < f.bs[i]; ++k)
+			fn(f.extra[f.as[i] + 2 * k + 1]);
+		return;
+	default:
+		fn(f.as[i]);
+		fn(f.bs[i]);
+		return;
+	}
+}
+
+// ------------------------------------------------------------
+// AST -> mir, the same conversions the visitors make on integer Values
+// ------------------------------------------------------------
+namespace {
+
+struct Builder {
+	CompileContext& ctx;
+	Function& f;
+	Scope<uint32_t> vars;
+
+	using value_t = std::optional<uint32_t>;
+
+	uint32_t emit(Op op, uint8_t width, uint32_t a = 0, uint32_t b = 0, int64_t imm = 0) {
+		f.ops.push_back(op);
+		f.widths.push_back(width);
+		f.as.push_back(a);
+		f.bs.push_back(b);
+		f.imms.push_back(imm);
+		f.names.emplace_back();
+		return f.size() - 1;
+	}
+
+	uint32_t constant(uint8_t width, int64_t v) { return emit(Op::Const, width, 0, 0, v); }
+	uint8_t width(uint32_t v) const { return f.widths[v]; }
+
+	void begin_block(const char* label) {
+		f.starts.push_back(f.size());
+		f.labels.push_back(label);
+	}
+	uint32_t block() const { return f.blocks() - 1; }
+	bool open() const { return f.starts.back() == f.size() || !is_terminator(f.ops.back()); }
+
+	uint32_t resize(uint32_t v, uint8_t to, bool is_signed) {
+		uint8_t from = width(v);
+		if (from == to)
+			return v;
+		return emit(to < from ? Op::Trunc : is_signed ? Op::SExt : Op::ZExt, to, v);
+	}
+
+	uint32_t to_bool(uint32_t v) { return emit(Op::Ne, 1, v, constant(width(v), 0)); }
+
+	//assign_convert: bools test != 0, everything else is an int cast (signed unless it was a bool)
+	value_t assign_convert(uint32_t v, const Type& target) {
+		auto to = int_width(target);
+		if (!to)
+			return std::nullopt;
+		if (*to == width(v))
+			return v;
+		if (*to == 1)
+			return to_bool(v);
+		return resize(v, *to, width(v) != 1);
+	}
+
+	// --- expressions, nullopt is "not ours" ---
+	value_t exp(const Expression& e) {
+		return std::visit([&](auto& x) { return exp(x); }, e.inner);
+	}
+
+	template <typename T>
+	value_t exp(const T&) { return std::nullopt; }
+
+	value_t exp(const Num& n) { return constant(INT_BITS, static_cast<int64_t>(n.value)); }
+
+	//globals and function values are left to the visitors
+	value_t exp(const Var& v) {
+		if (uint32_t* found = vars.find(v.text))
+			return *found;
+		return std::nullopt;
+	}
+
+	value_t exp(const TypeCast& c) {
+		Type* type = ctx.get_type(c.type);
+		if (!type || !c.exp)
+			return std::nullopt;
+		auto to = int_width(*type);
+		value_t v = exp(*c.exp);
+		if (!to || !v || !width(*v))
+			return std::nullopt;
+		return resize(*v, *to, width(*v) != 1);
+	}
+
+	value_t exp(const PreOp& p) {
+		value_t a = exp(*p.exp);
+		if (!a || !width(*a))
+			return std::nullopt;
+
+		switch (p.op.kind) {
+		case Operator::Plus:
+			return a;
+		case Operator::Minus:
+			return emit(Op::Sub, width(*a), constant(width(*a), 0), *a);
+		case Operator::Not:
+			return emit(Op::Eq, 1, *a, constant(width(*a), 0));
+		default:
+			return std::nullopt;//& needs a slot
+		}
+	}
+
+	//x = e makes a Copy named x, a new local if x is not one yet
+	value_t assign(const BinOp& op) {
+		auto* var = std::get_if<Var>(&op.a->inner);
+		if (!var)
+			return std::nullopt;//stores through pointers
+
+		uint32_t* slot = vars.find(var->text);
+		if (!slot)
+			if (auto it = ctx.global_consts.find(var->text);
+			    it != ctx.global_consts.end() && llvm::isa<llvm::GlobalVariable>(it->second->v))
+				return std::nullopt;
+
+		value_t v = exp(*op.b);
+		if (!v || !width(*v))
+			return std::nullopt;
+
+		//implicit_cast: same width, or widened with a zext
+		if (slot) {
+			if (width(*v) > width(*slot))
+				return std::nullopt;
+			v = resize(*v, width(*slot), false);
+		}
+
+		uint32_t copy = emit(Op::Copy, width(*v), *v);
+		f.names[copy] = var->text;
+		if (slot)
+			*slot = copy;
+		else
+			vars[var->text] = copy;
+		return copy;
+	}
+
+	value_t exp(const BinOp& op) {
+		if (op.op == Operator::Assign)
+			return assign(op);
+
+		value_t a = exp(*op.a);
+		if (!a)
+			return std::nullopt;
+		value_t b = exp(*op.b);
+		if (!b || !width(*a) || !width(*b))
+			return std::nullopt;
+
+		//promote_integer_pair
+		uint8_t w = std::max(width(*a), width(*b));
+		uint32_t x = resize(*a, w, width(*a) > 1);
+		uint32_t y = resize(*b, w, width(*b) > 1);
+
+		switch (op.op.kind) {
+		case Operator::Plus:    return emit(Op::Add, w, x, y);
+		case Operator::Minus:   return emit(Op::Sub, w, x, y);
+		case Operator::Star:    return emit(Op::Mul, w, x, y);
+		case Operator::Slash:   return emit(Op::SDiv, w, x, y);
+		case Operator::Percent: return emit(Op::SRem, w, x, y);
+		case Operator::BitAnd:  return emit(Op::And, w, x, y);
+		case Operator::BitOr:   return emit(Op::Or, w, x, y);
+		case Operator::BitXor:  return emit(Op::Xor, w, x, y);
+
+		case Operator::Lt:    return emit(Op::Lt, 1, x, y);
+		case Operator::Gt:    return emit(Op::Gt, 1, x, y);
+		case Operator::Le:    return emit(Op::Le, 1, x, y);
+		case Operator::Ge:    return emit(Op::Ge, 1, x, y);
+		case Operator::EqEq:  return emit(Op::Eq, 1, x, y);
+		case Operator::NotEq: return emit(Op::Ne, 1, x, y);
+
+		//both sides are evaluated, like the visitors do
+		case Operator::AndAnd: {
+			uint32_t l = to_bool(x);
+			return emit(Op::And, 1, l, to_bool(y));
+		}
+		case Operator::OrOr: {
+			uint32_t l = to_bool(x);
+			return emit(Op::Or, 1, l, to_bool(y));
+		}
+		default:
+			return std::nullopt;
+		}
+	}
+
+	//direct calls of declared functions, builtins and generics need the visitors
+	value_t exp(const Call& c) {
+		auto* name = std::get_if<Var>(&c.func->inner);
+		if (!name || vars.find(name->text) || ctx.generics.contains(name->text))
+			return std::nullopt;
+		auto it = ctx.global_consts.find(name->text);
+		if (it == ctx.global_consts.end())
+			return std::nullopt;
+
+		Value& callee = *it->second;
+		FunctionType* type = callee.type.func;
+		if (!type || !type->ft)
+			return std::nullopt;
+
+		size_t fixed = type->args.size();
+		if (type->ft->isVarArg() ? c.args.size() < fixed : c.args.size() != fixed)
+			return std::nullopt;
+		std::optional<uint8_t> ret = type->ret.t->isVoidTy() ? 0 : int_width(type->ret);
+		if (!ret)
+			return std::nullopt;
+
+		std::vector<uint32_t> args;
+		for (size_t i = 0; i < c.args.size(); ++i) {
+			value_t a = exp(c.args[i]);
+			if (!a || !width(*a))
+				return std::nullopt;
+			if (i < fixed)
+				a = assign_convert(*a, type->args[i]);
+			else if (width(*a) < 32)//default argument promotion for the ... part
+				a = resize(*a, 32, width(*a) != 1);
+			if (!a)
+				return std::nullopt;
+			args.push_back(*a);
+		}
+
+		uint32_t first = f.extra.size();
+		f.extra.insert(f.extra.end(), args.begin(), args.end());
+		f.callees.push_back({callee.v, type});
+		return emit(Op::Call, *ret, first, args.size(), f.callees.size() - 1);
+	}
+
+	// --- statements, false is "not ours" ---
+	bool stmt(const Statement& s) {
+		return std::visit([&](auto& x) { return stmt(x); }, s.inner);
+	}
+
+	template <typename T>
+	bool stmt(const T&) { return false; }
+
+	bool stmt(const Basic& b) { return exp(b.inner).has_value(); }
+
+	bool stmt(const Block& b) {
+		if (b.cold)//needs the visitors to lay it out
+			return false;
+		vars.push();
+		bool ok = std::all_of(b.parts.begin(), b.parts.end(), [&](auto& s) { return stmt(s); });
+		vars.pop();
+		return ok;
+	}
+
+	bool stmt(const Return& r) {
+		value_t v = exp(r.val);
+		if (!v || !width(*v))
+			return false;
+		v = assign_convert(*v, f.type->ret);
+		if (!v)
+			return false;
+		emit(Op::Ret, 0, *v);
+		begin_block("after.return");//nothing jumps here, dce drops whatever follows
+		return true;
+	}
+
+	bool stmt(const If& i) {
+		value_t cond = exp(i.cond);
+		if (!cond || !width(*cond))
+			return false;
+		uint32_t br = emit(Op::CondBr, 0, to_bool(*cond));
+		Scope<uint32_t> before = vars;
+
+		begin_block("then");
+		f.bs[br] = block();
+		if (!stmt(i.block))
+			return false;
+		uint32_t then_end = block();
+		uint32_t then_br = open() ? emit(Op::Br, 0) : NONE;
+		Scope<uint32_t> then_vars = std::exchange(vars, std::move(before));
+
+		begin_block("else");
+		f.imms[br] = block();
+		if (!stmt(i.else_part))
+			return false;
+		uint32_t else_end = block();
+		bool else_open = open();
+
+		if (then_br == NONE && !else_open) {
+			begin_block("after.if");
+			return true;
+		}
+
+		uint32_t merge = f.blocks();
+		if (then_br != NONE)
+			f.as[then_br] = merge;
+		if (else_open)
+			emit(Op::Br, 0, merge);
+		begin_block("merge");
+
+		if (then_br == NONE)
+			return true;
+		if (!else_open) {
+			vars = std::move(then_vars);
+			return true;
+		}
+
+		//a phi for every variable the arms left different
+		auto& from_then = then_vars.levels();
+		auto& from_else = vars.levels();
+		for (size_t l = 0; l < from_else.size(); ++l)
+			for (auto& [name, v] : from_else[l]) {
+				uint32_t t = from_then[l].at(name);
+				if (t == v)
+					continue;
+				uint32_t first = f.extra.size();
+				f.extra.insert(f.extra.end(), {then_end, t, else_end, v});
+				uint32_t phi = emit(Op::Phi, width(v), first, 2);
+				f.names[phi] = name;
+				v = phi;
+			}
+		return true;
+	}
+};
+
+}//namespace
+
+std::optional<Function> build(CompileContext& ctx, const small_lang::Function& src, FunctionType& type) {
+	//the visitors insist on a trailing return, coroutines need their frame
+	if (src.is_async || src.body.parts.empty() || !std::holds_alternative<Return>(src.body.parts.back().inner))
+		return std::nullopt;
+	if (!int_width(type.ret))
+		return std::nullopt;
+
+	Function f;
+	f.type = &type;
+	Builder b{ctx, f, {}};
+	b.begin_block("entry");
+
+	for (size_t i = 0; i < src.args.size(); ++i) {
+		auto w = int_width(type.args[i]);
+		if (!w)
+			return std::nullopt;
+		uint32_t a = b.emit(Op::Arg, *w, 0, 0, i);
+		f.names[a] = src.args[i].text;
+		b.vars[src.args[i].text] = a;
+	}
+
+	for (auto& stmt : src.body.parts)
+		if (!b.stmt(stmt))
+			return std::nullopt;
+	return f;
+}
+
+// ------------------------------------------------------------
+// Passes
+// ------------------------------------------------------------
+
+//constants are kept sign extended from their width, bools as 0 or 1
+static int64_t wrap(uint64_t v, uint8_t w) {
+	if (w == 1)
+		return v & 1;
+	if (w >= 64)
+		return static_cast<int64_t>(v);
+	uint64_t sign = 1ull << (w - 1);
+	v &= (sign << 1) - 1;
+	return static_cast<int64_t>((v ^ sign) - sign);
+}
+
+//what a signed compare sees, an i1 true is -1
+static int64_t as_signed(int64_t v, uint8_t w) { return w == 1 ? -v : v; }
+
+//drops the (block, value) pairs of phi i whose block drop(block) is true for
+template <typename F>
+static void drop_incoming(Function& f, uint32_t i, F&& drop) {
+	uint32_t* pairs = &f.extra[f.as[i]];
+	uint32_t kept = 0;
+	for (uint32_t k = 0; k < f.bs[i]; ++k)
+		if (!drop(pairs[2 * k])) {
+			pairs[2 * kept] = pairs[2 * k];
+			pairs[2 * kept + 1] = pairs[2 * k + 1];
+			++kept;
+		}
+	f.bs[i] = kept;
+}
+
+static std::optional<int64_t> fold(const Function& f, uint32_t i) {
+	uint8_t w = f.widths[i];
+	auto is_const = [&](uint32_t v) { return f.ops[v] == Op::Const; };
+
+	switch (f.ops[i]) {
+	case Op::SExt: case Op::ZExt: case Op::Trunc: {
+		uint32_t a = f.as[i];
+		if (!is_const(a))
+			return std::nullopt;
+		uint8_t from = f.widths[a];
+		int64_t v = f.imms[a];
+		if (f.ops[i] == Op::SExt)
+			return wrap(as_signed(v, from), w);
+		if (f.ops[i] == Op::ZExt)
+			return wrap(static_cast<uint64_t>(v) & (from >= 64 ? ~0ull : (1ull << from) - 1), w);
+		return wrap(v, w);
+	}
+
+	case Op::Phi: {
+		//every incoming value the same constant
+		std::optional<int64_t> same;
+		for (uint32_t k = 0; k < f.bs[i]; ++k) {
+			uint32_t v = f.extra[f.as[i] + 2 * k + 1];
+			if (!is_const(v) || (same && *same != f.imms[v]))
+				return std::nullopt;
+			same = f.imms[v];
+		}
+		return same;
+	}
+
+	case Op::Add: case Op::Sub: case Op::Mul: case Op::SDiv: case Op::SRem:
+	case Op::And: case Op::Or: case Op::Xor:
+	case Op::Lt: case Op::Gt: case Op::Le: case Op::Ge: case Op::Eq: case Op::Ne:
+		break;
+	default:
+		return std::nullopt;
+	}
+
+	uint32_t a = f.as[i], b = f.bs[i];
+	if (!is_const(a) || !is_const(b))
+		return std::nullopt;
+	uint8_t ow = f.widths[a];
+	uint64_t x = f.imms[a], y = f.imms[b];
+	int64_t sx = as_signed(f.imms[a], ow), sy = as_signed(f.imms[b], ow);
+	int64_t min = ow >= 64 ? std::numeric_limits<int64_t>::min() : -(int64_t(1) << (ow - 1));
+
+	switch (f.ops[i]) {
+	case Op::Add: return wrap(x + y, w);
+	case Op::Sub: return wrap(x - y, w);
+	case Op::Mul: return wrap(x * y, w);
+	case Op::And: return wrap(x & y, w);
+	case Op::Or:  return wrap(x | y, w);
+	case Op::Xor: return wrap(x ^ y, w);
+	//division by zero and min / -1 are left for the program to hit
+	case Op::SDiv:
+		if (sy == 0 || (sx == min && sy == -1))
+			return std::nullopt;
+		return wrap(static_cast<uint64_t>(sx / sy), w);
+	case Op::SRem:
+		if (sy == 0 || (sx == min && sy == -1))
+			return std::nullopt;
+		return wrap(static_cast<uint64_t>(sx % sy), w);
+	case Op::Lt: return sx < sy;
+	case Op::Gt: return sx > sy;
+	case Op::Le: return sx <= sy;
+	case Op::Ge: return sx >= sy;
+	case Op::Eq: return x == y;
+	case Op::Ne: return x != y;
+	default:
+		return std::nullopt;
+	}
+}
+
+bool fold_constants(Function& f) {
+	bool changed = false;
+	uint32_t block = 0;
+	for (uint32_t i = 0; i < f.size(); ++i) {
+		while (block + 1 < f.blocks() && f.starts[block + 1] <= i)
+			++block;
+
+		if (f.ops[i] == Op::CondBr && f.ops[f.as[i]] == Op::Const) {
+			bool taken = f.imms[f.as[i]];
+			uint32_t target = taken ? f.bs[i] : f.imms[i];
+			uint32_t dropped = taken ? f.imms[i] : f.bs[i];
+			for (uint32_t p = f.starts[dropped]; p < f.block_end(dropped); ++p)
+				if (f.ops[p] == Op::Phi)
+					drop_incoming(f, p, [&](uint32_t from) { return from == block; });
+			f.ops[i] = Op::Br;
+			f.as[i] = target;
+			changed = true;
+			continue;
+		}
+
+		if (auto v = fold(f, i)) {
+			f.ops[i] = Op::Const;
+			f.imms[i] = *v;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool propagate_copies(Function& f) {
+	bool changed = false;
+	std::vector<uint32_t> repl(f.size());
+	std::iota(repl.begin(), repl.end(), 0);
+
+	//operands come first, so repl of an operand is already final
+	for (uint32_t i = 0; i < f.size(); ++i) {
+		each_operand(f, i, [&](uint32_t& v) { v = repl[v]; });
+
+		if (f.ops[i] == Op::Copy) {
+			repl[i] = f.as[i];
+		} else if (f.ops[i] == Op::Phi && f.bs[i]) {
+			uint32_t same = f.extra[f.as[i] + 1];
+			for (uint32_t k = 1; k < f.bs[i]; ++k)
+				if (f.extra[f.as[i] + 2 * k + 1] != same)
+					same = NONE;
+			if (same != NONE)
+				repl[i] = same;
+		}
+
+		if (repl[i] != i) {
+			if (f.names[repl[i]].empty())
+				f.names[repl[i]] = f.names[i];
+			f.ops[i] = Op::Nop;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool remove_dead(Function& f) {
+	bool changed = false;
+
+	//every edge goes forward, so one sweep sees all predecessors of a block first
+	std::vector<bool> reachable(f.blocks(), false);
+	reachable[0] = true;
+	for (uint32_t b = 0; b < f.blocks(); ++b) {
+		uint32_t start = f.starts[b], end = f.block_end(b);
+		if (!reachable[b]) {
+			for (uint32_t i = start; i < end; ++i)
+				if (f.ops[i] != Op::Nop) {
+					f.ops[i] = Op::Nop;
+					changed = true;
+				}
+			continue;
+		}
+
+		for (uint32_t i = start; i < end; ++i) {
+			if (f.ops[i] != Op::Phi)
+				continue;
+			uint32_t before = f.bs[i];
+			drop_incoming(f, i, [&](uint32_t from) { return !reachable[from]; });
+			changed |= f.bs[i] != before;
+		}
+
+		if (end == start)
+			continue;
+		if (f.ops[end - 1] == Op::Br) {
+			reachable[f.as[end - 1]] = true;
+		} else if (f.ops[end - 1] == Op::CondBr) {
+			reachable[f.bs[end - 1]] = true;
+			reachable[f.imms[end - 1]] = true;
+		}
+	}
+
+	//unused values, users come after their operands so one backwards sweep is enough
+	std::vector<uint32_t> uses(f.size(), 0);
+	for (uint32_t i = 0; i < f.size(); ++i)
+		each_operand(f, i, [&](uint32_t v) { ++uses[v]; });
+
+	for (uint32_t i = f.size(); i-- > 0;) {
+		Op op = f.ops[i];
+		if (uses[i] || op == Op::Nop || op == Op::Arg || op == Op::Call || is_terminator(op))
+			continue;
+		each_operand(f, i, [&](uint32_t v) { --uses[v]; });
+		f.ops[i] = Op::Nop;
+		changed = true;
+	}
+	return changed;
+}
+
+void optimize(Function& f, std::span<const Pass> passes) {
+	//passes only ever remove or simplify, the bound is a backstop
+	for (int round = 0; round < 16; ++round) {
+		bool changed = false;
+		for (const Pass& p : passes)
+			changed |= p.run(f);
+		if (!changed)
+			return;
+	}
+}
+
+// ------------------------------------------------------------
+// mir -> LLVM
+// ------------------------------------------------------------
+void lower(CompileContext& ctx, const Function& f, llvm::Function* fn) {
+	auto& b = ctx.builder;
+
+	//a block that doesnt end in a terminator has no predecessors (the tail after a Return)
+	std::vector<llvm::BasicBlock*> blocks(f.blocks(), nullptr);
+	for (uint32_t bb = 0; bb < f.blocks(); ++bb) {
+		uint32_t end = f.block_end(bb);
+		if (end > f.starts[bb] && is_terminator(f.ops[end - 1]))
+			blocks[bb] = llvm::BasicBlock::Create(*ctx.ctx, f.labels[bb], fn);
+	}
+
+	std::vector<llvm::Value*> vals(f.size(), nullptr);
+	std::vector<uint32_t> phis;
+	for (uint32_t bb = 0; bb < f.blocks(); ++bb) {
+		if (!blocks[bb])
+			continue;
+		b.SetInsertPoint(blocks[bb]);
+
+		for (uint32_t i = f.starts[bb]; i < f.block_end(bb); ++i) {
+			llvm::StringRef name(f.names[i].data(), f.names[i].size());
+			llvm::Type* type = f.widths[i] ? b.getIntNTy(f.widths[i]) : nullptr;
+			auto x = [&] { return vals[f.as[i]]; };
+			auto y = [&] { return vals[f.bs[i]]; };
+
+			switch (f.ops[i]) {
+			case Op::Nop:
+				continue;
+			case Op::Const:
+				vals[i] = f.widths[i] == 1 ? b.getInt1(f.imms[i]) : llvm::ConstantInt::getSigned(type, f.imms[i]);
+				break;
+			case Op::Arg:
+				vals[i] = fn->getArg(f.imms[i]);
+				vals[i]->setName(name);
+				break;
+			case Op::Copy:  vals[i] = x(); break;
+			case Op::Add:   vals[i] = b.CreateAdd(x(), y(), name); break;
+			case Op::Sub:   vals[i] = b.CreateSub(x(), y(), name); break;
+			case Op::Mul:   vals[i] = b.CreateMul(x(), y(), name); break;
+			case Op::SDiv:  vals[i] = b.CreateSDiv(x(), y(), name); break;
+			case Op::SRem:  vals[i] = b.CreateSRem(x(), y(), name); break;
+			case Op::And:   vals[i] = b.CreateAnd(x(), y(), name); break;
+			case Op::Or:    vals[i] = b.CreateOr(x(), y(), name); break;
+			case Op::Xor:   vals[i] = b.CreateXor(x(), y(), name); break;
+			case Op::Lt:    vals[i] = b.CreateICmpSLT(x(), y(), name); break;
+			case Op::Gt:    vals[i] = b.CreateICmpSGT(x(), y(), name); break;
+			case Op::Le:    vals[i] = b.CreateICmpSLE(x(), y(), name); break;
+			case Op::Ge:    vals[i] = b.CreateICmpSGE(x(), y(), name); break;
+			case Op::Eq:    vals[i] = b.CreateICmpEQ(x(), y(), name); break;
+			case Op::Ne:    vals[i] = b.CreateICmpNE(x(), y(), name); break;
+			case Op::SExt:  vals[i] = b.CreateSExt(x(), type, name); break;
+			case Op::ZExt:  vals[i] = b.CreateZExt(x(), type, name); break;
+			case Op::Trunc: vals[i] = b.CreateTrunc(x(), type, name); break;
+
+			case Op::Call: {
+				const Callee& callee = f.callees[f.imms[i]];
+				std::vector<llvm::Value*> args;
+				for (uint32_t k = 0; k < f.bs[i]; ++k)
+					args.push_back(vals[f.extra[f.as[i] + k]]);
+				llvm::CallInst* call = b.CreateCall(callee.type->ft, callee.fn, args,
+					type ? "function call" : "");
+				call->setCallingConv(callee.type->cc);
+				vals[i] = call;
+				break;
+			}
+
+			//incoming values are filled in once every block exists
+			case Op::Phi:
+				vals[i] = b.CreatePHI(type, f.bs[i], name);
+				phis.push_back(i);
+				break;
+
+			case Op::Br:     b.CreateBr(blocks[f.as[i]]); break;
+			case Op::CondBr: b.CreateCondBr(x(), blocks[f.bs[i]], blocks[f.imms[i]]); break;
+			case Op::Ret:    b.CreateRet(x()); break;
+			}
+		}
+	}
+
+	for (uint32_t i : phis) {
+		auto* phi = llvm::cast<llvm::PHINode>(vals[i]);
+		for (uint32_t k = 0; k < f.bs[i]; ++k)
+			phi->addIncoming(vals[f.extra[f.as[i] + 2 * k + 1]], blocks[f.extra[f.as[i] + 2 * k]]);
+	}
+}
+
+static constexpr const char* op_names[] = {
+	"nop", "const", "arg", "copy",
+	"add", "sub", "mul", "sdiv", "srem", "and", "or", "xor",
+	"lt", "gt", "le", "ge", "eq", "ne",
+	"sext", "zext", "trunc",
+	"call", "phi", "br", "condbr", "ret",
+};
+static_assert(std::size(op_names) == static_cast<size_t>(Op::Ret) + 1);
+
+void print(std::ostream& out, const Function& f, std::string_view name) {
+	out << "[mir] " << name << "\n";
+	for (uint32_t bb = 0; bb < f.blocks(); ++bb) {
+		uint32_t start = f.starts[bb], end = f.block_end(bb);
+		bool live = std::any_of(f.ops.begin() + start, f.ops.begin() + end, [](Op op) { return op != Op::Nop; });
+		if (!live)
+			continue;
+
+		out << "bb" << bb << " " << f.labels[bb] << ":\n";
+		for (uint32_t i = start; i < end; ++i) {
+			Op op = f.ops[i];
+			if (op == Op::Nop)
+				continue;
+
+			out << "  ";
+			if (f.widths[i])
+				out << "%" << i << " = ";
+			out << op_names[static_cast<size_t>(op)];
+			if (f.widths[i])
+				out << " i" << int(f.widths[i]);
+
+			switch (op) {
+			case Op::Const: case Op::Arg:
+				out << " " << f.imms[i];
+				break;
+			case Op::Br:
+				out << " bb" << f.as[i];
+				break;
+			case Op::CondBr:
+				out << " %" << f.as[i] << ", bb" << f.bs[i] << ", bb" << f.imms[i];
+				break;
+			case Op::Phi:
+				for (uint32_t k = 0; k < f.bs[i]; ++k)
+					out << (k ? ", " : " ") << "[bb" << f.extra[f.as[i] + 2 * k] << " %" << f.extra[f.as[i] + 2 * k + 1] << "]";
+				break;
+			case Op::Call: {
+				llvm::StringRef callee = f.callees[f.imms[i]].fn->getName();
+				out << " @" << std::string_view(callee.data(), callee.size()) << "(";
+				for (uint32_t k = 0; k < f.bs[i]; ++k)
+					out << (k ? ", %" : "%") << f.extra[f.as[i] + k];
+				out << ")";
+				break;
+			}
+			default: {
+				const char* sep = " %";
+				each_operand(f, i, [&](uint32_t v) {
+					out << sep << v;
+					sep = ", %";
+				});
+				break;
+			}
+			}
+
+			if (!f.names[i].empty())
+				out << "  ; " << f.names[i];
+			out << "\n";
+		}
+	}
+}
+
+}//small_lang::mir
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "compiler.hpp"
+
+namespace small_lang::mir {
+
+// ------------------------------------------------------------
+// Mid level IR
+//   typed SSA for the integer part of the language: int/i32/char/bool
+//   arguments and locals, arithmetic, comparisons, casts, If, Return and
+//   direct calls, anything else is emitted by the visitors straight to LLVM
+//   one instruction per index in parallel arrays, a value is the index of
+//   the instruction that made it and block b is starts[b]..starts[b+1]
+//   every operand comes before its user (there are no loops)
+// ------------------------------------------------------------
+
+enum class Op : uint8_t {
+	Nop,   //removed by a pass
+	Const, //imm, sign extended (bools are 0 or 1)
+	Arg,   //imm is the index
+	Copy,  //a, every assignment makes one so copyprop has something to do
+	Add, Sub, Mul, SDiv, SRem, And, Or, Xor,//a, b
+	Lt, Gt, Le, Ge, Eq, Ne,//signed compares of a and b, width 1
+	SExt, ZExt, Trunc,     //a to the width
+	Call,  //callees[imm], arguments are extra[a..a+b)
+	Phi,   //b (block, value) pairs at extra[a..a+2b)
+	Br,    //to block a
+	CondBr,//a ? block b : block imm
+	Ret,   //a
+};
+
+//cc and the llvm signature come from type
+struct Callee {
+	llvm::Value* fn;
+	FunctionType* type;
+};
+
+struct Function {
+	std::vector<Op> ops;
+	std::vector<uint8_t> widths;//bits of the result, 0 if there is none
+	std::vector<uint32_t> as;
+	std::vector<uint32_t> bs;
+	std::vector<int64_t> imms;
+	std::vector<std::string_view> names;//the variable a value was assigned to, empty for temporaries
+
+	std::vector<uint32_t> extra;      //call arguments and phi pairs
+	std::vector<uint32_t> starts;     //first instruction of every block
+	std::vector<const char*> labels;  //block names for the lowered IR
+	std::vector<Callee> callees;
+	FunctionType* type = nullptr;
+
+	uint32_t size() const { return ops.size(); }
+	uint32_t blocks() const { return starts.size(); }
+	uint32_t block_end(uint32_t b) const { return b + 1 < starts.size() ? starts[b + 1] : size(); }
+};
+
+//null if f uses anything outside the subset, errors are left to the visitors to report
+std::optional<Function> build(CompileContext& ctx, const small_lang::Function& f, FunctionType& type);
+
+// --- passes, each returns true if it changed anything ---
+bool fold_constants(Function& f);  //constant operands, constant branches
+bool propagate_copies(Function& f);//Copy and phis whose incoming values are all the same
+bool remove_dead(Function& f);     //unreachable blocks (code after a Return) and unused values
+
+struct Pass {
+	const char* name;
+	bool (*run)(Function&);
+};
+
+inline constexpr Pass default_passes[] = {
+	{"constprop", fold_constants},
+	{"copyprop", propagate_copies},
+	{"dce", remove_dead},
+};
+
+//runs passes in order until none of them changes anything
+void optimize(Function& f, std::span<const Pass> passes = default_passes);
+
+//fills the empty fn (declared by the caller) through ctx.builder
+void lower(CompileContext& ctx, const Function& f, llvm::Function* fn);
+
+//%3 = add i64 %1, %2 ... one line per instruction, Nops are skipped
+void print(std::ostream& out, const Function& f, std::string_view name);
+
+}//small_lang::mir
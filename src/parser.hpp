@@ -5,22 +5,17 @@
 #include <cstring>
 #include <cassert>
 #include <format>
-#include <charconv>
 #include <algorithm>
 #include <sstream>
+#include <array>
+#include <vector>
 #include "ast.hpp"
 #include "ast_print.hpp"
+#include "lexer.hpp"
+#include "utils.hpp"
 
 namespace small_lang {
 
-static constexpr std::string_view keywords[] = {
-    "if", "else", "for", "while", "return",
-    "fn", "cfn",
-    //not used but like comeon
-    "break", "continue", "true", "false",
-    "let","as","is", "const", "struct"
-};
-
 struct ParseError {
     std::string message;
     std::string_view context; //position in the input stream where we ParseErrored
@@ -79,235 +74,192 @@ struct ParseError {
 static constexpr Bp CALL_BP = 16;
 static constexpr Bp SUBSCRIPT_BP = 16;
 static constexpr Bp CAST_BP = 15;
+static constexpr Bp SPAWN_BP = 15;//takes the call and nothing after it
+static constexpr Bp AWAIT_BP = 15;
+static constexpr Bp COMPTIME_BP = 15;
 
 
 
-constexpr Bp  Op::bp_prefix() const noexcept {
-    switch (kind) {
-        case Operator::Plus:        // unary +
-        case Operator::Minus:       // unary -
-        case Operator::Not:         // logical not
-        case Operator::BitAnd:      // address-of
-        case Operator::Star:        // deref
-        case Operator::PlusPlus:    // pre-increment
-        case Operator::MinusMinus:  // pre-decrement
-            return 16; // tight binding (C-style unary)
-        default:
-            return 0;   // not a prefix op
-    }
-}
+//binding powers, one row per Operator (0 means "not usable in that position")
+struct BpRow {
+    Bp prefix = 0;
+    Bp infix_left = 0;
+    Bp infix_right = 0;
+    Bp postfix = 0;
+};
 
-constexpr Bp  Op::bp_infix_left() const noexcept {
-    switch (kind) {
-        case Operator::Dot:
-        case Operator::Arrow:       return 20;
-        case Operator::Star:
-        case Operator::Slash:
-        case Operator::Percent:     return 14;
-        case Operator::Plus:
-        case Operator::Minus:       return 13;
-        case Operator::Lt:
-        case Operator::Gt:
-        case Operator::Le:
-        case Operator::Ge:          return 11;
-        case Operator::EqEq:
-        case Operator::NotEq:       return 10;
-        case Operator::BitAnd:      return 9;
-        case Operator::BitXor:      return 8;
-        case Operator::BitOr:       return 7;
-        case Operator::AndAnd:      return 6;
-        case Operator::OrOr:        return 5;
-        case Operator::Assign:      return 3;
-        default:
-            return 0;
-    }
+static constexpr size_t OPERATOR_COUNT = static_cast<size_t>(Operator::Dot) + 1;//Dot is last
+
+constexpr std::array<BpRow, OPERATOR_COUNT> make_bp_table() {
+    std::array<BpRow, OPERATOR_COUNT> t{};
+    auto row = [&](Operator k) -> BpRow& { return t[static_cast<size_t>(k)]; };
+
+    // tight binding (C-style unary)
+    for (Operator k : {Operator::Plus,      // unary +
+                       Operator::Minus,     // unary -
+                       Operator::Not,       // logical not
+                       Operator::BitAnd,    // address-of
+                       Operator::Star,      // deref
+                       Operator::PlusPlus,  // pre-increment
+                       Operator::MinusMinus // pre-decrement
+                      })
+        row(k).prefix = 16;
+
+    auto infix = [&](std::initializer_list<Operator> ks, Bp left, Bp right) {
+        for (Operator k : ks) {
+            row(k).infix_left = left;
+            row(k).infix_right = right;
+        }
+    };
+
+    // left-associative ops use same as left
+    infix({Operator::Dot, Operator::Arrow}, 20, 20);
+    infix({Operator::Star, Operator::Slash, Operator::Percent}, 14, 14);
+    infix({Operator::Plus, Operator::Minus}, 13, 13);
+    infix({Operator::Lt, Operator::Gt, Operator::Le, Operator::Ge}, 11, 11);
+    infix({Operator::EqEq, Operator::NotEq}, 10, 10);
+    infix({Operator::BitAnd}, 9, 9);
+    infix({Operator::BitXor}, 8, 8);
+    infix({Operator::BitOr}, 7, 7);
+    infix({Operator::AndAnd}, 6, 6);
+    infix({Operator::OrOr}, 5, 5);
+
+    // right-assoc
+    infix({Operator::Assign}, 3, 4);
+
+    row(Operator::PlusPlus).postfix = 15;
+    row(Operator::MinusMinus).postfix = 15;
+    return t;
 }
 
-constexpr Bp  Op::bp_infix_right() const noexcept {
-    switch (kind) {
-        // left-associative ops use same as left
-        case Operator::Dot:
-        case Operator::Arrow:       return 20;
-        case Operator::Star:
-        case Operator::Slash:
-        case Operator::Percent:     return 14;
-        case Operator::Plus:
-        case Operator::Minus:       return 13;
-        case Operator::Lt:
-        case Operator::Gt:
-        case Operator::Le:
-        case Operator::Ge:          return 11;
-        case Operator::EqEq:
-        case Operator::NotEq:       return 10;
-        case Operator::BitAnd:      return 9;
-        case Operator::BitXor:      return 8;
-        case Operator::BitOr:       return 7;
-        case Operator::AndAnd:      return 6;
-        case Operator::OrOr:        return 5;
-
-         // right-assoc
-        case Operator::Assign:      return 4;
-        default:
-            return 0;
-    }
-}
-
-constexpr Bp  Op::bp_postfix() const noexcept {
-    switch (kind) {
-        case Operator::PlusPlus:    
-        case Operator::MinusMinus:  return 15;
-        default:
-            return 0;
-    }
+static constexpr std::array<BpRow, OPERATOR_COUNT> BP_TABLE = make_bp_table();
+
+constexpr Bp  Op::bp_prefix() const noexcept { return BP_TABLE[static_cast<size_t>(kind)].prefix; }
+constexpr Bp  Op::bp_infix_left() const noexcept { return BP_TABLE[static_cast<size_t>(kind)].infix_left; }
+constexpr Bp  Op::bp_infix_right() const noexcept { return BP_TABLE[static_cast<size_t>(kind)].infix_right; }
+constexpr Bp  Op::bp_postfix() const noexcept { return BP_TABLE[static_cast<size_t>(kind)].postfix; }
+
+static_assert(Op(Operator::Assign).bp_infix_right() == 4);
+static_assert(Op(Operator::Invalid).bp_prefix() == 0);
+
+
+constexpr std::string_view spelling(Tok k) noexcept {
+	switch (k) {
+		case Tok::Eof:      return "EOF";
+		case Tok::Name:     return "NAME";
+		case Tok::Keyword:  return "KEYWORD";
+		case Tok::Num:      return "NUMBER";
+		case Tok::Op:       return "OPERATOR";
+		case Tok::Type:     return "@TYPE";
+		case Tok::String:   return "STRING";
+		case Tok::LParen:   return "(";
+		case Tok::RParen:   return ")";
+		case Tok::LBrace:   return "{";
+		case Tok::RBrace:   return "}";
+		case Tok::LBracket: return "[";
+		case Tok::RBracket: return "]";
+		case Tok::Comma:    return ",";
+		case Tok::Semi:     return ";";
+		case Tok::Ellipsis: return "...";
+		case Tok::Unknown:  return "UNKNOWN";
+	}
+	return "<invalid>";
 }
 
-
+//cursor over a pre tokenized source, all lookahead is an index away
 struct ParseStream{
 	std::string_view full;
-	std::string_view current;
+	TokenBuffer toks;
+	size_t pos = 0;
 
-	ParseStream(std::string_view text) : full(text),current(text) {}
+	ParseStream(std::string_view text) : full(text),toks(tokenize(text)) {}
 
-
-	void advance(int amount){
-		current={current.data()+amount,current.size()-amount};
+	Tok kind(size_t ahead = 0) const {
+		return toks.kinds[std::min(pos+ahead,toks.size()-1)];
 	}
 
-
-	bool skip_whitespace(){
-		bool skiped = false;
-		while (!current.empty() && std::isspace(current.front())) {
-	        skiped = true;
-	        current.remove_prefix(1);
-	       
-	    }
-
-	    return skiped;	    
+	std::string_view text_of(size_t i) const {
+		return full.substr(toks.offsets[i],toks.lengths[i]);
 	}
 
-	bool skip_comments() {
-	    bool skipped = skip_whitespace();
-
-	    while (!current.empty() && current.front() == '#') {
-	        while (!current.empty() && current.front() != '\n') {
-	            current.remove_prefix(1);
-	        }
-
-	        if (!current.empty() && current.front() == '\n') {
-	            current.remove_prefix(1);
-	        }
-
-	        skipped = true;
-			skip_whitespace();
-	    }
-
-	    return skipped;
+	//the token we are looking at (empty at EOF)
+	std::string_view here() const {
+		return text_of(pos);
 	}
 
+	//start of the current token, where a node starting here begins
+	const char* marker() const {
+		return full.data()+toks.offsets[pos];
+	}
 
+	//end of the last consumed token, where a node ending here ends
+	const char* last_end() const {
+		if(pos==0)
+			return full.data();
+		return full.data()+toks.offsets[pos-1]+toks.lengths[pos-1];
+	}
 
-	const char* marker(){
-		return current.data();
+	void advance(){
+		if(kind()!=Tok::Eof)
+			++pos;
 	}
 
-	bool empty(){
-		skip_comments();
-		return current.empty();
+	bool empty() const {
+		return kind()==Tok::Eof;
 	}
 
+	bool peek(Tok k) const {
+		return kind()==k;
+	}
 
-	bool starts_with(std::string_view pre){
-		if(current.size()<pre.size())
+	bool try_consume(Tok k){
+		if(!peek(k))
 			return false;
-
-		return std::memcmp(current.data(),pre.data(),pre.size())==0;
+		advance();
+		return true;
 	}
 
-	bool try_consume(std::string_view pre){
-		skip_comments();
-		if(starts_with(pre)){
-			advance(pre.size());
-			return true;
-		}
+	bool try_consume(Tok k,Token& out){
+		if(!peek(k))
+			return false;
+		out.text = here();
+		advance();
+		return true;
+	}
 
-		return false;
+	bool peek_keyword(Kw kw) const {
+		return kind()==Tok::Keyword && toks.ids[pos]==static_cast<uint32_t>(kw);
 	}
 
-	bool try_consume(std::string_view pre,Token& out){
-		skip_comments();
-		auto* start = current.data();
-		if(!try_consume(pre))
+	bool try_keyword(Kw kw){
+		if(!peek_keyword(kw))
 			return false;
-
-		out.text = {start,current.data()};
+		advance();
 		return true;
 	}
 
-	ParseError consume(std::string_view pre,std::string_view expected){
-		if(try_consume(pre))
+	ParseError consume(Tok k,std::string_view expected){
+		if(try_consume(k))
 			return ParseError();
 
-		return ParseError(std::format("expected {} found {}",expected,found_token()),current);
+		return ParseError(std::format("expected {} found {}",expected,found_token()),here());
 	}
 
-	ParseError consume(std::string_view pre){
-		return consume(pre,pre);
+	ParseError consume(Tok k){
+		return consume(k,spelling(k));
 	}
 
-	std::string_view found_token(){
-		std::string_view backup = current;
-
-		skip_comments();
-		if(current.empty()){
-			current = backup;
+	std::string_view found_token() const {
+		if(empty())
 			return "EOF";
-		}
-
-		for(auto e : keywords){
-			if(current.starts_with(e))
-				return e;
-		}
-
-		std::string_view ans = try_name();
-		if(ans.size()){
-			current = backup;
-			return ans;
-		}
-
-		Op op = try_operator();
-		if(op){
-			current = backup;
-			return op;
-		}
-
-		ans = {current.data(),1};//we arent empty
-		current = backup;
-		return ans ;
+		return here();
 	}
 
 	std::string_view try_name(){
-		skip_comments();
-		if(current.empty()|| !std::isalpha(current.front()))
+		if(!peek(Tok::Name))
 			return {nullptr,0};
-
-		const char* base = current.data();
-		while(!current.empty() && 
-			(std::isalpha(current.front()) 
-				|| std::isdigit(current.front())
-				|| current.front()=='_')
-			)
-		{
-			current.remove_prefix(1);
-		}
-
-		std::string_view name{base,current.data()};
-		for (auto kw : keywords) {
-	        if (kw == name){
-	        	current = {base,current.end()};
-	            return {}; // treat as no identifier
-	        }
-	    }
-
+		std::string_view name = here();
+		advance();
 		return name;
 	}
 
@@ -317,81 +269,31 @@ struct ParseStream{
 	ParseError consume_name(std::string_view& name){
 		name = try_name();
 		if(!name.size())
-			return ParseError(std::format("expected NAME found {}",found_token()),current);
+			return ParseError(std::format("expected NAME found {}",found_token()),here());
 		else
 			return ParseError();
 	}
 
-	Op peek_operator() {
-	    skip_comments();
-	    if (current.empty())
-	        return {};
-
-	    // Longest operators first
-	    if (starts_with("++")) return Op(Operator::PlusPlus);
-	    if (starts_with("--")) return Op(Operator::MinusMinus);
-	    if (starts_with("->")) return Op(Operator::Arrow);
-	    if (starts_with("&&")) return Op(Operator::AndAnd);
-	    if (starts_with("||")) return Op(Operator::OrOr);
-	    if (starts_with("==")) return Op(Operator::EqEq);
-	    if (starts_with("!=")) return Op(Operator::NotEq);
-	    if (starts_with("<=")) return Op(Operator::Le);
-	    if (starts_with(">=")) return Op(Operator::Ge);
-
-	    // Single-character operators
-	    if (starts_with("+")) return Op(Operator::Plus);
-	    if (starts_with("-")) return Op(Operator::Minus);
-	    if (starts_with("*")) return Op(Operator::Star);
-	    if (starts_with("/")) return Op(Operator::Slash);
-	    if (starts_with("%")) return Op(Operator::Percent);
-	    if (starts_with(".")) return Op(Operator::Dot);
-	    if (starts_with("&")) return Op(Operator::BitAnd);
-	    if (starts_with("|")) return Op(Operator::BitOr);
-	    if (starts_with("^")) return Op(Operator::BitXor);
-	    if (starts_with("!")) return Op(Operator::Not);
-	    if (starts_with("=")) return Op(Operator::Assign);
-	    if (starts_with("<")) return Op(Operator::Lt);
-	    if (starts_with(">")) return Op(Operator::Gt);
-
-	    return {};
+	Op peek_operator() const {
+		if(!peek(Tok::Op))
+			return {};
+		return Op(static_cast<Operator>(toks.ids[pos]));
 	}
 
 	Op try_operator() {
-	    skip_comments();
 	    const Op op = peek_operator();
-	    if (!op) return {};
-
-	    // Consume actual characters based on the matched operator text
-	    advance(static_cast<std::string_view>(op).size());
+	    if (op) advance();
 	    return op;
 	}
 
-
-
-
 	Num try_number() {
-	    skip_comments();
-	    if (current.empty())
-	        return Num{};
-
-	    const char* start = current.data();
-	    const char* ptr   = start;
-
-
-	    // Require at least one digit after optional sign
-	    if (ptr == current.end() || !std::isdigit(static_cast<unsigned char>(*ptr)))
-	        return Num{};
-
-	    // Consume all digits
-	    ptr = std::find_if_not(ptr, current.end(), [](unsigned char c) { return std::isdigit(c); });
+		if(!peek(Tok::Num))
+			return Num{};
 
 	    Num ans;
-	    ans.text  = {start, ptr};
-	    ans.value = 0;
-
-	    std::from_chars(start, ptr, ans.value);
-
-	    current.remove_prefix(static_cast<size_t>(ptr - current.data()));
+	    ans.text  = here();
+	    ans.value = toks.values[pos];
+	    advance();
 	    return ans;
 	}
 
@@ -403,8 +305,6 @@ inline ParseError parse_expression(ParseStream& stream,Expression& exp,Bp min_bp
 
 
 inline ParseError parse_atom(ParseStream& stream,Expression& out){
-	stream.skip_comments();
-
 	Num n = stream.try_number();
 	if(n.text.size()){
 		out.inner = std::move(n);
@@ -417,219 +317,331 @@ inline ParseError parse_atom(ParseStream& stream,Expression& out){
 		return ParseError();
 	}
 
-	return ParseError(std::format("expected VALUE found {}\n",stream.found_token()),stream.current);
-}
-
-inline ParseError parse_paren_expression(ParseStream& stream,Expression& out){
-	ParseError res;
-	
-	stream.skip_comments();
-	const char* start = stream.marker();
-
-	res =  stream.consume("(");
-	if(res) return res;
-
-	res = parse_expression(stream,out);
-	if(res) return res;
-	
-	
-	res =  stream.consume(")");
-	if(res) return res;
-
-	out.tok().text = {start,stream.marker()};
-	return res;
-}
-
-inline ParseError parse_call_args(ParseStream& stream,Call& out){
-	Expression tmp;
-	ParseError err;
-
-	err=stream.consume("(");
-	if(err) return err;
-
-	//check for easy empty
-	
-	if(stream.try_consume(")"))
-		return ParseError();
-	
-	err=parse_expression(stream,tmp);
-	if(err) return err;
-	out.args.push_back(std::move(tmp));
-
-	
-	while(stream.try_consume(",")){
-		
-		
-		err=parse_expression(stream,tmp);
-		if(err) return err;
-		out.args.push_back(std::move(tmp));
-
-		
-	}
-
-	return stream.consume(")");
+	return ParseError(std::format("expected VALUE found {}\n",stream.found_token()),stream.here());
 }
 
 inline ParseError parse_type(ParseStream& stream,TypeDec& type){
-	stream.skip_comments();
-	const char* start = stream.marker();
+	std::string_view text = stream.here();
 
-	ParseError res = stream.consume("@");
+	ParseError res = stream.consume(Tok::Type);
 	if(res) return res;
 
-	//NAME
-	const char* name_start = stream.marker();
-	while(!stream.current.empty() && 
-		(std::isalpha(stream.current.front()) 
-			|| std::isdigit(stream.current.front())
-			|| stream.current.front()=='_')
-		)
-	{
-		stream.current.remove_prefix(1);
-	}
-
-	//STARS
-	while(!stream.current.empty() && 
-		stream.current.front()=='*'
-		)
-	{
-		stream.current.remove_prefix(1);
-	}
-
-	type.name = {name_start,stream.marker()};
-	type.text = {start,stream.marker()};
+	type.name = text.substr(1);//@
+	type.text = text;
 	return res;
 }
 
 //HEAVILY inspired by https://matklad.github.io/2020/04/13/simple-but-powerful-pratt-parsing.html
+//the recursion is unrolled onto an explicit stack so generated code thousands
+//of operators deep cant blow the native stack.
+//every frame is one "parse_expression(min_bp)" call of the recursive version,
+//waiting tells us how to fold a finished child back into its parent
+struct ExprFrame {
+	enum class Waiting { Nothing, Prefix, Cast, Paren, Infix, CallArg, SubScript, Spawn, Await, Comptime, IfCond, IfThen, IfElse };
+
+	explicit ExprFrame(Bp min_bp) : min_bp(min_bp) {}
+
+	Bp min_bp;
+	const char* start = nullptr;
+	Expression out;
+
+	Waiting waiting = Waiting::Nothing;
+	Op op;
+	TypeDec type;
+	Call call;
+	Conditional cond;
+};
+
 inline ParseError parse_expression(ParseStream& stream,Expression& out,Bp min_bp){
+	using Waiting = ExprFrame::Waiting;
 	ParseError res;
-	
-	stream.skip_comments();
-	const char* start = stream.marker();
-
-	//recursively get the start
-	Op op = stream.try_operator();
-	if(op){
-		res = parse_expression(stream,out,op.bp_prefix());
-		if(res) return res;
-		out.inner = PreOp(op,std::move(out),{start,stream.marker()});
-	}
-	else if(stream.starts_with("(")){
-		res = parse_paren_expression(stream,out);
-		if(res) return res;
-	}
-	else if(stream.starts_with("@")){
-		TypeCast cast;
-		res = parse_type(stream,cast.type);
-		if(res) return res;
-
-		cast.exp = std::make_unique<Expression>();
-		res = parse_expression(stream,*cast.exp,CAST_BP);
-		if(res) return res;
-
-		cast.text = {start,stream.marker()};
-		out.inner = std::move(cast);
-	}
-	else{
-		res = parse_atom(stream,out);
-		if(res) return res;
-	}
 
+	//nothing below re-enters parse_expression so the stack can be reused
+	static thread_local std::vector<ExprFrame> stack;
+	stack.clear();
+	stack.push_back(ExprFrame{min_bp});
 
+	bool head = true;//are we parsing the start of the top frame or its operators
 	for(;;){
-		//special cases first
-		stream.skip_comments();
-		if(stream.starts_with("(")){
-			if(CALL_BP < min_bp) break;
-			Call call;
-			res = parse_call_args(stream,call);
+		ExprFrame& f = stack.back();
+
+		if(head){
+			f.start = stream.marker();
+
+			Op op = stream.try_operator();
+			if(op){
+				f.waiting = Waiting::Prefix;
+				f.op = op;
+				stack.push_back(ExprFrame{op.bp_prefix()});
+				continue;
+			}
+
+			if(stream.peek(Tok::LParen)){
+				stream.advance();
+				f.waiting = Waiting::Paren;
+				stack.push_back(ExprFrame{0});
+				continue;
+			}
+
+			if(stream.try_keyword(Kw::Spawn)){
+				f.waiting = Waiting::Spawn;
+				stack.push_back(ExprFrame{SPAWN_BP});
+				continue;
+			}
+
+			if(stream.try_keyword(Kw::Await)){
+				f.waiting = Waiting::Await;
+				stack.push_back(ExprFrame{AWAIT_BP});
+				continue;
+			}
+
+			if(stream.try_keyword(Kw::Comptime)){
+				f.waiting = Waiting::Comptime;
+				stack.push_back(ExprFrame{COMPTIME_BP});
+				continue;
+			}
+
+			//cond, then and else are each a whole expression, then keeps -x or (x) out of the condition
+			if(stream.try_keyword(Kw::If)){
+				f.waiting = Waiting::IfCond;
+				stack.push_back(ExprFrame{0});
+				continue;
+			}
+
+			if(stream.peek(Tok::Type)){
+				res = parse_type(stream,f.type);
+				if(res) return res;
+				f.waiting = Waiting::Cast;
+				stack.push_back(ExprFrame{CAST_BP});
+				continue;
+			}
+
+			res = parse_atom(stream,f.out);
 			if(res) return res;
-
-			call.func = std::make_unique<Expression>(std::move(out));
-			call.text = {start,stream.marker()};
-			out.inner = std::move(call);
-			
-			continue;
+			head = false;
 		}
 
-		if(stream.starts_with("[")){			
-			if(SUBSCRIPT_BP < min_bp) break;
-			stream.try_consume("[");
+		//operators after the start, special cases first
+		bool done = false;
+		if(stream.peek(Tok::LParen)){
+			if(CALL_BP < f.min_bp){
+				done = true;
+			}
+			else{
+				stream.advance();
+
+				//check for easy empty
+				if(stream.try_consume(Tok::RParen)){
+					Call call;
+					call.func = std::make_unique<Expression>(std::move(f.out));
+					call.text = {f.start,stream.last_end()};
+					f.out.inner = std::move(call);
+					continue;
+				}
+
+				f.waiting = Waiting::CallArg;
+				stack.push_back(ExprFrame{0});
+				head = true;
+				continue;
+			}
+		}
+		else if(stream.peek(Tok::LBracket)){
+			if(SUBSCRIPT_BP < f.min_bp){
+				done = true;
+			}
+			else{
+				stream.advance();
+				f.waiting = Waiting::SubScript;
+				stack.push_back(ExprFrame{0});
+				head = true;
+				continue;
+			}
+		}
+		else{
+			//common case
+			Op op = stream.peek_operator();
+			Bp b = op.bp_postfix();
+			Bp lbp = op.bp_infix_left();
+
+			if(!op){
+				done = true;
+			}
+			else if(b){
+				if(b < f.min_bp){
+					done = true;
+				}
+				else{
+					stream.try_operator();//skip the operator
+					f.out.inner = PreOp(op,std::move(f.out),{f.start,stream.last_end()});
+					continue;
+				}
+			}
+			else if(!lbp || lbp < f.min_bp){
+				done = true;
+			}
+			else{
+				stream.try_operator();
+				f.waiting = Waiting::Infix;
+				f.op = op;
+				stack.push_back(ExprFrame{op.bp_infix_right()});
+				head = true;
+				continue;
+			}
+		}
+		assert(done);
 
-			SubScript sub;
+		//frame finished, hand its result to the parent
+		if(stack.size()==1){
+			out = std::move(f.out);
+			stack.clear();
+			return ParseError();
+		}
 
-			sub.idx = std::make_unique<Expression>();
-			res = parse_expression(stream,*sub.idx);
-			if(res) return res;
+		Expression child = std::move(f.out);
+		stack.pop_back();
+		ExprFrame& p = stack.back();
+		head = false;
+
+		switch(p.waiting){
+		case Waiting::Prefix:
+			p.out.inner = PreOp(p.op,std::move(child),{p.start,stream.last_end()});
+			break;
+
+		case Waiting::Cast:{
+			TypeCast cast;
+			cast.type = p.type;
+			cast.exp = std::make_unique<Expression>(std::move(child));
+			cast.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(cast);
+			break;
+		}
 
-			res = stream.consume("]");
+		case Waiting::Paren:
+			res = stream.consume(Tok::RParen);
 			if(res) return res;
 
-
-			sub.arr = std::make_unique<Expression>(std::move(out));
-			sub.text = {start,stream.marker()};
-			out.inner = std::move(sub);
-			
-			continue;
+			p.out = std::move(child);
+			p.out.tok().text = {p.start,stream.last_end()};
+			break;
+
+		case Waiting::Infix:{
+			BinOp bin;
+			bin.op = p.op;
+			bin.b = std::make_unique<Expression>(std::move(child));
+			bin.a = std::make_unique<Expression>(std::move(p.out));
+			bin.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(bin);
+			break;
 		}
 
-		//common case
-		op = stream.peek_operator();
-		if(!op) break;
+		case Waiting::CallArg:
+			p.call.args.push_back(std::move(child));
+			if(stream.try_consume(Tok::Comma)){
+				stack.push_back(ExprFrame{0});
+				head = true;
+				break;
+			}
 
-		Bp b = op.bp_postfix();
-		if(b){
-			if(b<min_bp) break;
-			stream.try_operator();//skip the operator
-			out.inner = PreOp(op,std::move(out),{start,stream.marker()});
+			res = stream.consume(Tok::RParen);
+			if(res) return res;
 
-			continue;
-		}
+			p.call.func = std::make_unique<Expression>(std::move(p.out));
+			p.call.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(p.call);
+			p.call = Call();
+			break;
 
-		Bp lbp = op.bp_infix_left();
-		if(!lbp || lbp<min_bp) break;
-		stream.try_operator();
+		case Waiting::SubScript:{
+			res = stream.consume(Tok::RBracket);
+			if(res) return res;
 
+			SubScript sub;
+			sub.idx = std::make_unique<Expression>(std::move(child));
+			sub.arr = std::make_unique<Expression>(std::move(p.out));
+			sub.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(sub);
+			break;
+		}
 
+		case Waiting::Spawn:{
+			if(!std::holds_alternative<Call>(child.inner))
+				return ParseError("spawn needs a call\n",{p.start,stream.last_end()});
 
-		
-		BinOp bin;
-		bin.op = op;
-		bin.b = std::make_unique<Expression>();
-		res = parse_expression(stream,*bin.b,op.bp_infix_right());
-		if(res) return res;
+			Spawn spawn;
+			spawn.call = std::make_unique<Expression>(std::move(child));
+			spawn.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(spawn);
+			break;
+		}
 
-		bin.a = std::make_unique<Expression>(std::move(out));
-		bin.text = {start,stream.marker()};
+		case Waiting::Await:{
+			Await await;
+			await.handle = std::make_unique<Expression>(std::move(child));
+			await.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(await);
+			break;
+		}
 
-		out.inner = std::move(bin);
+		case Waiting::Comptime:{
+			Comptime comptime;
+			comptime.exp = std::make_unique<Expression>(std::move(child));
+			comptime.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(comptime);
+			break;
+		}
 
+		case Waiting::IfCond:
+			p.cond.cond = std::make_unique<Expression>(std::move(child));
+			if(!stream.try_keyword(Kw::Then))
+				return ParseError(std::format("expected then found {}",stream.found_token()),stream.here());
+			p.waiting = Waiting::IfThen;
+			stack.push_back(ExprFrame{0});
+			head = true;
+			break;
+
+		case Waiting::IfThen:
+			p.cond.then = std::make_unique<Expression>(std::move(child));
+			if(!stream.try_keyword(Kw::Else))
+				return ParseError(std::format("expected else found {}",stream.found_token()),stream.here());
+			p.waiting = Waiting::IfElse;
+			stack.push_back(ExprFrame{0});
+			head = true;
+			break;
+
+		case Waiting::IfElse:
+			p.cond.other = std::make_unique<Expression>(std::move(child));
+			p.cond.text = {p.start,stream.last_end()};
+			p.out.inner = std::move(p.cond);
+			p.cond = Conditional();
+			break;
+
+		case Waiting::Nothing:
+			UNREACHABLE();
+		}
+		if(!head)
+			p.waiting = Waiting::Nothing;
 	}
-
-	return ParseError();
 }
 
 
 
 inline ParseError parse_proper_block(ParseStream& stream,Block& out){
 	ParseError res = ParseError();	
-	stream.skip_comments();
 	const char* start = stream.marker();
 
-	res = stream.consume("{");
+	res = stream.consume(Tok::LBrace);
 	if(res) return res;
 
 	Statement stmt;
 	for(;;){
 		
-		if(stream.try_consume("}")){
-			out.text = {start,stream.marker()};
+		if(stream.try_consume(Tok::RBrace)){
+			out.text = {start,stream.last_end()};
 			return res;
 		}
 
 		if(stream.empty()){
-			return ParseError("expected statement or '}' found EOF\n",stream.current);
+			return ParseError("expected statement or '}' found EOF\n",stream.here());
 		}
 
 		res=parse_statement(stream,stmt);
@@ -638,13 +650,14 @@ inline ParseError parse_proper_block(ParseStream& stream,Block& out){
 	}
 }
 
+//[cold] ; | { ... } | statement, the body of a branch
 inline ParseError parse_block(ParseStream& stream,Block& out){
-	if(stream.try_consume(";",out)){
+	out.cold = stream.try_keyword(Kw::Cold);
+	if(stream.try_consume(Tok::Semi,out)){
 		return ParseError();
 	}
 
-	stream.skip_comments();
-	if(stream.starts_with("{"))
+	if(stream.peek(Tok::LBrace))
 		return parse_proper_block(stream,out);
 	
 	Statement stmt;
@@ -655,18 +668,61 @@ inline ParseError parse_block(ParseStream& stream,Block& out){
 }
 
 
+//[-]NUM, a match value
+inline ParseError parse_match_value(ParseStream& stream,int64_t& out){
+	const char* start = stream.marker();
+	bool negative = stream.peek_operator()==Operator::Minus;
+	if(negative)
+		stream.advance();
+
+	Num n = stream.try_number();
+	if(!n.text.size())
+		return ParseError(std::format("expected NUMBER found {}",stream.found_token()),stream.here());
+
+	//an int holds one more negative value than positive
+	if(n.value > static_cast<uint64_t>(INT64_MAX) + negative)
+		return ParseError("match value does not fit in an int\n",{start,stream.last_end()});
+	out = static_cast<int64_t>(negative ? 0 - n.value : n.value);
+	return ParseError();
+}
+
+//VALUE [... VALUE] {, VALUE [... VALUE]} block
+inline ParseError parse_match_arm(ParseStream& stream,MatchArm& out){
+	const char* start = stream.marker();
+	do {
+		int64_t lo, hi;
+		const char* at = stream.marker();
+		ParseError res = parse_match_value(stream,lo);
+		if(res) return res;
+
+		hi = lo;
+		if(stream.try_consume(Tok::Ellipsis)){
+			res = parse_match_value(stream,hi);
+			if(res) return res;
+			if(hi < lo)
+				return ParseError("empty range, the low end comes first",{at,stream.last_end()});
+		}
+		out.ranges.push_back({lo,hi});
+	} while(stream.try_consume(Tok::Comma));
+
+	ParseError res = parse_block(stream,out.block);
+	if(res) return res;
+
+	out.text = {start,stream.last_end()};
+	return res;
+}
+
 inline ParseError parse_statement(ParseStream& stream,Statement& out){
 	ParseError res;
-	stream.skip_comments();
 	const char* start = stream.marker();
 	
-	if(stream.starts_with("{")){
+	if(stream.peek(Tok::LBrace)){
 		auto& b = out.inner.emplace<Block>();
 		return parse_proper_block(stream,b);
 	}
 
 
-	if(stream.try_consume("while")){
+	if(stream.try_keyword(Kw::While)){
 		While& handle = out.inner.emplace<While>();
 		res = parse_expression(stream,handle.cond);
 		if(res) return res;
@@ -674,11 +730,44 @@ inline ParseError parse_statement(ParseStream& stream,Statement& out){
 		res = parse_block(stream,handle.block);
 		if(res) return res;
 
-		handle.text = {start,stream.marker()};
+		handle.text = {start,stream.last_end()};
+		return res;
+	}
+
+	if(stream.try_keyword(Kw::Region)){
+		Region& handle = out.inner.emplace<Region>();
+		res = stream.consume_name(handle.name);
+		if(res) return res;
+
+		res = parse_proper_block(stream,handle.block);
+		if(res) return res;
+
+		handle.text = {start,stream.last_end()};
+		return res;
+	}
+
+	if(stream.try_keyword(Kw::Sync)){
+		Sync& handle = out.inner.emplace<Sync>();
+		res = stream.consume(Tok::Semi);
+		if(res) return res;
+
+		handle.text = {start,stream.last_end()};
 		return res;
 	}
 
-	if(stream.try_consume("if")){
+	if(stream.try_keyword(Kw::Yield)){
+		Yield& handle = out.inner.emplace<Yield>();
+		res = parse_expression(stream,handle.val);
+		if(res) return res;
+
+		res = stream.consume(Tok::Semi);
+		if(res) return res;
+
+		handle.text = {start,stream.last_end()};
+		return res;
+	}
+
+	if(stream.try_keyword(Kw::If)){
 		If& handle = out.inner.emplace<If>();
 		res = parse_expression(stream,handle.cond);
 		if(res) return res;
@@ -686,23 +775,55 @@ inline ParseError parse_statement(ParseStream& stream,Statement& out){
 		res = parse_block(stream,handle.block);
 		if(res) return res;
 
-		if(stream.try_consume("else")){
+		if(stream.try_keyword(Kw::Else)){
 			res = parse_block(stream,handle.else_part);
-			handle.text = {start,stream.marker()};
+			if(res) return res;
+		}
+
+		handle.text = {start,stream.last_end()};
+		return res;
+	}
+
+	if(stream.try_keyword(Kw::Match)){
+		Match& handle = out.inner.emplace<Match>();
+		res = parse_expression(stream,handle.val);
+		if(res) return res;
+
+		res = stream.consume(Tok::LBrace);
+		if(res) return res;
+
+		bool has_else = false;
+		while(!stream.try_consume(Tok::RBrace)){
+			if(stream.empty())
+				return ParseError("expected match arm or '}' found EOF\n",stream.here());
+
+			const char* at = stream.marker();
+			if(stream.try_keyword(Kw::Else)){
+				if(has_else)
+					return ParseError("match already has an else",{at,stream.last_end()});
+				has_else = true;
+				res = parse_block(stream,handle.else_part);
+				if(res) return res;
+				continue;
+			}
+
+			res = parse_match_arm(stream,handle.arms.emplace_back());
+			if(res) return res;
 		}
 
+		handle.text = {start,stream.last_end()};
 		return res;
 	}
 
-	if(stream.try_consume("return")){
+	if(stream.try_keyword(Kw::Return)){
 		Return& handle = out.inner.emplace<Return>();
 		res = parse_expression(stream,handle.val);
 		if(res) return res;
 
 		
-		stream.try_consume(";");
+		stream.try_consume(Tok::Semi);
 
-		handle.text = {start,stream.marker()};
+		handle.text = {start,stream.last_end()};
 		return res;
 	}
 
@@ -710,72 +831,190 @@ inline ParseError parse_statement(ParseStream& stream,Statement& out){
 	res = parse_expression(stream, handle.inner);
 	if (res) return res;
 
-	res = stream.consume(";");
+	res = stream.consume(Tok::Semi);
 	if (res) return res;
 
-	handle.text = { start, stream.marker() };
+	handle.text = { start, stream.last_end() };
 	return res;
 
 
 }
 
 
-inline ParseError parse_func_args(ParseStream& stream,FuncDec& out){
-	Var tmp;
-	ParseError err;
+//[@type] [-]NUM or comptime, what a global variable can start as
+inline bool is_constant_init(const Expression& e){
+	const Expression* cur = &e;
+	if(auto* cast = std::get_if<TypeCast>(&cur->inner); cast && cast->exp)
+		cur = cast->exp.get();
+	for(const PreOp* pre; (pre = std::get_if<PreOp>(&cur->inner)) && pre->op.kind==Operator::Minus;)
+		cur = pre->exp.get();
+	return std::holds_alternative<Num>(cur->inner) || std::holds_alternative<Comptime>(cur->inner);
+}
 
-	err=stream.consume("(");
-	if(err) return err;
+//hits = @i32 0; is an i32 like it would be for a local
+inline void infer_global_type(GlobalVar& var){
+	auto* cast = std::get_if<TypeCast>(&var.init.inner);
+	if(var.type.text.size() || !cast || !cast->exp)
+		return;
+	var.type = cast->type;
+	Expression inner = std::move(*cast->exp);//cast lives in var.init
+	var.init = std::move(inner);
+}
 
-	//check for easy empty
-	
-	if(stream.try_consume(")"))
+//one parameter: [@type [restrict]] [name], or ... as the last one of a cfn
+inline ParseError parse_func_arg(ParseStream& stream,FuncDec& out){
+	if(stream.peek(Tok::Ellipsis)){
+		if(!out.is_c)
+			return ParseError("... is only allowed in cfn declarations",stream.here());
+		stream.advance();
+		out.varargs = true;
 		return ParseError();
-	
-	err=stream.consume_name(tmp);
+	}
+
+	TypeDec type;
+	bool is_restrict = false;
+	if(stream.peek(Tok::Type)){
+		ParseError err = parse_type(stream,type);
+		if(err) return err;
+
+		const char* at = stream.marker();
+		is_restrict = stream.try_keyword(Kw::Restrict);
+		if(is_restrict && !type.name.ends_with('*'))
+			return ParseError(std::format("restrict needs a pointer type found {}",type.text),{at,stream.last_end()});
+	}
+
+	Var name;
+	name.text = stream.try_name();
+	if(!type.text.size() && !name.text.size())
+		return ParseError(std::format("expected NAME or @TYPE found {}",stream.found_token()),stream.here());
+
+	out.args.push_back(name);
+	out.arg_types.push_back(type);
+	out.restrict_args.push_back(is_restrict);
+	return ParseError();
+}
+
+inline ParseError parse_func_args(ParseStream& stream,FuncDec& out){
+	ParseError err;
+
+	err=stream.consume(Tok::LParen);
 	if(err) return err;
-	out.args.push_back(std::move(tmp));
 
-	
-	while(stream.try_consume(",")){
-		err=stream.consume_name(tmp);
+	//check for easy empty, the return type still follows
+	if(!stream.try_consume(Tok::RParen)){
+		err=parse_func_arg(stream,out);
 		if(err) return err;
-		out.args.push_back(std::move(tmp));
 
-		
+		while(!out.varargs && stream.try_consume(Tok::Comma)){
+			err=parse_func_arg(stream,out);
+			if(err) return err;
+		}
+
+		err=stream.consume(Tok::RParen);
+		if(err) return err;
 	}
 
-	return stream.consume(")");
+	//-> @ret
+	if(stream.peek_operator().kind==Operator::Arrow){
+		stream.advance();
+		err=parse_type(stream,out.ret);
+	}
+	return err;
 }
 
 
-inline ParseError parse_global(ParseStream& stream,Global& out){
+//repl: name = expr; that isnt a constant runs as an expression instead of defining a global
+inline ParseError parse_global(ParseStream& stream,Global& out,bool repl=false){
 	ParseError res;
-	stream.skip_comments();
 	const char* start = stream.marker();
 
+	if(stream.try_keyword(Kw::Import)){
+		Import& handle = out.inner.emplace<Import>();
+		std::string_view path = stream.here();
+		res = stream.consume(Tok::String,"import path");
+		if(res) return res;
+		handle.path = path.substr(1,path.size()-2);//quotes
+
+		res = stream.consume(Tok::Semi);
+		if(res) return res;
+
+		handle.text = { start, stream.last_end() };
+		return res;
+	}
+
+	bool is_exported = stream.try_keyword(Kw::Export);
+	bool is_thread_local = stream.try_keyword(Kw::ThreadLocal);
+	if(is_exported || is_thread_local || stream.peek(Tok::Type)){
+		GlobalVar& handle = out.inner.emplace<GlobalVar>();
+		handle.is_exported = is_exported;
+		handle.is_thread_local = is_thread_local;
+		if(stream.peek(Tok::Type)){
+			res = parse_type(stream,handle.type);
+			if(res) return res;
+		}
+
+		res = stream.consume_name(handle.name);
+		if(res) return res;
+
+		if(stream.peek_operator().kind==Operator::Assign){
+			stream.advance();
+			res = parse_expression(stream,handle.init);
+			if(res) return res;
+		}
+
+		res = stream.consume(Tok::Semi);
+		if(res) return res;
+
+		handle.text = { start, stream.last_end() };
+		infer_global_type(handle);
+		return res;
+	}
+
+	//async fn name(...) { ... }, only definitions
+	bool is_async = stream.try_keyword(Kw::Async);
+	if(is_async && !stream.peek_keyword(Kw::Fn))
+		return ParseError(std::format("expected fn after async found {}",stream.found_token()),stream.here());
+
 	FuncDec sig;
-	sig.is_c = stream.try_consume("cfn");
+	sig.is_c = !is_async && stream.try_keyword(Kw::Cfn);
 	
-	if(sig.is_c || stream.try_consume("fn")){
+	if(sig.is_c || stream.try_keyword(Kw::Fn)){
 		res = stream.consume_name(sig.name);
 		if(res) return res;
 
+		//fn name[T, U]: type parameters, only for definitions
+		if(!sig.is_c && stream.try_consume(Tok::LBracket)){
+			do{
+				res = stream.consume_name(sig.type_params.emplace_back());
+				if(res) return res;
+			}while(stream.try_consume(Tok::Comma));
+
+			res = stream.consume(Tok::RBracket);
+			if(res) return res;
+		}
+
 		res = parse_func_args(stream,sig);
 		if(res) return res;
 
+		if(!sig.type_params.empty() && stream.peek(Tok::Semi))
+			return ParseError(std::format("a generic fn needs a body found {}",stream.found_token()),stream.here());
 
-		if(stream.try_consume(";")){
-			sig.text = { start, stream.marker() };
+		if(!is_async && stream.try_consume(Tok::Semi)){
+			sig.text = { start, stream.last_end() };
 			out.inner = std::move(sig);
 			return res;
 		}
 
+		//a C variadic body needs va_arg, which the language doesnt have
+		if(sig.varargs)
+			return ParseError(std::format("expected ; after a cfn with ... found {}",stream.found_token()),stream.here());
+
 		Function& func = out.inner.emplace<Function>();
 		static_cast<FuncDec&>(func) = std::move(sig);
+		func.is_async = is_async;
 
 		res = parse_proper_block(stream,func.body);
-		func.text = { start, stream.marker() };
+		func.text = { start, stream.last_end() };
 		return res;
 	}
 
@@ -783,10 +1022,23 @@ inline ParseError parse_global(ParseStream& stream,Global& out){
 	res = parse_expression(stream, handle.inner);
 	if (res) return res;
 
-	res = stream.consume(";");
+	res = stream.consume(Tok::Semi);
 	if (res) return res;
 
-	handle.text = { start, stream.marker() };
+	handle.text = { start, stream.last_end() };
+
+	//name = expr; is a global variable, like the first assignment makes a local
+	//the compiler rejects an init that isnt constant, only the REPL runs it (x = x + 1 included)
+	auto* assign = std::get_if<BinOp>(&handle.inner.inner);
+	if(assign && assign->op.kind==Operator::Assign && std::holds_alternative<Var>(assign->a->inner)
+	   && (!repl || is_constant_init(*assign->b))){
+		GlobalVar var;
+		var.name = std::get<Var>(assign->a->inner);
+		var.init = std::move(*assign->b);
+		var.text = handle.text;
+		infer_global_type(var);
+		out.inner = std::move(var);
+	}
 	return res;
 
 }
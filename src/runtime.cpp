@@ -0,0 +1,298 @@
+#include "runtime.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct alignas(16) Chunk {
+	Chunk* next;
+};
+
+constexpr size_t CHUNK_SIZE = 64 << 10;
+
+//anything over this gets its own chunk so it doesnt throw away the rest of the current one
+constexpr size_t BIG_ALLOC = CHUNK_SIZE / 4;
+
+//alloc has no error value to hand back, so a request it cant serve is fatal like a failed new
+[[noreturn]] void alloc_failed(const char* what, uint64_t size) {
+	std::fprintf(stderr, "[region] %s %llu bytes\n", what, static_cast<unsigned long long>(size));
+	std::abort();
+}
+
+Chunk* new_chunk(SmallRegion* r, size_t size) {
+	if (size > SIZE_MAX - sizeof(Chunk))
+		alloc_failed("alloc too large:", size);
+	Chunk* c = static_cast<Chunk*>(std::malloc(sizeof(Chunk) + size));
+	if (!c)
+		alloc_failed("out of memory allocating", size);
+	c->next = static_cast<Chunk*>(r->chunks);
+	r->chunks = c;
+	return c;
+}
+
+}
+
+extern "C" void* small_region_grow(SmallRegion* r, uint64_t size) {
+	if (size == 0)//size + 7 wrapped, the request was within 8 of 2^64
+		alloc_failed("alloc too large: over", UINT64_MAX - 8);
+
+	if (size > BIG_ALLOC)
+		return new_chunk(r, size) + 1;
+
+	Chunk* c = new_chunk(r, CHUNK_SIZE);
+	char* data = reinterpret_cast<char*>(c + 1);
+	r->cur = data + size;
+	r->end = data + CHUNK_SIZE;
+	return data;
+}
+
+extern "C" void small_region_release(SmallRegion* r) {
+	Chunk* c = static_cast<Chunk*>(r->chunks);
+	while (c) {
+		Chunk* next = c->next;
+		std::free(c);
+		c = next;
+	}
+	*r = SmallRegion{};
+}
+
+// ------------------------------------------------------------
+// spawn/sync
+// ------------------------------------------------------------
+namespace {
+
+//Chase-Lev work stealing deque (with the C11 orderings from Le et al. 2013)
+//the owner pushes and pops the bottom, thieves take from the top
+struct Deque {
+	struct Ring {
+		int64_t mask;
+		std::unique_ptr<std::atomic<SmallTask*>[]> slots;
+
+		explicit Ring(int64_t size) : mask(size - 1), slots(new std::atomic<SmallTask*>[size]) {}
+
+		SmallTask* get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+		void put(int64_t i, SmallTask* t) { slots[i & mask].store(t, std::memory_order_relaxed); }
+	};
+
+	std::atomic<int64_t> top{0};
+	std::atomic<int64_t> bottom{0};
+	std::atomic<Ring*> ring;
+	std::vector<std::unique_ptr<Ring>> rings;//thieves may still read an old one, freed with the deque
+
+	Deque() {
+		rings.push_back(std::make_unique<Ring>(256));
+		ring.store(rings.back().get(), std::memory_order_relaxed);
+	}
+
+	void push(SmallTask* t) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t tp = top.load(std::memory_order_acquire);
+		Ring* r = ring.load(std::memory_order_relaxed);
+		if (b - tp > r->mask) {
+			auto bigger = std::make_unique<Ring>((r->mask + 1) * 2);
+			for (int64_t i = tp; i < b; ++i)
+				bigger->put(i, r->get(i));
+			r = bigger.get();
+			rings.push_back(std::move(bigger));
+			ring.store(r, std::memory_order_release);
+		}
+		r->put(b, t);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	SmallTask* pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Ring* r = ring.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		SmallTask* x = r->get(b);
+		if (t == b) {
+			//last one, race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				x = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return x;
+	}
+
+	SmallTask* steal() {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+
+		SmallTask* x = ring.load(std::memory_order_acquire)->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return x;
+	}
+};
+
+struct Worker {
+	Deque deque;
+	uint64_t seed;//xorshift state for picking victims
+	std::thread thread;//not joinable for worker 0
+};
+
+struct Pool {
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<bool> stopping{false};
+
+	//idle workers sleep here, epoch changes whenever there is something new to steal
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<int> sleeping{0};
+	uint64_t epoch = 0;
+};
+
+Pool* pool = nullptr;
+thread_local Worker* self = nullptr;
+
+void execute(SmallTask* t) {
+	int64_t* pending = t->pending;//t lives in the spawning frame, which may be gone after the decrement
+	t->run(t);
+	std::atomic_ref<int64_t>(*pending).fetch_sub(1, std::memory_order_release);
+}
+
+SmallTask* find_work(Worker& w) {
+	if (SmallTask* t = w.deque.pop())
+		return t;
+
+	size_t n = pool->workers.size();
+	for (size_t tries = 0; tries < 2 * n; ++tries) {
+		w.seed ^= w.seed << 13;
+		w.seed ^= w.seed >> 7;
+		w.seed ^= w.seed << 17;
+
+		Worker& victim = *pool->workers[w.seed % n];
+		if (&victim == &w)
+			continue;
+		if (SmallTask* t = victim.deque.steal())
+			return t;
+	}
+	return nullptr;
+}
+
+void worker_loop(Worker& w) {
+	self = &w;
+	while (!pool->stopping.load(std::memory_order_acquire)) {
+		if (SmallTask* t = find_work(w)) {
+			execute(t);
+			continue;
+		}
+
+		//announce we are going to sleep before the last look, so a spawn
+		//either sees us sleeping or we see its task
+		pool->sleeping.fetch_add(1, std::memory_order_seq_cst);
+		uint64_t epoch;
+		{
+			std::lock_guard lock(pool->mutex);
+			epoch = pool->epoch;
+		}
+		if (SmallTask* t = find_work(w)) {
+			pool->sleeping.fetch_sub(1, std::memory_order_relaxed);
+			execute(t);
+			continue;
+		}
+
+		std::unique_lock lock(pool->mutex);
+		pool->wake.wait(lock, [&] {
+			return pool->epoch != epoch || pool->stopping.load(std::memory_order_relaxed);
+		});
+		pool->sleeping.fetch_sub(1, std::memory_order_relaxed);
+	}
+	self = nullptr;
+}
+
+}
+
+extern "C" void small_spawn(SmallTask* t) {
+	if (!self) {
+		t->run(t);
+		return;
+	}
+
+	std::atomic_ref<int64_t>(*t->pending).fetch_add(1, std::memory_order_relaxed);
+	self->deque.push(t);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (pool->sleeping.load(std::memory_order_relaxed)) {
+		{
+			std::lock_guard lock(pool->mutex);
+			++pool->epoch;
+		}
+		pool->wake.notify_one();
+	}
+}
+
+extern "C" void small_sync(int64_t* pending) {
+	std::atomic_ref<int64_t> left(*pending);
+	while (left.load(std::memory_order_acquire)) {
+		//our own children are on top of our deque, anything else we find is fair game too
+		if (SmallTask* t = self ? find_work(*self) : nullptr)
+			execute(t);
+		else
+			std::this_thread::yield();
+	}
+}
+
+namespace small_lang {
+
+void start_workers(unsigned count) {
+	if (pool)
+		return;
+	if (!count)
+		count = std::max(1u, std::thread::hardware_concurrency());
+
+	pool = new Pool();
+	for (unsigned i = 0; i < count; ++i) {
+		auto w = std::make_unique<Worker>();
+		w->seed = 0x9e3779b97f4a7c15ull * (i + 1);
+		pool->workers.push_back(std::move(w));
+	}
+
+	self = pool->workers[0].get();
+	for (unsigned i = 1; i < count; ++i) {
+		Worker& w = *pool->workers[i];
+		w.thread = std::thread(worker_loop, std::ref(w));
+	}
+}
+
+void stop_workers() {
+	if (!pool)
+		return;
+
+	pool->stopping.store(true, std::memory_order_release);
+	{
+		std::lock_guard lock(pool->mutex);
+		++pool->epoch;
+	}
+	pool->wake.notify_all();
+
+	for (auto& w : pool->workers)
+		if (w->thread.joinable())
+			w->thread.join();
+
+	self = nullptr;
+	delete pool;
+	pool = nullptr;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// ------------------------------------------------------------
+// Runtime support called from JIT'd code
+// lives in the host process, the JIT finds it like any other C symbol
+// ------------------------------------------------------------
+
+extern "C" {
+
+//state of one region block, the compiler emits the bump fast path against this layout
+struct SmallRegion {
+	char* cur;
+	char* end;
+	void* chunks;//everything malloc'd for the region, freed together
+};
+
+//slow path of alloc(r, size) once the current chunk is used up, size is already 8 aligned
+//never returns null, size 0 (a request that wrapped) or malloc failing aborts the process
+void* small_region_grow(SmallRegion* r, uint64_t size);
+
+//frees every chunk and leaves r empty
+void small_region_release(SmallRegion* r);
+
+//one spawned call, the compiler puts its arguments and result right after this header
+struct SmallTask {
+	void (*run)(SmallTask* self);
+	int64_t* pending;//outstanding tasks of the frame that spawned it
+};
+
+//queues t on the calling worker, runs it right away on any other thread
+void small_spawn(SmallTask* t);
+
+//helps with queued work until *pending drops to 0
+void small_sync(int64_t* pending);
+
+}
+
+namespace small_lang {
+
+//fork-join workers for spawn, each with a Chase-Lev deque that idle workers steal from
+//the calling thread is worker 0 until stop_workers, 0 means one per core
+void start_workers(unsigned count);
+void stop_workers();
+
+}
@@ -27,6 +27,9 @@ public:
         return nullptr;
     }
 
+    //every scope, outermost first (same shape before and after a balanced push/pop)
+    std::vector<std::map<std::string_view, T>>& levels() { return parts; }
+
     void insert(std::string_view k, const T& v) {
         parts.back()[k] = v;
     }
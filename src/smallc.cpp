@@ -0,0 +1,297 @@
+#include "smallc.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <zstd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+
+namespace small_lang {
+
+static std::optional<uint8_t> tag_of(const CompileContext& ctx, const Type& t) {
+	uint8_t depth = 0;
+	const Type* cur = &t;
+	for (; cur->t->isPointerTy(); cur = cur->stored) {
+		if (cur->func || depth == 0xf)
+			return std::nullopt;
+		++depth;
+		if (!cur->stored)//void*
+			return static_cast<uint8_t>(TypeTag::Void) | depth << TAG_DEPTH_SHIFT;
+	}
+
+	const std::pair<const Type*, TypeTag> bases[] = {
+		{&ctx.int_type, TypeTag::Int}, {&ctx.bool_type, TypeTag::Bool},
+		{&ctx.i32_type, TypeTag::I32}, {&ctx.char_type, TypeTag::Char},
+		{&ctx.double_type, TypeTag::Double}, {&ctx.void_type, TypeTag::Void},
+	};
+	for (auto [base, tag] : bases)
+		if (cur->t == base->t && !cur->func)
+			return static_cast<uint8_t>(tag) | depth << TAG_DEPTH_SHIFT;
+	return std::nullopt;
+}
+
+static Type type_of(CompileContext& ctx, uint8_t tag) {
+	Type* t = &ctx.int_type;
+	switch (static_cast<TypeTag>(tag & 0xf)) {
+	case TypeTag::Int:    t = &ctx.int_type; break;
+	case TypeTag::Bool:   t = &ctx.bool_type; break;
+	case TypeTag::I32:    t = &ctx.i32_type; break;
+	case TypeTag::Char:   t = &ctx.char_type; break;
+	case TypeTag::Double: t = &ctx.double_type; break;
+	case TypeTag::Void:   t = &ctx.void_type; break;
+	}//checked on open
+
+	for (int depth = tag >> TAG_DEPTH_SHIFT; depth; --depth)
+		t = ctx.pointer_to(t);
+	return *t;
+}
+
+template<typename T>
+static void append(std::string& out, const T& v) {
+	out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+int write_smallc(CompileContext& ctx, const std::string& path) {
+	std::vector<SmallcFunc> funcs;
+	std::vector<SmallcVar> vars;
+	std::string tags;
+	std::string names;
+
+	for (auto& [name, val] : ctx.global_consts) {
+		//only exported variables keep external linkage
+		if (!val->type.func) {
+			llvm::GlobalVariable* var = ctx.mod->getNamedGlobal(name);
+			if (!var || var->isDeclaration() || var->hasLocalLinkage() || !val->type.stored)
+				continue;
+
+			auto tag = tag_of(ctx, *val->type.stored);
+			if (!tag) {
+				std::cerr << "[smallc] can't export " << name << ": its type has no stable encoding\n";
+				return 1;
+			}
+
+			SmallcVar v{};
+			v.name_offset = names.size();
+			v.name_size = name.size();
+			v.tag = *tag;
+			v.is_thread_local = var->isThreadLocal();
+			names.append(name);
+			vars.push_back(v);
+			continue;
+		}
+
+		llvm::Function* fn = ctx.mod->getFunction(name);
+		if (!fn || fn->isDeclaration() || fn->hasLocalLinkage())
+			continue;
+
+		const FunctionType& ft = *val->type.func;
+		SmallcFunc f{};
+		f.name_offset = names.size();
+		f.name_size = name.size();
+		f.tags_offset = tags.size();
+		f.arg_count = ft.args.size();
+		f.is_c = ft.cc == llvm::CallingConv::C;
+		f.varargs = ft.ft->isVarArg();
+
+		auto push_tag = [&](const Type& t) {
+			auto tag = tag_of(ctx, t);
+			if (tag)
+				tags.push_back(static_cast<char>(*tag));
+			return tag.has_value();
+		};
+
+		bool ok = push_tag(ft.ret);
+		for (auto& a : ft.args)
+			ok = ok && push_tag(a);
+
+		if (!ok) {
+			std::cerr << "[smallc] can't export " << name << ": signature has no stable encoding\n";
+			return 1;
+		}
+
+		names.append(name);
+		funcs.push_back(f);
+	}
+
+	llvm::SmallVector<char, 0> bitcode;
+	llvm::raw_svector_ostream bos(bitcode);
+	llvm::WriteBitcodeToFile(*ctx.mod, bos);
+
+	std::string compressed(ZSTD_compressBound(bitcode.size()), '\0');
+	size_t zsize = ZSTD_compress(compressed.data(), compressed.size(),
+	                             bitcode.data(), bitcode.size(), 19);
+	if (ZSTD_isError(zsize)) {
+		std::cerr << "[smallc] zstd: " << ZSTD_getErrorName(zsize) << "\n";
+		return 1;
+	}
+
+	SmallcHeader h{};
+	std::memcpy(h.magic, SMALLC_MAGIC, sizeof(h.magic));
+	h.version = SMALLC_VERSION;
+	h.func_count = funcs.size();
+	h.tags_size = tags.size();
+	h.names_size = names.size();
+	h.bitcode_size = bitcode.size();
+	h.zstd_size = zsize;
+	h.var_count = vars.size();
+
+	std::string out;
+	append(out, h);
+	for (auto& f : funcs)
+		append(out, f);
+	for (auto& v : vars)
+		append(out, v);
+	out += tags;
+	out += names;
+	out.append(compressed.data(), zsize);
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.write(out.data(), out.size())) {
+		std::cerr << "[smallc] failed to write " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+std::unique_ptr<Precompiled> Precompiled::open(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "[smallc] failed to open " << path << "\n";
+		return nullptr;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(SmallcHeader)) {
+		std::cerr << "[smallc] " << path << " is too small\n";
+		::close(fd);
+		return nullptr;
+	}
+
+	void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		std::cerr << "[smallc] failed to map " << path << "\n";
+		return nullptr;
+	}
+
+	auto ans = std::make_unique<Precompiled>();
+	ans->path = path;
+	ans->data = static_cast<const char*>(map);
+	ans->size = st.st_size;
+
+	const SmallcHeader& h = ans->header();
+	if (std::memcmp(h.magic, SMALLC_MAGIC, sizeof(h.magic)) || h.version != SMALLC_VERSION) {
+		std::cerr << "[smallc] " << path << " is not a version " << SMALLC_VERSION << " .smallc file\n";
+		return nullptr;
+	}
+
+	//every size comes from the file, a sum that wraps could point the tables anywhere
+	uint64_t expected = 0;
+	bool wrapped = __builtin_mul_overflow(uint64_t{h.func_count}, sizeof(SmallcFunc), &expected)
+	            || __builtin_add_overflow(expected, uint64_t{h.var_count} * sizeof(SmallcVar), &expected)//cant wrap itself
+	            || __builtin_add_overflow(expected, sizeof(SmallcHeader), &expected)
+	            || __builtin_add_overflow(expected, h.tags_size, &expected)
+	            || __builtin_add_overflow(expected, h.names_size, &expected)
+	            || __builtin_add_overflow(expected, h.zstd_size, &expected);
+	if (wrapped || expected != ans->size) {
+		std::cerr << "[smallc] " << path << " is truncated or corrupt\n";
+		return nullptr;
+	}
+
+	//the frame records its own size, so a bad bitcode_size cant make us allocate anything
+	unsigned long long content = ZSTD_getFrameContentSize(ans->bitcode(), h.zstd_size);
+	if (content >= ZSTD_CONTENTSIZE_ERROR || content != h.bitcode_size) {
+		std::cerr << "[smallc] " << path << " is truncated or corrupt\n";
+		return nullptr;
+	}
+
+	for (uint32_t i = 0; i < h.func_count; ++i) {
+		const SmallcFunc& f = ans->funcs()[i];
+		uint64_t name_end = 0;
+		bool bad = __builtin_add_overflow(f.name_offset, uint64_t{f.name_size}, &name_end)
+		        || name_end > h.names_size
+		        || uint64_t{f.tags_offset} + 1 + f.arg_count > h.tags_size;//cant wrap in 64 bits
+		for (size_t t = 0; !bad && t <= f.arg_count; ++t)
+			bad = (ans->tags()[f.tags_offset + t] & 0xf) > static_cast<uint8_t>(TypeTag::Void);
+
+		if (bad) {
+			std::cerr << "[smallc] " << path << " has a corrupt signature table\n";
+			return nullptr;
+		}
+	}
+
+	for (uint32_t i = 0; i < h.var_count; ++i) {
+		const SmallcVar& v = ans->vars()[i];
+		uint64_t name_end = 0;
+		if (__builtin_add_overflow(v.name_offset, uint64_t{v.name_size}, &name_end)
+		 || name_end > h.names_size
+		 || (v.tag & 0xf) > static_cast<uint8_t>(TypeTag::Void) || v.tag == static_cast<uint8_t>(TypeTag::Void)) {
+			std::cerr << "[smallc] " << path << " has a corrupt variable table\n";
+			return nullptr;
+		}
+	}
+
+	return ans;
+}
+
+Precompiled::~Precompiled() {
+	if (data)
+		munmap(const_cast<char*>(data), size);
+}
+
+void Precompiled::declare(CompileContext& ctx) const {
+	for (uint32_t i = 0; i < header().func_count; ++i) {
+		const SmallcFunc& f = funcs()[i];
+		const uint8_t* sig = tags() + f.tags_offset;
+
+		std::vector<Type> args;
+		for (size_t a = 0; a < f.arg_count; ++a)
+			args.push_back(type_of(ctx, sig[1 + a]));
+
+		ctx.declare_function({names() + f.name_offset, f.name_size},
+		                     type_of(ctx, sig[0]), std::move(args),
+		                     f.is_c ? llvm::CallingConv::C : llvm::CallingConv::Fast, f.varargs);
+	}
+
+	for (uint32_t i = 0; i < header().var_count; ++i) {
+		const SmallcVar& v = vars()[i];
+		ctx.declare_variable({names() + v.name_offset, v.name_size},
+		                     ctx.canonical(type_of(ctx, v.tag)), v.is_thread_local);
+	}
+}
+
+int Precompiled::link_into(CompileContext& ctx) const {
+	std::vector<char> raw(header().bitcode_size);
+	size_t got = ZSTD_decompress(raw.data(), raw.size(), bitcode(), header().zstd_size);
+	if (ZSTD_isError(got) || got != raw.size()) {
+		std::cerr << "[smallc] " << path << ": bad zstd payload\n";
+		return 1;
+	}
+
+	auto modExp = llvm::parseBitcodeFile(
+		llvm::MemoryBufferRef(llvm::StringRef(raw.data(), raw.size()), path), *ctx.ctx);
+	if (!modExp) {
+		llvm::errs() << "[smallc] " << path << ": " << toString(modExp.takeError()) << "\n";
+		return 1;
+	}
+
+	if (llvm::Linker::linkModules(*ctx.mod, std::move(*modExp))) {
+		std::cerr << "[smallc] failed to link " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+}//small_lang
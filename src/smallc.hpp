@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "compiler.hpp"
+
+namespace small_lang {
+
+// ------------------------------------------------------------
+// .smallc precompiled modules
+//
+// layout (native endian, everything before the bitcode is used in place from the mmap):
+//   SmallcHeader
+//   SmallcFunc[func_count]
+//   SmallcVar[var_count]
+//   type tags   (tags_size bytes, ret then args for every function)
+//   names       (names_size bytes, not null terminated)
+//   bitcode     (zstd frame, zstd_size bytes, bitcode_size once decompressed)
+// ------------------------------------------------------------
+
+static constexpr char SMALLC_MAGIC[8] = {'s','m','a','l','l','c','\0','\0'};
+static constexpr uint32_t SMALLC_VERSION = 3;
+
+struct SmallcHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t func_count;
+	uint64_t tags_size;
+	uint64_t names_size;
+	uint64_t bitcode_size;
+	uint64_t zstd_size;
+	uint32_t var_count;
+	uint32_t pad;
+};
+
+struct SmallcFunc {
+	uint64_t name_offset;
+	uint32_t name_size;
+	uint32_t tags_offset;//ret tag followed by arg_count arg tags
+	uint16_t arg_count;
+	uint8_t is_c;
+	uint8_t varargs;
+	uint8_t pad[6];
+};
+
+//an exported global variable, defined in the bitcode
+struct SmallcVar {
+	uint64_t name_offset;
+	uint32_t name_size;
+	uint8_t tag;
+	uint8_t is_thread_local;
+	uint8_t pad[2];
+};
+
+//a tag is the base type in the low nibble and the pointer depth in the high one
+enum class TypeTag : uint8_t {
+	Int, Bool, I32, Char, Double, Void,
+};
+static constexpr uint8_t TAG_DEPTH_SHIFT = 4;
+
+//exports every function and exported variable defined in ctx.mod, 0 on success
+int write_smallc(CompileContext& ctx, const std::string& path);
+
+//a mapped .smallc, keep it alive as long as any context it was declared into
+struct Precompiled {
+	static std::unique_ptr<Precompiled> open(const std::string& path);
+	~Precompiled();
+
+	//registers the exported signatures and variables in ctx without touching the bitcode
+	void declare(CompileContext& ctx) const;
+
+	//decompresses the bitcode and links it into ctx.mod, 0 on success
+	int link_into(CompileContext& ctx) const;
+
+	std::string path;
+	const char* data = nullptr;
+	size_t size = 0;
+
+	const SmallcHeader& header() const { return *reinterpret_cast<const SmallcHeader*>(data); }
+	const SmallcFunc* funcs() const { return reinterpret_cast<const SmallcFunc*>(data + sizeof(SmallcHeader)); }
+	const SmallcVar* vars() const { return reinterpret_cast<const SmallcVar*>(funcs() + header().func_count); }
+	const uint8_t* tags() const { return reinterpret_cast<const uint8_t*>(vars() + header().var_count); }
+	const char* names() const { return reinterpret_cast<const char*>(tags() + header().tags_size); }
+	const char* bitcode() const { return names() + header().names_size; }
+};
+
+}//small_lang
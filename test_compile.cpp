@@ -1,7 +1,15 @@
 #include "jit.hpp"
+#include "smallc.hpp"
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string_view>
+#include <unistd.h>
 
 using namespace small_lang;
 
@@ -12,8 +20,9 @@ struct TestCase {
 };
 
 // run one case, optionally with debug
-static bool run_case(const TestCase& t, bool verbose_on_fail = true) {
+static bool run_case(const TestCase& t, Engine engine, bool verbose_on_fail = true) {
     RunOptions opt;
+    opt.engine        = engine;
     opt.print_globals = false;
     opt.print_ir_pre  = false;
     opt.print_ir_post = false;
@@ -47,6 +56,292 @@ static bool run_case(const TestCase& t, bool verbose_on_fail = true) {
     return ok;
 }
 
+// ------------------------------------------------------------
+// cases a return value cant show: files on disk (precompiled modules,
+// native libraries) and what ends up in the IR
+// ------------------------------------------------------------
+struct CheckCase {
+    std::string name;
+    bool (*run)();
+};
+
+//a scratch file of this process
+static std::string temp_path(std::string_view name) {
+    return (std::filesystem::temp_directory_path() / std::format("small_test_{}_{}", getpid(), name)).string();
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static void write_file(const std::string& path, std::string_view bytes) {
+    std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size());
+}
+
+//compiles src into a .smallc at path, 0 on success
+static int emit_smallc(std::string_view src, const std::string& path) {
+    RunOptions opt;
+    opt.emit_smallc = path;
+    int64_t ret = 0;
+    return compile_source(src, opt, ret);
+}
+
+//JITs src against opt's libraries, true if main() returned expected
+static bool runs_to(std::string_view src, RunOptions opt, int64_t expected) {
+    opt.engine = Engine::Jit;
+    int64_t ret = -9999;
+    if (compile_source(src, opt, ret))
+        return false;
+    if (ret != expected)
+        std::cerr << "expected " << expected << " but got " << ret << "\n";
+    return ret == expected;
+}
+
+static constexpr std::string_view TWICE_LIB = R"(
+fn twice(x) { return x * 2; }
+)";
+static constexpr std::string_view TWICE_MAIN = R"(
+cfn main() { return twice(21); }
+)";
+
+static bool smallc_round_trip() {
+    std::string lib = temp_path("twice.smallc");
+    RunOptions opt;
+    opt.link_smallc = {lib};
+    bool ok = !emit_smallc(TWICE_LIB, lib) && runs_to(TWICE_MAIN, opt, 42);
+    std::filesystem::remove(lib);
+    return ok;
+}
+
+static bool smallc_exported_globals() {
+    std::string lib = temp_path("counter.smallc");
+    RunOptions opt;
+    opt.link_smallc = {lib};
+    bool ok = !emit_smallc(R"(
+export calls = 40;
+export thread_local @i32 hits = 0;
+hidden = 7;                 # internal, not in the .smallc
+
+fn bump() {
+    calls = calls + 1;
+    hits = hits + @i32 1;
+    return hidden;
+}
+)", lib) && runs_to(R"(
+cfn main() {
+    x = bump();
+    return calls + @int hits + x;   # 41 + 1 + 7
+}
+)", opt, 49);
+    std::filesystem::remove(lib);
+    return ok;
+}
+
+static bool smallc_corrupt_rejected() {
+    std::string lib = temp_path("corrupt.smallc");
+    if (emit_smallc(TWICE_LIB, lib))
+        return false;
+    std::string good = read_file(lib);
+
+    //sizes that wrap around to the real file size, then a truncated file
+    std::string wrapped = good;
+    SmallcHeader h;
+    std::memcpy(&h, wrapped.data(), sizeof(h));
+    h.tags_size += 1ull << 63;
+    h.names_size += 1ull << 63;
+    std::memcpy(wrapped.data(), &h, sizeof(h));
+
+    bool ok = true;
+    RunOptions opt;
+    opt.link_smallc = {lib};
+    int64_t ret = 0;
+    for (std::string_view bytes : {std::string_view(wrapped), std::string_view(good).substr(0, good.size() - 1)}) {
+        write_file(lib, bytes);
+        ok = ok && compile_source(TWICE_MAIN, opt, ret) != 0;
+    }
+    std::filesystem::remove(lib);
+    return ok;
+}
+
+//the IR printed before optimization, empty if src doesnt compile
+static std::string ir_of(std::string_view src, RunOptions opt) {
+    opt.print_ir_pre = true;
+    opt.run_main = false;
+    std::stringstream out;
+    std::streambuf* old = std::cout.rdbuf(out.rdbuf());
+    int64_t ret = 0;
+    int failed = compile_source(src, opt, ret);
+    std::cout.rdbuf(old);
+    return failed ? "" : out.str();
+}
+
+static bool no_strict_aliasing_drops_tbaa() {
+    std::string_view src = R"(
+fn typed(@int* a, @bool* b) {
+    x = *a;
+    *b = @bool 1;
+    return x + *a;
+}
+
+cfn main() {
+    v = 20;
+    f = @bool 0;
+    return typed(&v, &f);
+}
+)";
+    RunOptions opt;
+    std::string strict = ir_of(src, opt);
+    opt.strict_aliasing = false;
+    std::string loose = ir_of(src, opt);
+    return strict.contains("!tbaa") && !loose.empty() && !loose.contains("!tbaa");
+}
+
+static constexpr std::string_view PROMOTE_MAIN = R"(
+cfn calloc(@int n, @int size) -> @void*;
+cfn malloc(@int size) -> @int*;
+cfn free(@void*) -> @void;
+cfn strlen(@char* s) -> @int;
+
+fn boxed(v) {
+    p = malloc(8);          # returned, stays on the heap
+    *p = v;
+    return @int p;
+}
+
+cfn main() {
+    s = @int calloc(4, 2);  # only strlen sees it, becomes a zeroed alloca
+    *(@char* s) = @char 104;
+    *(@char* (s+1)) = @char 105;
+    n = strlen(@char* s);
+    free(@void* s);
+    b = boxed(40);
+    r = *(@int* b) + n;
+    free(@void* b);
+    return r;
+}
+)";
+
+//the calloc became an alloca, the malloc that is returned stayed a call
+static bool heap_to_stack_promotion() {
+    std::string ir = ir_of(PROMOTE_MAIN, RunOptions{});
+    return ir.contains("alloca [8 x i8]") && !ir.contains("call ptr @calloc")
+        && ir.contains("call ptr @malloc(i64 8)");
+}
+
+//down reaches itself only through spawn, still recursion so its malloc stays
+static bool spawned_recursion_stays_on_heap() {
+    std::string ir = ir_of(R"(
+cfn malloc(@int size) -> @int*;
+cfn free(@int* p) -> @void;
+
+fn down(n) {
+    p = malloc(1024);
+    *p = n;
+    if n > 0 {
+        a = spawn down(n - 1);
+        sync;
+    }
+    r = *p;
+    free(p);
+    return r;
+}
+
+cfn main() { return down(3); }
+)", RunOptions{});
+    return ir.contains("call ptr @malloc(i64 1024)") && !ir.contains("alloca [1024 x i8]");
+}
+
+static constexpr std::string_view NATIVE_MAIN = R"(
+cfn native_add(@int a, @int b) -> @int;
+
+cfn main() { return native_add(40, 2); }
+)";
+
+static bool link_shared_library() {
+    RunOptions opt;
+    opt.link_shared = {TEST_NATIVE_SHARED};
+    return runs_to(NATIVE_MAIN, opt, 42);
+}
+
+static bool link_object_archive() {
+    RunOptions opt;
+    opt.link_archives = {TEST_NATIVE_STATIC};
+    return runs_to(NATIVE_MAIN, opt, 42);
+}
+
+//a GNU ar archive of named members, without a symbol table (we dont need one)
+static std::string ar_archive(const std::vector<std::pair<std::string, std::string>>& members) {
+    std::string out = "!<arch>\n";
+    for (auto& [name, data] : members) {
+        out += std::format("{:<16}{:<12}{:<6}{:<6}{:<8}{:<10}`\n", name + "/", 0, 0, 0, 644, data.size());
+        out += data;
+        if (data.size() % 2)
+            out += '\n';
+    }
+    return out;
+}
+
+//bitcode of native_triple(x) = x * 3, what clang -flto would put in an archive
+static std::string triple_bitcode() {
+    llvm::LLVMContext c;
+    llvm::Module m("native_triple", c);
+    llvm::Type* i64 = llvm::Type::getInt64Ty(c);
+    auto* f = llvm::Function::Create(llvm::FunctionType::get(i64, {i64}, false),
+                                     llvm::Function::ExternalLinkage, "native_triple", m);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(c, "entry", f));
+    b.CreateRet(b.CreateMul(f->getArg(0), b.getInt64(3)));
+
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    llvm::WriteBitcodeToFile(m, os);
+    os.flush();
+    return out;
+}
+
+static bool link_bitcode_archive() {
+    std::string lib = temp_path("triple.a");
+    write_file(lib, ar_archive({{"triple.bc", triple_bitcode()}}));
+
+    RunOptions opt;
+    opt.link_archives = {lib};
+    bool ok = runs_to(R"(
+cfn native_triple(@int x) -> @int;
+
+cfn main() { return native_triple(14); }
+)", opt, 42);
+
+    //the REPL has no main module to link it into but still has to see it
+    std::stringstream out;
+    std::streambuf* old = std::cout.rdbuf(out.rdbuf());
+    auto session = ReplSession::create(opt);
+    ok = ok && session
+       && !session->eval("cfn native_triple(@int x) -> @int;")
+       && !session->eval("native_triple(14);");
+    std::cout.rdbuf(old);
+    ok = ok && out.str().contains("=> 42");
+
+    std::filesystem::remove(lib);
+    return ok;
+}
+
+static bool unusable_archive_rejected() {
+    std::string lib = temp_path("junk.a");
+    RunOptions opt;
+    opt.link_archives = {lib};
+    int64_t ret = 0;
+
+    bool ok = true;
+    for (std::string bytes : {ar_archive({}), ar_archive({{"notes.txt", "not code\n"}})}) {
+        write_file(lib, bytes);
+        ok = ok && compile_source(NATIVE_MAIN, opt, ret) != 0 && !ReplSession::create(opt);
+    }
+    std::filesystem::remove(lib);
+    return ok;
+}
+
 int main() {
     std::cout << "=== Small-Lang Battery ===\n";
 
@@ -148,6 +443,15 @@ cfn main() {
 }
 )", 4 },
 
+        { "deep recursion that isnt a tail call",
+R"(
+fn down(n) {
+    if n == 0 return 0;
+    return 1 + down(n - 1);
+}
+cfn main() { return down(100000) == 100000; }
+)", 1 },
+
         // --- nested control flow ---
         { "nested ifs",
 R"(
@@ -213,6 +517,551 @@ cfn main() {
 }
 )", 1 },
 
+        // --- typed C prototypes ---
+        { "typed cfn with narrow int and pointer",
+R"(
+cfn abs(@i32) -> @i32;
+cfn labs(@int) -> @int;
+cfn memset(@void* dst, @i32 c, @int n) -> @void*;
+
+cfn main() {
+    x = 0;
+    memset(@void* &x, 1, 2);   # 0x0101
+    return abs(0 - 7) + labs(0 - 100) + x;
+}
+)", 364 },
+        { "double parameters, arithmetic and compares",
+R"(
+fn twice(@double a) -> @double { return a + a; }
+fn hyp2(@double a, @double b) -> @double { return a * a + b * b; }
+
+cfn main() {
+    h = twice(@double 5) / 4;              # 2.5, the int converts
+    if (h < 2 || h >= 3 || -h > 0 || !h) return 1;
+    return @int (hyp2(@double 3, @double 4) + h * 2);   # 25 + 5
+}
+)", 30 },
+        { "zero argument signatures with return types",
+R"(
+cfn getpid() -> @i32;
+fn nothing() -> @void { }
+fn seven() -> @char { return 7; }
+
+cfn main() {
+    nothing();
+    return (getpid() > 0) + seven();
+}
+)", 8 },
+
+        // --- regions ---
+        { "region alloc and early return",
+R"(
+fn fill(r, n) {
+    first = alloc(r, 8);
+    last = first;
+    i = n;
+    if (i > 0) last = alloc(r, 8);
+    return last - first;
+}
+
+cfn main() {
+    region r {
+        a = alloc(r, 24);
+        b = alloc(r, 1);
+        if (b - a != 24) return 1;
+        region inner {
+            if (fill(inner, 1) != 8) return 2;
+        }
+    }
+    return 0;
+}
+)", 0 },
+        { "region zero size allocs are distinct",
+R"(
+cfn main() {
+    region r {
+        a = alloc(r, 0);                # empty region, goes through grow
+        b = alloc(r, 0);
+        if (a == 0) return 1;
+        if (b - a != 8) return 2;
+    }
+    return 0;
+}
+)", 0 },
+
+        // --- fork-join ---
+        { "spawn and sync",
+R"(
+fn none() { return 0; }
+fn fib(n) {
+    if n < 2 return n;
+    a = spawn fib(n - 1);
+    b = fib(n - 2);
+    sync;
+    return *a + b;
+}
+
+cfn main() {
+    spawn none();
+    x = spawn fib(20);
+    y = fib(10);
+    sync;
+    return *x + y;
+}
+)", 6820 },
+
+        // --- atomics and thread locals ---
+        { "atomic rmw, cas and thread_local init",
+R"(
+thread_local @i32 tls = -3;
+
+fn bump() {
+    tls = @i32 (tls + 1);
+    return 0;
+}
+
+cfn main() {
+    x = 5;
+    p = &x;
+    a = atomic_xchg(p, 8, seq_cst);        # 5
+    b = atomic_cas(p, 8, 2, acq_rel);      # 8, x = 2
+    c = atomic_sub(p, 1, release);         # 2, x = 1
+    atomic_store(p, atomic_load(p, relaxed) + 40, relaxed);
+    bump();
+    return a + b + c + x + tls;            # 5 + 8 + 2 + 41 - 2
+}
+)", 54 },
+
+        // --- generators and async ---
+        { "yield, next/done/drop and await",
+R"(
+fn gen(n) {
+    region r {
+        p = alloc(r, 8);
+        yield n;
+        yield n + 1;
+    }
+    return n + 2;
+}
+
+async fn twice(g) {
+    a = await g;
+    return a * 2;
+}
+
+cfn main() {
+    g = gen(1);
+    a = next(g);                        # 1
+    drop(g);                            # destroyed inside the region
+    h = gen(10);
+    b = next(h) + next(h) + next(h);    # 10 + 11 + 12
+    c = done(h);
+    drop(h);
+    d = await twice(gen(20));           # 22 * 2
+    return a + b + c + d;
+}
+)", 79 },
+
+        // --- generics ---
+        { "generic instances per argument type, nested and spawned",
+R"(
+fn id[T](@T v) -> @T {
+    return v;
+}
+
+fn twice[T](@T* p) -> @T {
+    return id(*p) + id(*p);
+}
+
+cfn main() {
+    a = 20;
+    b = @i32 1;
+    r = spawn twice(&a);    # twice[int] -> id[int]
+    s = twice(&b);          # twice[i32] -> id[i32]
+    sync;
+    return *r + s;
+}
+)", 42 },
+
+        { "pointer types shared by instances, caller addresses kept across one",
+R"(
+fn get[T](@T* p) -> @T {
+    q = p;
+    r = &q;
+    return **r;
+}
+
+cfn main() {
+    a = 1;
+    pa = &a;
+    ppa = &pa;
+    **ppa = get(*ppa) + 40;     # the address on the left outlives get[int] being compiled
+    b = @char 1;
+    return a + get(&b);         # 41 + 1
+}
+)", 42 },
+
+        // --- comptime ---
+        { "comptime calls, nested and inside a generic",
+R"(
+fn cube(x) {
+    return x * x * x;
+}
+
+fn table_base() {
+    return comptime cube(3);    # itself folded while comptime runs it
+}
+
+fn scaled[T](@T v) -> @T {
+    return v * comptime @T (table_base() - 25);
+}
+
+thread_local @int base = comptime (table_base() + cube(1));
+
+cfn main() {
+    c = scaled(@char 7);        # 7 * 2
+    return base + @int c;       # 28 + 14
+}
+)", 42 },
+
+        { "a chain of comptime globals",
+R"(
+fn step(x) { return x * 2; }
+
+g0 = comptime step(0);
+g1 = comptime (g0 + step(1));
+g2 = comptime (g1 + step(2));
+g3 = comptime (g2 + step(3));
+g4 = comptime (g3 + step(4));
+g5 = comptime (g4 + step(5));
+g6 = comptime (g5 + step(6));
+g7 = comptime (g6 + step(7));
+g8 = comptime (g7 + step(8));
+g9 = comptime (g8 + step(9));
+g10 = comptime (g9 + step(10));
+g11 = comptime (g10 + step(11));
+g12 = comptime (g11 + step(12));
+g13 = comptime (g12 + step(13));
+g14 = comptime (g13 + step(14));
+g15 = comptime (g14 + step(15));
+
+cfn main() {
+    return g15;     # every comptime runs once, not once per later one
+}
+)", 240 },
+
+        // --- heap to stack ---
+        { "non escaping calloc on the stack, returned malloc on the heap", PROMOTE_MAIN, 42 },
+
+        { "a malloc handed to realloc stays on the heap",
+R"(
+cfn malloc(@int size) -> @int*;
+cfn realloc(@int* p, @int size) -> @int*;
+cfn free(@int* p) -> @void;
+
+cfn main() {
+    p = malloc(16);         # nocapture in realloc, but realloc frees it
+    *p = 40;
+    q = realloc(p, 4096);
+    q[511] = 2;
+    r = *q + q[511];
+    free(q);
+    return r;
+}
+)", 42 },
+
+        // --- mid IR ---
+        { "phis from if arms, narrowing returns, code after return",
+R"(
+fn pick(a, b) {
+    x = a;
+    if (a < b) {
+        x = b;
+        y = 100;
+    }
+    else {
+        if (a == 7) return 70;
+    }
+    return x;
+}
+
+fn narrow(@char c) -> @bool {
+    d = c + 1;
+    return d;
+}
+
+fn twice(n) {
+    return n * 2;
+    n = n + 1;  # never runs
+    return n;
+}
+
+cfn main() {
+    r = pick(3, 9) + pick(9, 3) + pick(7, 3);   # 9 + 9 + 70
+    if (narrow(@char 255)) r = 0;
+    b = 3 < 4;
+    return (r - twice(b + 22)) + 2 * (7 / -2);  # 88 - 46 - 6
+}
+)", 36 },
+
+        // --- match ---
+        { "match arms, ranges, first arm wins, values the type cant hold",
+R"(
+fn op(code, a, b) {
+    r = 0;
+    match code {
+        0 r = a + b;
+        1 r = a - b;
+        2 { r = a * b; }
+        3, 4 return 100 + code;
+        10...1000 r = 7;
+        5...12 r = 8;       # 10, 11, 12 are already taken by the range above
+        -3 r = -1;
+        else r = 99;
+    }
+    return r;
+}
+
+fn narrow(@char c) {
+    match c {
+        -128...-1 return 1;
+        200 return 2;       # a char never holds 200
+        else return 3;
+    }
+    return 4;               # after a match where every arm returns
+}
+
+cfn main() {
+    s = op(0, 2, 3) + op(1, 9, 4) + op(2, 3, 3) + op(4, 0, 0) + op(500, 0, 0);
+    s = s + op(11, 0, 0) + op(6, 0, 0) + op(0 - 3, 0, 0) + op(2000, 0, 0);
+    return s + narrow(@char 200) * 10 + narrow(@char 5);    # 243 + 10 + 3
+}
+)", 256 },
+
+        { "match on the ends of the int range",
+R"(
+fn edge(x) {
+    match x {
+        -9223372036854775808 return 1;
+        9223372036854775807 return 2;
+        -9223372036854775807...-1 return 3;
+        else return 4;
+    }
+    return 0;
+}
+
+cfn main() {
+    lo = (0 - 9223372036854775807) - 1;
+    return edge(lo) + edge(lo + 1) * 10 + edge(9223372036854775807) * 100 + edge(0) * 1000;   # 1 + 30 + 200 + 4000
+}
+)", 4231 },
+
+        // --- conditional expressions ---
+        { "conditional select, guarded division and call, mixed widths",
+R"(
+thread_local @int calls = 0;
+
+fn bump(x) {
+    calls = calls + 1;
+    return x;
+}
+
+fn clamp(x, lo, hi) {
+    return if x < lo then lo else if x > hi then hi else x;
+}
+
+fn safe_div(a, b) {
+    return if b == 0 then 0 else a / b; # the division only runs when b != 0
+}
+
+fn pick(c, @char a, b) {
+    return if unpredictable(c) then a else b;
+}
+
+cfn main() {
+    r = clamp(5, 0, 3) + clamp(0 - 4, 0, 3) + clamp(2, 0, 3);   # 3 + 0 + 2
+    r = r + safe_div(7, 0) + safe_div(9, 2);                    # 0 + 4
+    r = r + pick(1, @char -1, 100) + pick(0, @char 1, 100);     # -1 + 100
+    x = if r > 0 then bump(1) else bump(2);                     # only bump(1) runs
+    if unpredictable(x == 1) r = r + 1;
+    return r + calls * 10 + x;                                  # 109 + 10 + 1
+}
+)", 120 },
+
+        { "conditional arms starting with a prefix operator or a paren",
+R"(
+fn abs_of(x) {
+    return if x < 0 then -x else x;
+}
+
+fn first(@int* p, c) {
+    return if c then *p else !c;
+}
+
+cfn main() {
+    a = 4;
+    b = 6;
+    s = if a < b then (a + b) else b;                   # 10
+    p = if a then &a else &b;
+    return abs_of(0 - 20) + abs_of(5) + s + first(p, 1) + first(p, 0);   # 20 + 5 + 10 + 4 + 1
+}
+)", 40 },
+
+        // --- branch hints ---
+        { "likely/unlikely conditions, cold if and match arms",
+R"(
+fn sum(@int* p, n) {
+    if unlikely(n == 0) return 0;
+    return *p + sum(p, n - 1);
+}
+
+fn check(x) {
+    r = 0;
+    if x < 0 cold {
+        r = 100;
+        if (x < 0 - 10) r = 200;    # nested inside the moved blocks
+    } else r = x;
+    return r;
+}
+
+fn kind(c) {
+    match c {
+        0 return 1;
+        1...500 return 2;
+        1000...5000 cold return 3;
+        else cold return 4;
+    }
+    return 0;
+}
+
+cfn main() {
+    a = 5;
+    x = if likely(a > 0) then 1 else 2;
+    s = sum(&a, 3) + check(0 - 20) + check(7);                  # 15 + 200 + 7
+    return s + kind(0) + kind(7) + kind(2000) + kind(-4) + x;   # 222 + 10 + 1
+}
+)", 233 },
+
+        // --- aliasing ---
+        { "restrict parameters, typed and char stores through pointers",
+R"(
+fn typed(@int* a, @bool* b) {
+    x = *a;
+    *b = @bool 1;       # a bool store cant change an int
+    return x + *a;
+}
+
+fn restricted(@int* restrict p, @int* restrict q) {
+    *q = 1;
+    x = *p;
+    *q = 2;             # q doesnt point into p
+    return x + *p;
+}
+
+fn chars(@int* a, @char* c) {
+    x = *a;
+    *c = @char 7;       # char can alias anything, *a is read again
+    return x + *a;
+}
+
+cfn main() {
+    v = 20;
+    w = 0;
+    f = @bool 0;
+    r = typed(&v, &f) + restricted(&v, &w);                 # 40 + 40
+    return (r + chars(&v, @char* &v) + w + @int f) - 87;    # 80 + (20 + 7) + 2 + 1
+}
+)", 23 },
+
+        // --- pointer arithmetic ---
+        { "pointer steps, differences, subscripts and compares",
+R"(
+cfn malloc(@int size) -> @int*;
+cfn free(@void*) -> @void;
+
+fn sum(@int* p, @int* end) {
+    if (p == end) return 0;
+    return *p + sum(p + 1, end);
+}
+
+fn fill(@int* p, i, n) {
+    if (i == n) return 0;
+    p[i] = i * i;
+    return fill(p, i + 1, n);
+}
+
+cfn main() {
+    a = malloc(8 * 10);
+    fill(a, 0, 10);
+    end = a + 10;
+    n = end - a;                    # 10
+    s = sum(a, end);                # 285
+    last = a[@char 9];              # 81
+    b = (end - 1) - a;              # 9
+    v = @void* a;
+    x = *(@int* (v + 8));           # void* steps bytes, a[1]
+    ok = a < end && 2 + a == a + 2;
+    free(v);
+    return s + n + last + b + x + ok;   # 285 + 10 + 81 + 9 + 1 + 1
+}
+)", 387 },
+
+        // --- global variables ---
+        { "mutable globals, typed, cast and comptime initializers, thread_local",
+R"(
+calls = 0;
+@i32 limit = -3;
+small = @char 100;
+table_base = comptime (6 * 7);
+@int* last = 0;
+thread_local hits = 0;
+
+fn count(x) {
+    calls = calls + 1;
+    hits = hits + 1;
+    return x;
+}
+
+fn remember(@int* p) {
+    last = p;
+    return 0;
+}
+
+cfn main() {
+    count(1);
+    count(2);
+    a = 5;
+    remember(&a);
+    *last = 9;
+    small = small + @char 1;
+    return calls + hits + @int limit + @int small + table_base + a;   # 2 + 2 - 3 + 101 + 42 + 9
+}
+)", 153 },
+
+        { "global initializers at the ends of their types",
+R"(
+@int lowest = -9223372036854775808;
+@int highest = 9223372036854775807;
+@char c = -128;
+@i32 big = 2147483647;
+@bool yes = 1;
+
+cfn main() {
+    a = (lowest + highest) + 2;         # 1
+    return a + @int c + @int (big - @i32 2147483600) + @int yes + 128;   # 1 - 128 + 47 + 1 + 128
+}
+)", 49 },
+
+        // --- lexing ---
+        { "names starting with keywords",
+R"(
+cfn main() {
+    iffy = 2;
+    returned = iffy + 1;   # not 'return ed'
+    return returned;
+}
+)", 3 },
+
         // --- equality truth check like earlier ---
         { "logical inversion equality",
 R"(
@@ -225,14 +1074,36 @@ cfn main() {
 )", 1 },
     };
 
+    // every case once JITed and once interpreted (falls back to the JIT outside the mid IR)
     int passed = 0;
-    for (auto& t : tests) {
-        if (run_case(t))
+    for (Engine engine : {Engine::Jit, Engine::Interp})
+        for (auto& t : tests) {
+            if (run_case(t, engine))
+                ++passed;
+            else
+                std::cerr << "❌ " << t.name << " failed\n";
+        }
+
+    std::vector<CheckCase> check_cases = {
+        { "--no-strict-aliasing drops the tbaa tags", no_strict_aliasing_drops_tbaa },
+        { "heap to stack promotes the calloc, not the returned malloc", heap_to_stack_promotion },
+        { "heap to stack leaves recursion through spawn alone", spawned_recursion_stays_on_heap },
+        { "--link a shared library", link_shared_library },
+        { "--link-archive with object members", link_object_archive },
+        { "--link-archive with bitcode members, file and REPL", link_bitcode_archive },
+        { "--link-archive with nothing usable is rejected", unusable_archive_rejected },
+        { "smallc round trip", smallc_round_trip },
+        { "smallc exported globals", smallc_exported_globals },
+        { "smallc with wrapping sizes or truncated is rejected", smallc_corrupt_rejected },
+    };
+    for (auto& c : check_cases) {
+        if (c.run())
             ++passed;
         else
-            std::cerr << "❌ " << t.name << " failed\n";
+            std::cerr << "❌ " << c.name << " failed\n";
     }
 
-    std::cout << "\n=== " << passed << " / " << tests.size() << " passed ===\n";
-    return (passed == (int)tests.size()) ? 0 : 1;
+    size_t total = tests.size() * 2 + check_cases.size();
+    std::cout << "\n=== " << passed << " / " << total << " passed ===\n";
+    return (passed == (int)total) ? 0 : 1;
 }
@@ -0,0 +1,5 @@
+// native code test_compile links in through --link and --link-archive
+
+extern "C" long long native_add(long long a, long long b) {
+    return a + b;
+}